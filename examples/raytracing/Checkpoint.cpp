@@ -0,0 +1,263 @@
+#include "Checkpoint.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char Magic[8] = "RTCKPT";
+constexpr uint32_t Version = 2; // 2: depths
+// slots start on a page so that each one can be synced on its own
+constexpr size_t SlotAlignment = 4096;
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+Checkpoint::Checkpoint(std::string path) : m_Path(std::move(path)) {}
+
+Checkpoint::~Checkpoint() {
+  Wait();
+  Unmap();
+}
+
+size_t Checkpoint::SlotSize(uint32_t width, uint32_t height) {
+  const size_t pixels = (size_t)width * height;
+  return AlignUp(sizeof(SlotHeader) + pixels * sizeof(glm::vec4) +
+                     pixels * sizeof(uint32_t) + pixels * sizeof(float),
+                 SlotAlignment);
+}
+
+size_t Checkpoint::FileSize(uint32_t width, uint32_t height) {
+  return SlotAlignment + 2 * SlotSize(width, height);
+}
+
+Checkpoint::SlotHeader *Checkpoint::GetSlot(int slot) const {
+  return reinterpret_cast<SlotHeader *>(m_Data + SlotAlignment +
+                                        slot * SlotSize(m_Width, m_Height));
+}
+
+int Checkpoint::NewestSlot() const {
+  const Header *header = reinterpret_cast<const Header *>(m_Data);
+  if (std::memcmp(header->Magic, Magic, sizeof(Magic)) != 0 ||
+      header->Version != Version || header->Width != m_Width ||
+      header->Height != m_Height)
+    return -1;
+
+  const uint64_t first = GetSlot(0)->Sequence;
+  const uint64_t second = GetSlot(1)->Sequence;
+  if (first == 0 && second == 0)
+    return -1;
+  return first > second ? 0 : 1;
+}
+
+bool Checkpoint::Restore(uint32_t width, uint32_t height, State &state,
+                         glm::vec4 *accumulation, uint32_t *sampleCounts,
+                         float *depths) {
+  Wait();
+  if (!Map(width, height, false))
+    return false;
+
+  const int slot = NewestSlot();
+  if (slot < 0)
+    return false;
+  const SlotHeader *saved = GetSlot(slot);
+  if (saved->Key != state.Key)
+    return false;
+
+  const size_t pixels = (size_t)width * height;
+  const std::byte *data = reinterpret_cast<const std::byte *>(saved + 1);
+  std::memcpy(accumulation, data, pixels * sizeof(glm::vec4));
+  std::memcpy(sampleCounts, data + pixels * sizeof(glm::vec4),
+              pixels * sizeof(uint32_t));
+  std::memcpy(depths,
+              data + pixels * (sizeof(glm::vec4) + sizeof(uint32_t)),
+              pixels * sizeof(float));
+
+  state.FrameIndex = saved->FrameIndex;
+  state.Seed = saved->Seed;
+  m_SavedFrameIndex = saved->FrameIndex;
+  return true;
+}
+
+bool Checkpoint::Save(uint32_t width, uint32_t height, const State &state,
+                      const glm::vec4 *accumulation,
+                      const uint32_t *sampleCounts, const float *depths) {
+  if (m_Pending.valid()) {
+    if (m_Pending.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready)
+      return false;
+    m_Pending.get();
+  }
+
+  const size_t pixels = (size_t)width * height;
+  m_Accumulation.assign(accumulation, accumulation + pixels);
+  m_SampleCounts.assign(sampleCounts, sampleCounts + pixels);
+  m_Depths.assign(depths, depths + pixels);
+  m_Pending = std::async(std::launch::async, [this, width, height, state]() {
+    Write(width, height, state);
+  });
+  return true;
+}
+
+void Checkpoint::Wait() {
+  if (m_Pending.valid())
+    m_Pending.get();
+}
+
+void Checkpoint::Write(uint32_t width, uint32_t height, State state) {
+  if (!Map(width, height, true)) {
+    m_Failed = true;
+    return;
+  }
+
+  const int newest = NewestSlot();
+  if (newest < 0) {
+    Header *header = reinterpret_cast<Header *>(m_Data);
+    std::memcpy(header->Magic, Magic, sizeof(Magic));
+    header->Version = Version;
+    header->Width = width;
+    header->Height = height;
+    header->Reserved = 0;
+    if (!Sync(0, sizeof(Header))) {
+      m_Failed = true;
+      return;
+    }
+  }
+
+  const int slot = newest == 0 ? 1 : 0;
+  const uint64_t sequence = newest < 0 ? 1 : GetSlot(newest)->Sequence + 1;
+  const size_t slotOffset = SlotAlignment + slot * SlotSize(width, height);
+  SlotHeader *target = GetSlot(slot);
+
+  // invalidate the slot before its data changes, validate it once the data
+  // is on disk
+  target->Sequence = 0;
+  bool written = Sync(slotOffset, sizeof(SlotHeader));
+
+  const size_t pixels = (size_t)width * height;
+  std::byte *data = reinterpret_cast<std::byte *>(target + 1);
+  std::memcpy(data, m_Accumulation.data(), pixels * sizeof(glm::vec4));
+  std::memcpy(data + pixels * sizeof(glm::vec4), m_SampleCounts.data(),
+              pixels * sizeof(uint32_t));
+  std::memcpy(data + pixels * (sizeof(glm::vec4) + sizeof(uint32_t)),
+              m_Depths.data(), pixels * sizeof(float));
+  target->Key = state.Key;
+  target->FrameIndex = state.FrameIndex;
+  target->Seed = state.Seed;
+  written = written && Sync(slotOffset, SlotSize(width, height));
+
+  target->Sequence = sequence;
+  written = written && Sync(slotOffset, sizeof(SlotHeader));
+
+  if (written)
+    m_SavedFrameIndex = state.FrameIndex;
+  m_Failed = !written;
+}
+
+#ifdef _WIN32
+
+bool Checkpoint::Map(uint32_t width, uint32_t height, bool create) {
+  if (!m_Fallback.empty() && m_Width == width && m_Height == height)
+    return true;
+  Unmap();
+
+  const size_t size = FileSize(width, height);
+  std::ifstream file(m_Path, std::ios::binary | std::ios::ate);
+  if (file && (size_t)file.tellg() == size) {
+    m_Fallback.resize(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(m_Fallback.data()), size);
+  } else {
+    if (!create)
+      return false;
+    m_Fallback.assign(size, std::byte{0});
+    std::ofstream out(m_Path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(m_Fallback.data()), size);
+    if (!out)
+      return false;
+  }
+
+  m_Data = m_Fallback.data();
+  m_Size = size;
+  m_Width = width;
+  m_Height = height;
+  return true;
+}
+
+void Checkpoint::Unmap() {
+  m_Fallback.clear();
+  m_Data = nullptr;
+  m_Size = 0;
+  m_Width = m_Height = 0;
+}
+
+bool Checkpoint::Sync(size_t offset, size_t size) {
+  std::fstream file(m_Path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(reinterpret_cast<const char *>(m_Data + offset), size);
+  file.flush();
+  return (bool)file;
+}
+
+#else
+
+bool Checkpoint::Map(uint32_t width, uint32_t height, bool create) {
+  if (m_Data && m_Width == width && m_Height == height)
+    return true;
+  Unmap();
+
+  const int fd = open(m_Path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+
+  const size_t size = FileSize(width, height);
+  struct stat info {};
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size != size) {
+    // a file of another size is another render: start from an empty one
+    if (!create || ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+      close(fd);
+      return false;
+    }
+  }
+
+  void *mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  m_Data = static_cast<std::byte *>(mapping);
+  m_Size = size;
+  m_Width = width;
+  m_Height = height;
+  return true;
+}
+
+void Checkpoint::Unmap() {
+  if (m_Data)
+    munmap(m_Data, m_Size);
+  m_Data = nullptr;
+  m_Size = 0;
+  m_Width = m_Height = 0;
+}
+
+bool Checkpoint::Sync(size_t offset, size_t size) {
+  // msync wants a page aligned start
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t start = offset / page * page;
+  return msync(m_Data + start, offset + size - start, MS_SYNC) == 0;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Progress of an accumulation render kept on disk, so that a render can be
+// stopped (or crash) and pick up where it was on the next launch.
+//
+// The file holds two slots, each one a full copy of the accumulation buffer,
+// the per-pixel sample counts and depths (the reprojection compares against
+// them) and the random sequence position. Saves go to
+// the older slot and only mark it valid once its data is on disk, so a save
+// that is cut short leaves the previous one intact.
+//
+// Saving copies the buffers on the calling thread (one memcpy) and writes the
+// mapped file on a background task, the render threads never wait for the
+// disk.
+class Checkpoint {
+public:
+  struct State {
+    // hash of everything the accumulated samples depend on, see
+    // Renderer::StateKey()
+    uint64_t Key = 0;
+    uint32_t FrameIndex = 1; // frame the render continues with
+    uint32_t Seed = 0;
+  };
+
+public:
+  explicit Checkpoint(std::string path);
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+  ~Checkpoint(); // waits for the pending save
+
+  // Reads the newest complete save into `accumulation`, `sampleCounts` and
+  // `depths` (width * height each) if it was taken at this size with the same
+  // key
+  bool Restore(uint32_t width, uint32_t height, State &state,
+               glm::vec4 *accumulation, uint32_t *sampleCounts, float *depths);
+
+  // Starts saving a copy of the buffers, false if the previous save is still
+  // being written
+  bool Save(uint32_t width, uint32_t height, const State &state,
+            const glm::vec4 *accumulation, const uint32_t *sampleCounts,
+            const float *depths);
+  // Blocks until the pending save is on disk
+  void Wait();
+
+  const std::string &GetPath() const { return m_Path; }
+  // frame index of the last save that made it to disk, 0 before the first one
+  uint32_t GetSavedFrameIndex() const { return m_SavedFrameIndex; }
+  bool Failed() const { return m_Failed; }
+
+private:
+  struct Header {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Reserved;
+  };
+
+  struct SlotHeader {
+    uint64_t Sequence; // 0 while the slot is being written
+    uint64_t Key;
+    uint32_t FrameIndex;
+    uint32_t Seed;
+    uint32_t Reserved[2];
+  };
+
+  static size_t SlotSize(uint32_t width, uint32_t height);
+  static size_t FileSize(uint32_t width, uint32_t height);
+
+  // Maps the file with the layout for `width` x `height`, `create` resizes
+  // (and so clears) a file of another size
+  bool Map(uint32_t width, uint32_t height, bool create);
+  void Unmap();
+  // Pushes a range of the mapping to disk
+  bool Sync(size_t offset, size_t size);
+
+  SlotHeader *GetSlot(int slot) const;
+  // newest valid slot, -1 if there is none
+  int NewestSlot() const;
+  void Write(uint32_t width, uint32_t height, State state);
+
+private:
+  std::string m_Path;
+
+  std::byte *m_Data = nullptr;
+  size_t m_Size = 0;
+  uint32_t m_Width = 0, m_Height = 0;
+  std::vector<std::byte> m_Fallback; // used where mmap is not available
+
+  // copy of the buffers being written
+  std::vector<glm::vec4> m_Accumulation;
+  std::vector<uint32_t> m_SampleCounts;
+  std::vector<float> m_Depths;
+  std::future<void> m_Pending;
+
+  std::atomic<uint32_t> m_SavedFrameIndex = 0;
+  std::atomic<bool> m_Failed = false;
+};
@@ -0,0 +1,699 @@
+#include "Mesh.h"
+
+#include "Walnut/Timer.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char Magic[8] = "RTMESH";
+constexpr uint32_t Version = 1;
+// buffers of the cache file start on this
+constexpr size_t BufferAlignment = 16;
+// the sources are hashed by blocks of this size, in parallel. Fixed, so that a
+// model has the same key on every machine
+constexpr size_t HashBlockSize = 1 << 20;
+// smallest chunk of OBJ text a parsing task gets
+constexpr size_t MinChunkSize = 1 << 18;
+constexpr uint32_t NoMaterial = UINT32_MAX;
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t Mix(uint64_t value) {
+  value *= 0x9e3779b97f4a7c15ull;
+  return value ^ (value >> 32);
+}
+
+// a word at a time, the OBJ files worth caching are big
+uint64_t HashBytes(std::string_view bytes, uint64_t seed) {
+  uint64_t hash = Mix(seed ^ bytes.size());
+  size_t i = 0;
+  for (; i + 8 <= bytes.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes.data() + i, 8);
+    hash = Mix(hash ^ word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+  return Mix(hash ^ tail);
+}
+
+uint64_t HashParallel(std::string_view bytes, uint64_t seed) {
+  std::vector<size_t> blocks((bytes.size() + HashBlockSize - 1) /
+                             HashBlockSize);
+  std::iota(blocks.begin(), blocks.end(), 0);
+  std::vector<uint64_t> hashes(blocks.size());
+  std::for_each(std::execution::par, blocks.begin(), blocks.end(),
+                [&](size_t block) {
+                  hashes[block] =
+                      HashBytes(bytes.substr(block * HashBlockSize,
+                                             HashBlockSize),
+                                block);
+                });
+
+  uint64_t hash = Mix(seed ^ bytes.size());
+  for (uint64_t blockHash : hashes)
+    hash = Mix(hash ^ blockHash);
+  return hash;
+}
+
+std::string_view AsText(const std::byte *data, size_t size) {
+  return {reinterpret_cast<const char *>(data), size};
+}
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+std::string_view TrimLeft(std::string_view text) {
+  size_t i = 0;
+  while (i < text.size() && IsSpace(text[i]))
+    ++i;
+  return text.substr(i);
+}
+
+std::string_view Trim(std::string_view text) {
+  text = TrimLeft(text);
+  while (!text.empty() && IsSpace(text.back()))
+    text.remove_suffix(1);
+  return text;
+}
+
+// splits `line` into its keyword and the rest
+std::pair<std::string_view, std::string_view>
+SplitKeyword(std::string_view line) {
+  line = TrimLeft(line);
+  size_t end = 0;
+  while (end < line.size() && !IsSpace(line[end]))
+    ++end;
+  return {line.substr(0, end), TrimLeft(line.substr(end))};
+}
+
+// reads floats off the front of `text`, false if there are fewer than `count`
+template <size_t N>
+bool ParseFloats(std::string_view text, std::array<float, N> &values,
+                 size_t count = N) {
+  for (size_t i = 0; i < N; ++i) {
+    text = TrimLeft(text);
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), values[i]);
+    if (error != std::errc()) {
+      if (i < count)
+        return false;
+      values[i] = 0.0f;
+      continue;
+    }
+    text.remove_prefix(end - text.data());
+  }
+  return true;
+}
+
+// calls `onLine` with every line of `text`, without the line break
+template <typename F> void ForEachLine(std::string_view text, F &&onLine) {
+  while (!text.empty()) {
+    const size_t end = text.find('\n');
+    onLine(text.substr(0, end));
+    if (end == std::string_view::npos)
+      break;
+    text.remove_prefix(end + 1);
+  }
+}
+
+// mtllib statements of an OBJ, in order
+std::vector<std::string> FindMaterialLibraries(std::string_view obj) {
+  std::vector<std::string> libraries;
+  for (size_t start = 0; start < obj.size();) {
+    const size_t end = std::min(obj.find('\n', start), obj.size());
+    const auto [keyword, rest] =
+        SplitKeyword(obj.substr(start, end - start));
+    if (keyword == "mtllib")
+      libraries.emplace_back(Trim(rest));
+    start = end + 1;
+  }
+  return libraries;
+}
+
+// One corner of a face, 0 based indices, -1 when it has no uv or normal.
+// Negative (relative) OBJ indices are resolved within the chunk first, the
+// bits of Relative mark those that still need the chunk offsets.
+struct Corner {
+  int32_t Position, UV, Normal;
+  uint32_t Relative;
+};
+
+struct ParsedChunk {
+  std::vector<glm::vec3> Positions, Normals;
+  std::vector<glm::vec2> UVs;
+  std::vector<Corner> Corners; // three per triangle
+  // per triangle, into UsedMaterials. NoMaterial before the first usemtl of
+  // the chunk: the material active at the end of the previous chunks applies
+  std::vector<uint32_t> TriangleMaterials;
+  std::vector<std::string> UsedMaterials;
+  bool Failed = false;
+};
+
+// `index` of a face, as the 0 based index in its array (`count` items so far
+// in the chunk). False for 0, which OBJ doesn't have.
+bool ResolveIndex(int32_t index, size_t count, uint32_t relativeBit,
+                  int32_t &resolved, uint32_t &relative) {
+  if (index > 0) {
+    resolved = index - 1;
+  } else if (index < 0) {
+    resolved = (int32_t)count + index;
+    relative |= relativeBit;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseCorner(std::string_view token, const ParsedChunk &chunk,
+                 Corner &corner) {
+  std::array<int32_t, 3> indices{0, 0, 0};
+  for (size_t part = 0; part < 3 && !token.empty(); ++part) {
+    if (token.front() != '/') {
+      const auto [end, error] = std::from_chars(
+          token.data(), token.data() + token.size(), indices[part]);
+      if (error != std::errc())
+        return false;
+      token.remove_prefix(end - token.data());
+    }
+    if (!token.empty()) {
+      if (token.front() != '/')
+        return false;
+      token.remove_prefix(1);
+    }
+  }
+
+  corner = {-1, -1, -1, 0};
+  if (!ResolveIndex(indices[0], chunk.Positions.size(), 1, corner.Position,
+                    corner.Relative))
+    return false;
+  if (indices[1] != 0)
+    ResolveIndex(indices[1], chunk.UVs.size(), 2, corner.UV, corner.Relative);
+  if (indices[2] != 0)
+    ResolveIndex(indices[2], chunk.Normals.size(), 4, corner.Normal,
+                 corner.Relative);
+  return true;
+}
+
+void ParseChunk(std::string_view text, ParsedChunk &chunk) {
+  std::vector<Corner> face;
+  ForEachLine(text, [&](std::string_view line) {
+    if (chunk.Failed)
+      return;
+    const auto [keyword, rest] = SplitKeyword(line);
+    if (keyword == "v") {
+      std::array<float, 3> values;
+      chunk.Failed = !ParseFloats(rest, values);
+      chunk.Positions.emplace_back(values[0], values[1], values[2]);
+    } else if (keyword == "vn") {
+      std::array<float, 3> values;
+      chunk.Failed = !ParseFloats(rest, values);
+      chunk.Normals.emplace_back(values[0], values[1], values[2]);
+    } else if (keyword == "vt") {
+      std::array<float, 2> values;
+      chunk.Failed = !ParseFloats(rest, values, 1);
+      chunk.UVs.emplace_back(values[0], values[1]);
+    } else if (keyword == "f") {
+      face.clear();
+      std::string_view corners = rest;
+      while (!corners.empty()) {
+        size_t end = 0;
+        while (end < corners.size() && !IsSpace(corners[end]))
+          ++end;
+        Corner corner;
+        if (!ParseCorner(corners.substr(0, end), chunk, corner)) {
+          chunk.Failed = true;
+          return;
+        }
+        face.push_back(corner);
+        corners = TrimLeft(corners.substr(end));
+      }
+      if (face.size() < 3) {
+        chunk.Failed = true;
+        return;
+      }
+      // a fan around the first corner
+      const uint32_t material =
+          chunk.UsedMaterials.empty()
+              ? NoMaterial
+              : (uint32_t)chunk.UsedMaterials.size() - 1;
+      for (size_t i = 2; i < face.size(); ++i) {
+        chunk.Corners.push_back(face[0]);
+        chunk.Corners.push_back(face[i - 1]);
+        chunk.Corners.push_back(face[i]);
+        chunk.TriangleMaterials.push_back(material);
+      }
+    } else if (keyword == "usemtl") {
+      chunk.UsedMaterials.emplace_back(Trim(rest));
+    }
+  });
+}
+
+// splits `text` into about `count` chunks, each one ending after a line break
+std::vector<std::string_view> SplitChunks(std::string_view text,
+                                          size_t count) {
+  std::vector<std::string_view> chunks;
+  const size_t chunkSize = std::max(MinChunkSize, text.size() / count + 1);
+  while (!text.empty()) {
+    size_t end = text.size();
+    if (chunkSize < text.size()) {
+      end = text.find('\n', chunkSize);
+      end = end == std::string_view::npos ? text.size() : end + 1;
+    }
+    chunks.push_back(text.substr(0, end));
+    text.remove_prefix(end);
+  }
+  return chunks;
+}
+
+void CopyName(char *destination, size_t size, std::string_view name) {
+  const size_t length = std::min(name.size(), size - 1);
+  std::memcpy(destination, name.data(), length);
+  destination[length] = '\0';
+}
+
+std::vector<Mesh::MeshMaterial> ParseMaterialLibrary(std::string_view text) {
+  std::vector<Mesh::MeshMaterial> materials;
+  ForEachLine(text, [&](std::string_view line) {
+    const auto [keyword, rest] = SplitKeyword(line);
+    if (keyword == "newmtl") {
+      CopyName(materials.emplace_back().Name, sizeof(Mesh::MeshMaterial::Name),
+               Trim(rest));
+    } else if (materials.empty()) {
+      return;
+    } else if (keyword == "Kd" || keyword == "Ke") {
+      std::array<float, 3> values;
+      if (ParseFloats(rest, values))
+        (keyword == "Kd" ? materials.back().Albedo
+                         : materials.back().EmissionColor) =
+            glm::vec3(values[0], values[1], values[2]);
+    } else if (keyword == "Ns") {
+      // the roughness of the Beckmann distribution matching that Phong lobe
+      std::array<float, 1> exponent;
+      if (ParseFloats(rest, exponent))
+        materials.back().Roughness = std::clamp(
+            std::sqrt(2.0f / (std::max(exponent[0], 0.0f) + 2.0f)), 0.0f,
+            1.0f);
+    } else if (keyword == "Pm") {
+      std::array<float, 1> metallic;
+      if (ParseFloats(rest, metallic))
+        materials.back().Metallic = std::clamp(metallic[0], 0.0f, 1.0f);
+    } else if (keyword == "map_Kd") {
+      // options come first, the file name is the last word
+      const std::string_view path = Trim(rest);
+      const size_t start = path.find_last_of(" \t");
+      CopyName(materials.back().AlbedoMap,
+               sizeof(Mesh::MeshMaterial::AlbedoMap),
+               start == std::string_view::npos ? path : path.substr(start + 1));
+    }
+  });
+  return materials;
+}
+
+// hashes the triplets of the dedup table
+struct CornerHash {
+  size_t operator()(const Corner &corner) const {
+    return Mix(((uint64_t)(uint32_t)corner.Position << 32 |
+                (uint32_t)corner.UV) ^
+               Mix((uint32_t)corner.Normal));
+  }
+};
+
+struct CornerEqual {
+  bool operator()(const Corner &a, const Corner &b) const {
+    return a.Position == b.Position && a.UV == b.UV && a.Normal == b.Normal;
+  }
+};
+
+} // namespace
+
+Mesh::~Mesh() = default;
+
+std::shared_ptr<const Mesh> Mesh::Load(const std::string &objPath,
+                                       const std::string &cacheDirectory) {
+  Walnut::Timer timer;
+  MappedFile obj;
+  if (!obj.Open(objPath))
+    return nullptr;
+
+  std::shared_ptr<Mesh> mesh(new Mesh());
+  const uint64_t key = SourceKey(objPath, obj);
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  const std::string cachePath =
+      (std::filesystem::path(cacheDirectory) /
+       (std::filesystem::path(objPath).stem().string() + "-" + name +
+        ".rtmesh"))
+          .string();
+
+  if (mesh->m_Cache.Open(cachePath) &&
+      mesh->View(mesh->m_Cache.GetData(), mesh->m_Cache.GetSize(), key)) {
+    mesh->m_LoadStats.FromCache = true;
+  } else {
+    if (!mesh->Import(objPath, obj, key))
+      return nullptr;
+    // without a cache the next launch imports again, nothing else changes
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    mesh->WriteCache(cachePath);
+  }
+  mesh->m_LoadStats.LoadTime = timer.ElapsedMillis();
+  return mesh;
+}
+
+uint64_t Mesh::SourceKey(const std::string &objPath, const MappedFile &obj) {
+  const std::string_view text = AsText(obj.GetData(), obj.GetSize());
+  uint64_t key = HashParallel(text, Version);
+  const auto directory = std::filesystem::path(objPath).parent_path();
+  for (const std::string &library : FindMaterialLibraries(text)) {
+    MappedFile mtl;
+    key = Mix(key ^ HashBytes(library, 0));
+    if (mtl.Open((directory / library).string()))
+      key = HashParallel(AsText(mtl.GetData(), mtl.GetSize()), key);
+  }
+  return key;
+}
+
+bool Mesh::Import(const std::string &objPath, const MappedFile &obj,
+                  uint64_t key) {
+  const std::string_view text = AsText(obj.GetData(), obj.GetSize());
+
+  // parse
+  const auto chunkTexts = SplitChunks(
+      text, 4 * std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<ParsedChunk> chunks(chunkTexts.size());
+  std::vector<size_t> chunkIndices(chunks.size());
+  std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+  std::for_each(
+      std::execution::par, chunkIndices.begin(), chunkIndices.end(),
+      [&](size_t chunk) { ParseChunk(chunkTexts[chunk], chunks[chunk]); });
+
+  // materials
+  std::vector<MeshMaterial> materials;
+  const auto directory = std::filesystem::path(objPath).parent_path();
+  for (const std::string &library : FindMaterialLibraries(text)) {
+    MappedFile mtl;
+    if (!mtl.Open((directory / library).string()))
+      continue;
+    auto parsed = ParseMaterialLibrary(AsText(mtl.GetData(), mtl.GetSize()));
+    materials.insert(materials.end(), parsed.begin(), parsed.end());
+  }
+  // the keys point into the names, room for the default material is made
+  // first so that adding it never moves them
+  materials.reserve(materials.size() + 1);
+  std::unordered_map<std::string_view, uint32_t> materialIndices;
+  for (uint32_t i = 0; i < materials.size(); ++i)
+    materialIndices.emplace(materials[i].Name, i);
+  uint32_t defaultMaterial = NoMaterial;
+  const auto findMaterial = [&](std::string_view name) {
+    if (const auto found = materialIndices.find(name);
+        found != materialIndices.end())
+      return found->second;
+    if (defaultMaterial == NoMaterial) {
+      defaultMaterial = (uint32_t)materials.size();
+      CopyName(materials.emplace_back().Name, sizeof(MeshMaterial::Name),
+               "default");
+    }
+    return defaultMaterial;
+  };
+
+  // merge the chunks, resolving the indices against the whole file
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<Corner> corners;
+  std::vector<uint32_t> triangleMaterials;
+  // usemtl in effect at the start of the chunk, empty before the first one
+  std::string_view activeMaterial;
+  for (ParsedChunk &chunk : chunks) {
+    if (chunk.Failed)
+      return false;
+    const auto positionOffset = (int32_t)positions.size();
+    const auto uvOffset = (int32_t)uvs.size();
+    const auto normalOffset = (int32_t)normals.size();
+    positions.insert(positions.end(), chunk.Positions.begin(),
+                     chunk.Positions.end());
+    uvs.insert(uvs.end(), chunk.UVs.begin(), chunk.UVs.end());
+    normals.insert(normals.end(), chunk.Normals.begin(), chunk.Normals.end());
+
+    for (Corner corner : chunk.Corners) {
+      if (corner.Relative & 1)
+        corner.Position += positionOffset;
+      if (corner.Relative & 2)
+        corner.UV += uvOffset;
+      if (corner.Relative & 4)
+        corner.Normal += normalOffset;
+      // relative indices are only resolved now, they may point before the
+      // file start
+      if (corner.Position < 0 || corner.Position >= (int32_t)positions.size() ||
+          (corner.Relative & 2 && corner.UV < 0) ||
+          corner.UV >= (int32_t)uvs.size() ||
+          (corner.Relative & 4 && corner.Normal < 0) ||
+          corner.Normal >= (int32_t)normals.size())
+        return false;
+      corners.push_back(corner);
+    }
+
+    std::vector<uint32_t> used(chunk.UsedMaterials.size());
+    for (size_t i = 0; i < used.size(); ++i)
+      used[i] = findMaterial(chunk.UsedMaterials[i]);
+    uint32_t inherited = NoMaterial;
+    for (uint32_t material : chunk.TriangleMaterials) {
+      if (material == NoMaterial && inherited == NoMaterial)
+        inherited = findMaterial(activeMaterial);
+      triangleMaterials.push_back(material != NoMaterial ? used[material]
+                                                         : inherited);
+    }
+    if (!chunk.UsedMaterials.empty())
+      activeMaterial = chunk.UsedMaterials.back();
+  }
+
+  // one vertex per distinct position/uv/normal triplet
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices(corners.size());
+  std::vector<bool> needsNormal;
+  std::unordered_map<Corner, uint32_t, CornerHash, CornerEqual> distinct;
+  distinct.reserve(positions.size() * 2);
+  for (size_t i = 0; i < corners.size(); ++i) {
+    const Corner &corner = corners[i];
+    const auto [found, added] =
+        distinct.try_emplace(corner, (uint32_t)vertices.size());
+    if (added) {
+      Vertex &vertex = vertices.emplace_back();
+      vertex.Position = positions[corner.Position];
+      vertex.Normal =
+          corner.Normal >= 0 ? normals[corner.Normal] : glm::vec3(0.0f);
+      vertex.UV = corner.UV >= 0 ? uvs[corner.UV] : glm::vec2(0.0f);
+      needsNormal.push_back(corner.Normal < 0);
+    }
+    indices[i] = found->second;
+  }
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    Vertex &a = vertices[indices[i]];
+    Vertex &b = vertices[indices[i + 1]];
+    Vertex &c = vertices[indices[i + 2]];
+    // not normalized: larger faces weigh more
+    const glm::vec3 faceNormal =
+        glm::cross(b.Position - a.Position, c.Position - a.Position);
+    for (size_t corner = 0; corner < 3; ++corner) {
+      if (needsNormal[indices[i + corner]])
+        vertices[indices[i + corner]].Normal += faceNormal;
+    }
+  }
+  glm::vec3 boundsMin{std::numeric_limits<float>::max()};
+  glm::vec3 boundsMax{std::numeric_limits<float>::lowest()};
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    Vertex &vertex = vertices[i];
+    if (needsNormal[i]) {
+      const float length = glm::length(vertex.Normal);
+      vertex.Normal =
+          length > 0.0f ? vertex.Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    boundsMin = glm::min(boundsMin, vertex.Position);
+    boundsMax = glm::max(boundsMax, vertex.Position);
+  }
+
+  // lay everything out like the cache file
+  Header header{};
+  std::memcpy(header.Magic, Magic, sizeof(Magic));
+  header.Version = Version;
+  header.Key = key;
+  header.VertexCount = (uint32_t)vertices.size();
+  header.IndexCount = (uint32_t)indices.size();
+  header.MaterialCount = (uint32_t)materials.size();
+  header.VertexOffset = AlignUp(sizeof(Header), BufferAlignment);
+  header.IndexOffset = AlignUp(
+      header.VertexOffset + vertices.size() * sizeof(Vertex), BufferAlignment);
+  header.TriangleMaterialOffset = AlignUp(
+      header.IndexOffset + indices.size() * sizeof(uint32_t), BufferAlignment);
+  header.MaterialOffset =
+      AlignUp(header.TriangleMaterialOffset +
+                  triangleMaterials.size() * sizeof(uint32_t),
+              BufferAlignment);
+  for (int axis = 0; axis < 3; ++axis) {
+    header.BoundsMin[axis] = vertices.empty() ? 0.0f : boundsMin[axis];
+    header.BoundsMax[axis] = vertices.empty() ? 0.0f : boundsMax[axis];
+  }
+
+  m_Storage.assign(header.MaterialOffset +
+                       materials.size() * sizeof(MeshMaterial),
+                   std::byte{0});
+  std::memcpy(m_Storage.data(), &header, sizeof(Header));
+  std::memcpy(m_Storage.data() + header.VertexOffset, vertices.data(),
+              vertices.size() * sizeof(Vertex));
+  std::memcpy(m_Storage.data() + header.IndexOffset, indices.data(),
+              indices.size() * sizeof(uint32_t));
+  std::memcpy(m_Storage.data() + header.TriangleMaterialOffset,
+              triangleMaterials.data(),
+              triangleMaterials.size() * sizeof(uint32_t));
+  std::memcpy(m_Storage.data() + header.MaterialOffset, materials.data(),
+              materials.size() * sizeof(MeshMaterial));
+  return View(m_Storage.data(), m_Storage.size(), key);
+}
+
+bool Mesh::View(const std::byte *data, size_t size, uint64_t key) {
+  if (size < sizeof(Header))
+    return false;
+  const Header *header = reinterpret_cast<const Header *>(data);
+  if (std::memcmp(header->Magic, Magic, sizeof(Magic)) != 0 ||
+      header->Version != Version || header->Key != key ||
+      header->IndexCount % 3 != 0)
+    return false;
+
+  const auto fits = [size](uint64_t offset, uint64_t bytes) {
+    return offset % BufferAlignment == 0 && offset <= size &&
+           bytes <= size - offset;
+  };
+  const uint64_t triangles = header->IndexCount / 3;
+  if (!fits(header->VertexOffset, header->VertexCount * sizeof(Vertex)) ||
+      !fits(header->IndexOffset, header->IndexCount * sizeof(uint32_t)) ||
+      !fits(header->TriangleMaterialOffset, triangles * sizeof(uint32_t)) ||
+      !fits(header->MaterialOffset,
+            header->MaterialCount * sizeof(MeshMaterial)))
+    return false;
+
+  m_Data = data;
+  m_Header = header;
+  return true;
+}
+
+void Mesh::WriteCache(const std::string &path) const {
+  // written aside and renamed: a reader never sees half a file
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(m_Storage.data()),
+               m_Storage.size());
+    if (!file)
+      return;
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error)
+    std::filesystem::remove(temporary, error);
+}
+
+std::span<const Mesh::Vertex> Mesh::GetVertices() const {
+  return GetArray<Vertex>(m_Header->VertexOffset, m_Header->VertexCount);
+}
+
+std::span<const uint32_t> Mesh::GetIndices() const {
+  return GetArray<uint32_t>(m_Header->IndexOffset, m_Header->IndexCount);
+}
+
+std::span<const uint32_t> Mesh::GetTriangleMaterials() const {
+  return GetArray<uint32_t>(m_Header->TriangleMaterialOffset,
+                            m_Header->IndexCount / 3);
+}
+
+std::span<const Mesh::MeshMaterial> Mesh::GetMaterials() const {
+  return GetArray<MeshMaterial>(m_Header->MaterialOffset,
+                                m_Header->MaterialCount);
+}
+
+glm::vec3 Mesh::GetBoundsMin() const {
+  return {m_Header->BoundsMin[0], m_Header->BoundsMin[1],
+          m_Header->BoundsMin[2]};
+}
+
+glm::vec3 Mesh::GetBoundsMax() const {
+  return {m_Header->BoundsMax[0], m_Header->BoundsMax[1],
+          m_Header->BoundsMax[2]};
+}
+
+#ifdef _WIN32
+
+Mesh::MappedFile::~MappedFile() = default;
+
+bool Mesh::MappedFile::Open(const std::string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  m_Fallback.resize((size_t)file.tellg());
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(m_Fallback.data()), m_Fallback.size());
+  if (!file)
+    return false;
+  m_Data = m_Fallback.data();
+  m_Size = m_Fallback.size();
+  return true;
+}
+
+#else
+
+Mesh::MappedFile::~MappedFile() {
+  if (m_Mapped)
+    munmap(const_cast<std::byte *>(m_Data), m_Size);
+}
+
+bool Mesh::MappedFile::Open(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+  // an empty file can't be mapped, it's an empty view all the same
+  if (info.st_size == 0) {
+    close(fd);
+    return true;
+  }
+
+  void *mapping =
+      mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  m_Data = static_cast<const std::byte *>(mapping);
+  m_Size = (size_t)info.st_size;
+  m_Mapped = true;
+  return true;
+}
+
+#endif
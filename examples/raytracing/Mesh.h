@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Indexed triangle mesh imported from an OBJ file and its MTL libraries.
+//
+// Importing splits the OBJ text into chunks at line boundaries and parses
+// them in parallel, then deduplicates the position/uv/normal triplets of the
+// faces into one vertex buffer and a triangle index buffer. Polygons are
+// fanned into triangles, vertices without a normal get the area weighted
+// normal of their faces.
+//
+// The result is cached as a binary file named after a hash of the OBJ and MTL
+// contents. Later loads of an unchanged model map that file and use its
+// buffers in place, nothing is parsed or copied.
+class Mesh {
+public:
+  struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 UV;
+  };
+
+  // what the renderer has a use for in an MTL material
+  struct MeshMaterial {
+    glm::vec3 Albedo{0.8f};        // Kd
+    float Roughness = 1.0f;        // from the specular exponent Ns
+    glm::vec3 EmissionColor{0.0f}; // Ke
+    float Metallic = 0.0f;         // Pm
+    char Name[64] = {};
+    char AlbedoMap[192] = {}; // map_Kd, relative to the MTL file
+  };
+
+  struct LoadStats {
+    float LoadTime = 0.0f; // ms
+    bool FromCache = false;
+  };
+
+public:
+  // Loads `objPath` from its cache in `cacheDirectory` if the OBJ and its
+  // materials didn't change since, imports it and writes the cache otherwise.
+  // nullptr if the OBJ can't be read or is malformed.
+  static std::shared_ptr<const Mesh> Load(const std::string &objPath,
+                                          const std::string &cacheDirectory);
+
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  ~Mesh();
+
+  std::span<const Vertex> GetVertices() const;
+  // three per triangle
+  std::span<const uint32_t> GetIndices() const;
+  // one per triangle, into GetMaterials()
+  std::span<const uint32_t> GetTriangleMaterials() const;
+  std::span<const MeshMaterial> GetMaterials() const;
+  glm::vec3 GetBoundsMin() const;
+  glm::vec3 GetBoundsMax() const;
+  const LoadStats &GetLoadStats() const { return m_LoadStats; }
+
+private:
+  // layout of the cache file, the buffers follow at their offsets
+  struct Header {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Reserved;
+    uint64_t Key; // hash of the sources, see SourceKey()
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint32_t MaterialCount;
+    uint32_t Reserved2;
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    uint64_t TriangleMaterialOffset;
+    uint64_t MaterialOffset;
+    float BoundsMin[3];
+    float BoundsMax[3];
+  };
+
+  // Read only view of a whole file
+  class MappedFile {
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool Open(const std::string &path);
+    const std::byte *GetData() const { return m_Data; }
+    size_t GetSize() const { return m_Size; }
+
+  private:
+    const std::byte *m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_Mapped = false;
+    std::vector<std::byte> m_Fallback; // used where mmap is not available
+  };
+
+  Mesh() = default;
+
+  // hash of the OBJ text and of the MTL libraries it names
+  static uint64_t SourceKey(const std::string &objPath, const MappedFile &obj);
+  // parses the OBJ into m_Storage, laid out like the cache file
+  bool Import(const std::string &objPath, const MappedFile &obj, uint64_t key);
+  // points at the buffers of a cache file layout if it's complete and was
+  // made from the sources with `key`
+  bool View(const std::byte *data, size_t size, uint64_t key);
+  // writes m_Storage next to the other caches, replacing the file at once
+  void WriteCache(const std::string &path) const;
+
+  template <typename T>
+  std::span<const T> GetArray(uint64_t offset, uint32_t count) const {
+    return {reinterpret_cast<const T *>(m_Data + offset), count};
+  }
+
+private:
+  // either a mapped cache file or the freshly imported buffers
+  MappedFile m_Cache;
+  std::vector<std::byte> m_Storage;
+
+  const std::byte *m_Data = nullptr;
+  const Header *m_Header = nullptr;
+  LoadStats m_LoadStats;
+};
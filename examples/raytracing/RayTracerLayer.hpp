@@ -4,9 +4,12 @@
 #include "Walnut/Timer.h"
 
 #include "Camera.h"
+#include "Mesh.h"
+#include "RenderScheduler.h"
 #include "Renderer.h"
 
 #include "stb/stb_image.h"
+#include <future>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace Walnut;
@@ -15,6 +18,10 @@ const std::string MODEL_PATH = RESOURCE_DIR "/fourareen.obj";
 const std::string TEXTURE_PATH = RESOURCE_DIR "/fourareen2k_albedo.png";
 const std::string EARTHMAP_PATH = RESOURCE_DIR "/earthmap.jpeg";
 const std::string MOON_PATH = RESOURCE_DIR "/moon.jpeg";
+// accumulation progress, a render of the same view resumes from it
+const std::string CHECKPOINT_PATH = "raytracing.checkpoint";
+// imported models, see Mesh.h
+const std::string MESH_CACHE_DIR = "mesh-cache";
 
 class RayTracerLayer : public Walnut::Layer {
 
@@ -61,35 +68,88 @@ public:
       sphere.MaterialIndex = 2;
       m_Scene.Spheres.push_back(sphere);
     }
+    m_Scheduler.SetCheckpoint(CHECKPOINT_PATH);
+    // an import of a large model takes a while, the window shows up meanwhile
+    m_ModelLoading = std::async(std::launch::async, []() {
+      return Mesh::Load(MODEL_PATH, MESH_CACHE_DIR);
+    });
+
     Application::Get()->QueueEvent([]() { 
         Image::InitModel(945, 1028); 
     });
   }
 
   virtual void OnUpdate(float ts) override {
-    if (m_Camera.OnUpdate(ts))
-      m_Renderer.ResetFrameIndex();
+    if (m_Camera.OnUpdate(ts)) {
+      m_CameraMoved = true;
+      m_SnapshotChanged = true;
+    }
   }
 
   virtual void OnUIRender() override {
     ImGui::Begin("Settings");
-    ImGui::Text("Last render: %.3fms", m_LastRenderTime);
-    if (ImGui::Button("Render")) {
-      Render();
+    const RenderScheduler::FrameStats &stats = m_Scheduler.GetStats();
+    ImGui::Text("Last render: %.3fms", stats.RenderTime);
+    if (ImGui::Button("Render"))
+      m_SnapshotChanged = true;
+
+    m_SnapshotChanged |= ImGui::Checkbox("Accumulate", &m_Settings.Accumulate);
+    m_SnapshotChanged |= ImGui::DragFloat(
+        "Target Frame Time (ms)", &m_Settings.TargetFrameTime, 0.5f, 0.0f,
+        1000.0f);
+    if (m_Settings.TargetFrameTime > 0.0f)
+      ImGui::Text("Resolution 1/%u, %u spp per frame", stats.RenderScale,
+                  stats.SamplesPerFrame);
+    m_SnapshotChanged |=
+        ImGui::Checkbox("Reproject on Camera Motion", &m_Settings.Reproject);
+    int whileMoving = (int)m_Settings.WhileMoving;
+    if (ImGui::Combo("Trace While Moving", &whileMoving,
+                     "Every Pixel\0Checkerboard\0One in Four\0")) {
+      m_Settings.WhileMoving = (Renderer::MotionPattern)whileMoving;
+      m_SnapshotChanged = true;
     }
-
-    ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
+    if (ImGui::Checkbox("Light Sampling", &m_Settings.SampleLights))
+      ResetAccumulation();
+    if (ImGui::ColorEdit3("Sky Color", glm::value_ptr(m_Settings.SkyColor)))
+      ResetAccumulation();
 
     if (ImGui::Button("Reset"))
-      m_Renderer.ResetFrameIndex();
+      ResetAccumulation();
+
+    if (stats.HasCheckpoint) {
+      m_SnapshotChanged |=
+          ImGui::DragFloat("Checkpoint Interval (s)",
+                           &m_Settings.CheckpointInterval, 1.0f, 0.0f, 3600.0f);
+      if (stats.CheckpointFailed)
+        ImGui::Text("Can't write %s", CHECKPOINT_PATH.c_str());
+      else
+        ImGui::Text("Checkpoint: frame %u", stats.CheckpointFrameIndex);
+    }
+
+    if (m_ModelLoading.valid() &&
+        m_ModelLoading.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready) {
+      m_Model = m_ModelLoading.get();
+      m_ModelLoaded = true;
+    }
+    if (m_Model)
+      ImGui::Text("Model: %zu triangles, %zu vertices, %s in %.1fms",
+                  m_Model->GetIndices().size() / 3,
+                  m_Model->GetVertices().size(),
+                  m_Model->GetLoadStats().FromCache ? "cached" : "imported",
+                  m_Model->GetLoadStats().LoadTime);
+    else if (m_ModelLoaded)
+      ImGui::Text("Can't load %s", MODEL_PATH.c_str());
+    else
+      ImGui::Text("Loading %s", MODEL_PATH.c_str());
 
     ImGui::End();
 
     ImGui::Begin("Scene");
-    ImGui::DragFloat3("Camera Position", glm::value_ptr(m_Camera.m_Position),
-                      0.1f);
-    ImGui::DragFloat3("Camera LookAt",
-                      glm::value_ptr(m_Camera.m_ForwardDirection), 0.1f);
+    m_SnapshotChanged |= ImGui::DragFloat3(
+        "Camera Position", glm::value_ptr(m_Camera.m_Position), 0.1f);
+    m_SnapshotChanged |= ImGui::DragFloat3(
+        "Camera LookAt", glm::value_ptr(m_Camera.m_ForwardDirection), 0.1f);
 
     // spheres control
     for (size_t i = 0; i < m_Scene.Spheres.size(); i++) {
@@ -98,10 +158,12 @@ public:
       ImGui::Text("Sphere %zu", i);
 
       Sphere &sphere = m_Scene.Spheres[i];
-      ImGui::DragFloat3("Position", glm::value_ptr(sphere.Center), 0.1f);
-      ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
-      ImGui::DragInt("Material", &sphere.MaterialIndex, 1.0f, 0,
-                     (int)m_Scene.Materials.size() - 1);
+      m_SnapshotChanged |=
+          ImGui::DragFloat3("Position", glm::value_ptr(sphere.Center), 0.1f);
+      m_SnapshotChanged |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
+      m_SnapshotChanged |=
+          ImGui::DragInt("Material", &sphere.MaterialIndex, 1.0f, 0,
+                         (int)m_Scene.Materials.size() - 1);
 
       ImGui::Separator();
 
@@ -115,12 +177,14 @@ public:
       ImGui::Text("Material %zu", i);
 
       Material &material = m_Scene.Materials[i];
-      ImGui::DragFloat("Roughness", &material.Roughness, 0.05f, 0.0f, 1.0f);
-      ImGui::DragFloat("Metallic", &material.Metallic, 0.05f, 0.0f, 1.0f);
-      ImGui::ColorEdit3("Emission Color",
-                        glm::value_ptr(material.EmissionColor));
-      ImGui::DragFloat("Emission Power", &material.EmissionPower, 0.05f, 0.0f,
-                       FLT_MAX);
+      m_SnapshotChanged |= ImGui::DragFloat("Roughness", &material.Roughness,
+                                            0.05f, 0.0f, 1.0f);
+      m_SnapshotChanged |= ImGui::DragFloat("Metallic", &material.Metallic,
+                                            0.05f, 0.0f, 1.0f);
+      m_SnapshotChanged |= ImGui::ColorEdit3(
+          "Emission Color", glm::value_ptr(material.EmissionColor));
+      m_SnapshotChanged |= ImGui::DragFloat(
+          "Emission Power", &material.EmissionPower, 0.05f, 0.0f, FLT_MAX);
 
       ImGui::Separator();
 
@@ -136,7 +200,7 @@ public:
     m_ViewportHeight = ImGui::GetContentRegionAvail().y;
 
     if (m_ViewportWidth > 0 && m_ViewportHeight > 0) {
-      auto image = m_Renderer.GetFinalImage();
+      auto image = m_Scheduler.GetFinalImage();
       if (image)
         ImGui::Image(image->GetDescriptorSet(),
                      {(float)image->GetWidth(), (float)image->GetHeight()},
@@ -149,24 +213,50 @@ public:
     Render();
   }
 
+  // Hands the scene over to the render thread if it changed and shows the
+  // newest finished frame, never waits for the renderer
   void Render() {
-
-    Timer timer;
-
     if (m_ViewportWidth > 0 && m_ViewportHeight > 0) {
-      m_Renderer.OnResize(m_ViewportWidth, m_ViewportHeight);
-      m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
-      m_Renderer.Render(m_Scene, m_Camera);
+      if (m_ViewportWidth != m_SubmittedWidth ||
+          m_ViewportHeight != m_SubmittedHeight) {
+        m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
+        m_SnapshotChanged = true;
+      }
+
+      if (m_SnapshotChanged) {
+        m_Scheduler.Submit(m_Scene, m_Camera, m_Settings, m_ViewportWidth,
+                           m_ViewportHeight, m_ResetAccumulation,
+                           m_CameraMoved);
+        m_SubmittedWidth = m_ViewportWidth;
+        m_SubmittedHeight = m_ViewportHeight;
+        m_SnapshotChanged = false;
+        m_ResetAccumulation = false;
+        m_CameraMoved = false;
+      }
     }
 
-    m_LastRenderTime = timer.ElapsedMillis();
+    m_Scheduler.Update();
+  }
+
+  void ResetAccumulation() {
+    m_ResetAccumulation = true;
+    m_SnapshotChanged = true;
   }
 
 private:
-  Renderer m_Renderer;
+  RenderScheduler m_Scheduler;
+  Renderer::Settings m_Settings;
   Camera m_Camera;
   Scene m_Scene;
   uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
 
-  float m_LastRenderTime = 0.0f;
+  // what the render thread has, changes are submitted once per UI frame
+  uint32_t m_SubmittedWidth = 0, m_SubmittedHeight = 0;
+  bool m_SnapshotChanged = true;
+  bool m_ResetAccumulation = false;
+  bool m_CameraMoved = false;
+
+  std::future<std::shared_ptr<const Mesh>> m_ModelLoading;
+  std::shared_ptr<const Mesh> m_Model;
+  bool m_ModelLoaded = false;
 };
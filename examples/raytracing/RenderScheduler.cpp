@@ -0,0 +1,129 @@
+#include "RenderScheduler.h"
+
+#include "Walnut/Timer.h"
+
+#include <utility>
+
+RenderScheduler::RenderScheduler() : m_Thread([this]() { Run(); }) {}
+
+RenderScheduler::~RenderScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+  m_Wake.notify_one();
+  m_Thread.join();
+}
+
+void RenderScheduler::Submit(const Scene &scene, const Camera &camera,
+                             const Renderer::Settings &settings,
+                             uint32_t width, uint32_t height, bool reset,
+                             bool cameraMoved) {
+  // copied outside of the lock, the render thread may be waiting for it
+  Snapshot snapshot{scene, camera, settings, width, height, reset,
+                    cameraMoved};
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    // a reset or move of a snapshot that was never rendered still applies
+    if (m_Pending) {
+      snapshot.Reset |= m_Pending->Reset;
+      snapshot.CameraMoved |= m_Pending->CameraMoved;
+    }
+    m_Pending = std::move(snapshot);
+  }
+  m_Wake.notify_one();
+}
+
+void RenderScheduler::SetCheckpoint(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_CheckpointPath = path;
+  }
+  m_Wake.notify_one();
+}
+
+bool RenderScheduler::Update() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_HasReady)
+      return false;
+    std::swap(m_Ready, m_Front);
+    m_HasReady = false;
+  }
+
+  if (!m_FinalImage)
+    m_FinalImage = std::make_shared<Walnut::Image>(
+        m_Front.Width, m_Front.Height, Walnut::ImageFormat::RGBA);
+  else if (m_FinalImage->GetWidth() != m_Front.Width ||
+           m_FinalImage->GetHeight() != m_Front.Height)
+    m_FinalImage->Resize(m_Front.Width, m_Front.Height);
+
+  m_FinalImage->SetData(m_Front.Pixels.data());
+  m_Stats = m_Front.Stats;
+  return true;
+}
+
+void RenderScheduler::Run() {
+  std::optional<Snapshot> snapshot;
+
+  while (true) {
+    std::optional<std::string> checkpointPath;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      // an accumulating render goes on by itself, anything else waits for a
+      // change
+      m_Wake.wait(lock, [this, &snapshot]() {
+        return m_Stop || m_Pending || m_CheckpointPath ||
+               (snapshot && snapshot->Settings.Accumulate);
+      });
+      if (m_Stop)
+        return;
+
+      std::swap(checkpointPath, m_CheckpointPath);
+      if (m_Pending) {
+        snapshot = std::move(m_Pending);
+        m_Pending.reset();
+      }
+    }
+
+    if (checkpointPath)
+      m_Renderer.SetCheckpoint(*checkpointPath);
+    if (!snapshot)
+      continue;
+
+    if (snapshot->Reset)
+      m_Renderer.ResetFrameIndex();
+    else if (snapshot->CameraMoved)
+      m_Renderer.ReprojectAccumulation();
+    snapshot->Reset = false;
+    snapshot->CameraMoved = false;
+    m_Renderer.GetSettings() = snapshot->Settings;
+    m_Renderer.OnResize(snapshot->Width, snapshot->Height);
+
+    Walnut::Timer timer;
+    m_Renderer.Render(snapshot->Scene, snapshot->Camera);
+
+    const uint32_t *pixels = m_Renderer.GetImageData();
+    m_Back.Pixels.assign(pixels, pixels + (size_t)snapshot->Width *
+                                              snapshot->Height);
+    m_Back.Width = snapshot->Width;
+    m_Back.Height = snapshot->Height;
+
+    FrameStats &stats = m_Back.Stats;
+    stats.FrameIndex = m_Renderer.GetFrameIndex();
+    stats.RenderScale = m_Renderer.GetRenderScale();
+    stats.SamplesPerFrame = m_Renderer.GetSamplesPerFrame();
+    stats.RenderTime = timer.ElapsedMillis();
+    const Checkpoint *checkpoint = m_Renderer.GetCheckpoint();
+    stats.HasCheckpoint = checkpoint != nullptr;
+    stats.CheckpointFrameIndex =
+        checkpoint ? checkpoint->GetSavedFrameIndex() : 0;
+    stats.CheckpointFailed = checkpoint && checkpoint->Failed();
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      std::swap(m_Back, m_Ready);
+      m_HasReady = true;
+    }
+  }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Walnut/Image.h"
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs a Renderer on a thread of its own, so that the UI never waits for a
+// frame.
+//
+// The UI thread submits copies of the scene, camera and settings whenever
+// they change, the render thread picks up the newest of them before each
+// frame and keeps accumulating with it in between. Finished frames go through
+// three buffers: the render thread fills one, one holds the newest finished
+// frame and the UI thread uploads from the last one, none of them waits for
+// the other.
+class RenderScheduler {
+public:
+  // about the frame that's shown
+  struct FrameStats {
+    uint32_t FrameIndex = 0;
+    uint32_t RenderScale = 1;
+    uint32_t SamplesPerFrame = 1;
+    float RenderTime = 0.0f; // ms
+    bool HasCheckpoint = false;
+    uint32_t CheckpointFrameIndex = 0;
+    bool CheckpointFailed = false;
+  };
+
+public:
+  RenderScheduler();
+  RenderScheduler(const RenderScheduler &) = delete;
+  RenderScheduler &operator=(const RenderScheduler &) = delete;
+  ~RenderScheduler(); // finishes the frame being rendered
+
+  // Renders `width` x `height` frames of copies of these from the next frame
+  // on. `reset` drops what was accumulated so far, `cameraMoved` reprojects
+  // it to the new view (see Renderer::ReprojectAccumulation()).
+  void Submit(const Scene &scene, const Camera &camera,
+              const Renderer::Settings &settings, uint32_t width,
+              uint32_t height, bool reset, bool cameraMoved = false);
+  // see Renderer::SetCheckpoint()
+  void SetCheckpoint(const std::string &path);
+
+  // Uploads the newest finished frame to the final image, if there's one
+  // since the last call. UI thread only.
+  bool Update();
+
+  std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; }
+  const FrameStats &GetStats() const { return m_Stats; }
+
+private:
+  struct Snapshot {
+    ::Scene Scene;
+    ::Camera Camera;
+    Renderer::Settings Settings;
+    uint32_t Width = 0, Height = 0;
+    bool Reset = false;
+    bool CameraMoved = false;
+  };
+
+  struct Frame {
+    std::vector<uint32_t> Pixels;
+    uint32_t Width = 0, Height = 0;
+    FrameStats Stats;
+  };
+
+  void Run();
+
+private:
+  std::mutex m_Mutex;
+  std::condition_variable m_Wake;
+  // shared with the render thread, under m_Mutex
+  std::optional<Snapshot> m_Pending;
+  std::optional<std::string> m_CheckpointPath;
+  Frame m_Ready;
+  bool m_HasReady = false;
+  bool m_Stop = false;
+
+  // UI thread
+  Frame m_Front;
+  std::shared_ptr<Walnut::Image> m_FinalImage;
+  FrameStats m_Stats;
+
+  // render thread
+  Renderer m_Renderer;
+  Frame m_Back;
+
+  std::thread m_Thread;
+};
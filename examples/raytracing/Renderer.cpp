@@ -3,18 +3,40 @@
 #include "Renderer.h"
 
 #include "Walnut/Random.h"
+#include "Walnut/Timer.h"
 
 #include "stb/stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <execution>
+#include <limits>
+#include <random>
 #include <glm/gtx/dual_quaternion.hpp>
 #include <tuple>
 
 #include <glm/fwd.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
 
 namespace Utils {
 
+// bounds of the frame budget: one traced pixel per 8x8 block at worst, at most
+// 16 samples per pixel and frame at best
+constexpr uint32_t MaxRenderScale = 8;
+constexpr uint32_t MaxSamplesPerFrame = 16;
+
+// history is kept where the first hit moved by less than this, relative to its
+// distance
+constexpr float ReprojectionDepthTolerance = 0.02f;
+// at most this many samples of a pixel survive a camera move
+constexpr uint32_t MaxReprojectedSamples = 32;
+// distance sky pixels are reprojected at
+constexpr float SkyDistance = 1000.0f;
+
 static uint32_t ConvertToRGBA(const glm::vec4 &color) {
   uint8_t r = (uint8_t)(color.r * 255.0f);
   uint8_t g = (uint8_t)(color.g * 255.0f);
@@ -25,22 +47,94 @@ static uint32_t ConvertToRGBA(const glm::vec4 &color) {
   return result;
 }
 
-} // namespace Utils
+// PCG hash (Jarzynski and Olano, "Hash Functions for GPU Rendering")
+static uint32_t PCGHash(uint32_t input) {
+  const uint32_t state = input * 747796405u + 2891336453u;
+  const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
 
-void Renderer::OnResize(uint32_t width, uint32_t height) {
-  if (m_FinalImage) {
-    // No resize necessary
-    if (m_ViewportWidth == width && m_ViewportHeight == height)
-      return;
+// state of the sample the calling thread is tracing, see SeedRandom()
+static thread_local uint32_t s_RandomState = 0;
 
-    m_FinalImage->Resize(width, height);
-  } else {
-    m_FinalImage = std::make_shared<Walnut::Image>(width, height,
-                                                   Walnut::ImageFormat::RGBA);
+// Starts the random sequence of one sample of a pixel. The same seed, pixel and
+// sample index always give the same numbers, whichever thread traces them and
+// whether or not the render was restored from a checkpoint in between.
+static void SeedRandom(uint32_t seed, uint32_t pixel, uint32_t sample) {
+  s_RandomState = PCGHash(pixel ^ PCGHash(sample ^ PCGHash(seed)));
+}
+
+// Uniform in [0, 1)
+static float RandomFloat() {
+  s_RandomState = PCGHash(s_RandomState);
+  return (float)(s_RandomState >> 8) * 0x1p-24f;
+}
+
+// The view the camera's ray directions were computed for
+static glm::mat4 ViewProjection(const Camera &camera) {
+  return camera.GetProjection() *
+         glm::lookAt(camera.GetPosition(),
+                     camera.GetPosition() + camera.GetDirection(),
+                     glm::vec3(0.0f, 1.0f, 0.0f));
+}
 
-    m_ViewportWidth = width;
-    m_ViewportHeight = height;
+// FNV-1a
+static void HashBytes(uint64_t &hash, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
   }
+}
+
+// Orthonormal basis around the unit vector `n` (Duff et al., "Building an
+// Orthonormal Basis, Revisited"), `local.z` goes along `n`
+static glm::vec3 FromLocal(const glm::vec3 &n, const glm::vec3 &local) {
+  const float sign = std::copysign(1.0f, n.z);
+  const float a = -1.0f / (sign + n.z);
+  const float b = n.x * n.y * a;
+  const glm::vec3 t(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+  const glm::vec3 s(b, sign + n.y * n.y * a, -n.y);
+  return local.x * t + local.y * s + local.z * n;
+}
+
+// pdf = cos(theta) / pi
+static glm::vec3 CosineSampleHemisphere(const glm::vec3 &normal) {
+  const float u1 = RandomFloat();
+  const float phi = 2.0f * glm::pi<float>() * RandomFloat();
+  const float r = glm::sqrt(u1);
+  return FromLocal(normal, glm::vec3(r * glm::cos(phi), r * glm::sin(phi),
+                                     glm::sqrt(glm::max(0.0f, 1.0f - u1))));
+}
+
+// Solid angle pdf of sampling the cone a sphere subtends from `origin`, 0 from
+// inside of it
+static float SphereConePdf(const glm::vec3 &origin, const Sphere &sphere) {
+  const glm::vec3 toCenter = sphere.Center - origin;
+  const float distance2 = glm::dot(toCenter, toCenter);
+  const float radius2 = sphere.Radius * sphere.Radius;
+  if (distance2 <= radius2)
+    return 0.0f;
+
+  const float cosThetaMax = glm::sqrt(1.0f - radius2 / distance2);
+  return 1.0f / (2.0f * glm::pi<float>() * (1.0f - cosThetaMax));
+}
+
+static float PowerHeuristic(float pdf, float otherPdf) {
+  const float pdf2 = pdf * pdf;
+  const float sum = pdf2 + otherPdf * otherPdf;
+  return sum > 0.0f ? pdf2 / sum : 0.0f;
+}
+
+} // namespace Utils
+
+void Renderer::OnResize(uint32_t width, uint32_t height) {
+  // No resize necessary
+  if (m_ImageData && m_ViewportWidth == width && m_ViewportHeight == height)
+    return;
+
+  m_ViewportWidth = width;
+  m_ViewportHeight = height;
 
   delete[] m_ImageData;
   m_ImageData = new uint32_t[width * height];
@@ -48,6 +142,23 @@ void Renderer::OnResize(uint32_t width, uint32_t height) {
   delete[] m_AccumulationData;
   m_AccumulationData = new glm::vec4[width * height];
 
+  delete[] m_SampleCountData;
+  m_SampleCountData = new uint32_t[width * height];
+
+  delete[] m_DepthData;
+  m_DepthData = new float[width * height];
+
+  delete[] m_HistoryAccumulationData;
+  m_HistoryAccumulationData = new glm::vec4[width * height];
+  delete[] m_HistorySampleCountData;
+  m_HistorySampleCountData = new uint32_t[width * height];
+  delete[] m_HistoryDepthData;
+  m_HistoryDepthData = new float[width * height];
+
+  // the accumulation starts over at the new size
+  m_FrameIndex = 1;
+  m_ReprojectPending = false;
+
   m_ImageHorizontalIter.resize(width);
   m_ImageVerticalIter.resize(height);
   for (uint32_t i = 0; i < width; i++)
@@ -56,102 +167,462 @@ void Renderer::OnResize(uint32_t width, uint32_t height) {
     m_ImageVerticalIter[i] = i;
 }
 
-Renderer::~Renderer() {}
+Renderer::~Renderer() {
+  // keep what was accumulated since the last checkpoint
+  if (m_Checkpoint) {
+    m_Checkpoint->Wait();
+    if (m_Settings.Accumulate && m_Settings.CheckpointInterval > 0.0f &&
+        m_FrameIndex > 1)
+      SaveCheckpoint();
+  }
+  m_Checkpoint.reset();
+
+  delete[] m_ImageData;
+  delete[] m_AccumulationData;
+  delete[] m_SampleCountData;
+  delete[] m_DepthData;
+  delete[] m_HistoryAccumulationData;
+  delete[] m_HistorySampleCountData;
+  delete[] m_HistoryDepthData;
+}
+
+Renderer::Renderer() : m_Seed(std::random_device{}()) {}
 
-Renderer::Renderer() {}
+void Renderer::SetCheckpoint(const std::string &path) {
+  m_Checkpoint.reset();
+  if (path.empty())
+    return;
+
+  m_Checkpoint = std::make_unique<Checkpoint>(path);
+  m_ResumeCheckpoint = true;
+  m_LastCheckpoint = std::chrono::steady_clock::now();
+}
+
+uint64_t Renderer::StateKey() const {
+  uint64_t hash = 14695981039346656037ull;
+  const auto add = [&hash](const auto &value) {
+    Utils::HashBytes(hash, &value, sizeof(value));
+  };
+
+  add(m_ActiveCamera->GetPosition());
+  add(m_ActiveCamera->GetDirection());
+  for (const Sphere &sphere : m_ActiveScene->Spheres) {
+    add(sphere.Center);
+    add(sphere.Radius);
+    add(sphere.MaterialIndex);
+  }
+  for (const Material &material : m_ActiveScene->Materials) {
+    add(material.Roughness);
+    add(material.Metallic);
+    add(material.EmissionColor);
+    add(material.EmissionPower);
+  }
+  add(m_Settings.SampleLights);
+  add(m_Settings.SkyColor);
+  return hash;
+}
+
+void Renderer::SaveCheckpoint() {
+  const Checkpoint::State state{m_StateKey, m_FrameIndex, m_Seed};
+  if (!m_Checkpoint->Save(m_ViewportWidth, m_ViewportHeight, state,
+                          m_AccumulationData, m_SampleCountData,
+                          m_DepthData))
+    return; // the previous one is still being written, try next frame
+
+  m_LastCheckpoint = std::chrono::steady_clock::now();
+  // from now on the file holds this render
+  m_ResumeCheckpoint = false;
+}
 
 void Renderer::Render(const Scene &scene, const Camera &camera) {
   m_ActiveScene = &scene;
   m_ActiveCamera = &camera;
 
-  m_ViewportWidth = m_FinalImage->GetWidth();
-  m_ViewportHeight = m_FinalImage->GetHeight();
+  m_EmissiveSpheres.clear();
+  for (size_t i = 0; i < scene.Spheres.size(); i++) {
+    const glm::vec3 emission =
+        scene.Materials[scene.Spheres[i].MaterialIndex].GetEmission();
+    if (glm::dot(emission, emission) > 0.0f)
+      m_EmissiveSpheres.push_back((int)i);
+  }
 
-  if (m_FrameIndex == 1)
-    memset(m_AccumulationData, 0,
-           m_ViewportWidth * m_ViewportHeight * sizeof(glm::vec4));
+  m_StateKey = StateKey();
 
-#define MT 1
-#ifdef MT
-  std::for_each(
-      std::execution::par, m_ImageVerticalIter.begin(),
-      m_ImageVerticalIter.end(), [this](uint32_t y) {
-        std::for_each(
-            std::execution::par, m_ImageHorizontalIter.begin(),
-            m_ImageHorizontalIter.end(), [this, y](uint32_t x) {
-              uint32_t imageIndex = x + y * m_ViewportWidth;
-              glm::vec4 color = PerPixel(x, y);
-              m_AccumulationData[imageIndex] += (color);
-
-              glm::vec4 accumulatedColor = m_AccumulationData[imageIndex];
-              accumulatedColor /= (float)m_FrameIndex;
-              accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f),
-                                            glm::vec4(1.0f));
-
-              m_ImageData[imageIndex] = Utils::ConvertToRGBA(accumulatedColor);
-            });
-      });
+  // the camera moved since the last frame
+  const bool moving = m_ReprojectPending;
+  if (m_ReprojectPending) {
+    m_ReprojectPending = false;
+    if (m_FrameIndex > 1 && m_Settings.Accumulate && m_Settings.Reproject)
+      Reproject();
+    else
+      m_FrameIndex = 1;
+  }
 
-#else
+  if (m_FrameIndex == 1) {
+    bool resumed = false;
+    if (m_Checkpoint && m_ResumeCheckpoint && m_Settings.Accumulate) {
+      Checkpoint::State state;
+      state.Key = m_StateKey;
+      // the depths too, a restored pixel may not be traced again before the
+      // next reprojection
+      resumed = m_Checkpoint->Restore(m_ViewportWidth, m_ViewportHeight, state,
+                                      m_AccumulationData, m_SampleCountData,
+                                      m_DepthData);
+      if (resumed) {
+        m_FrameIndex = state.FrameIndex;
+        m_Seed = state.Seed;
+        m_ResumeCheckpoint = false;
+      }
+    }
 
-  for (uint32_t y = 0; y < m_ViewportHeight; y++) {
-    for (uint32_t x = 0; x < m_ViewportWidth; x++) {
+    if (!resumed) {
+      memset(m_AccumulationData, 0,
+             m_ViewportWidth * m_ViewportHeight * sizeof(glm::vec4));
+      memset(m_SampleCountData, 0,
+             m_ViewportWidth * m_ViewportHeight * sizeof(uint32_t));
+    }
+  }
 
-      // PerPixel color from ray tracing
+  // pixels traced this frame: one per block of m_FrameScale^2, a different
+  // one each frame so that a still view fills in at full resolution. While
+  // the camera moves, fewer of them if the settings ask for it.
+  m_FrameScale = m_RenderScale;
+  m_Checkerboard = false;
+  if (moving && m_Settings.WhileMoving == MotionPattern::Quarter)
+    m_FrameScale = std::max(m_FrameScale, 2u);
+  else if (moving && m_Settings.WhileMoving == MotionPattern::Checkerboard)
+    m_Checkerboard = m_FrameScale == 1;
+
+  m_TracedColumns.clear();
+  m_TracedRows.clear();
+  if (m_Checkerboard) {
+    // every other column, shifted by one on every other row (see
+    // TracedColumn()), the other half on the next frame
+    m_CheckerboardPhase = m_SubframeIndex++ & 1;
+    for (uint32_t x = 0; x < m_ViewportWidth; x += 2)
+      m_TracedColumns.push_back(x);
+    m_TracedRows = m_ImageVerticalIter;
+  } else {
+    const uint32_t scale = m_FrameScale;
+    const uint32_t offset = m_SubframeIndex++ % (scale * scale);
+    m_BlockOffsetX = offset % scale;
+    m_BlockOffsetY = offset / scale;
+    for (uint32_t x = 0; x < m_ViewportWidth; x += scale)
+      m_TracedColumns.push_back(
+          std::min(x + m_BlockOffsetX, m_ViewportWidth - 1));
+    for (uint32_t y = 0; y < m_ViewportHeight; y += scale)
+      m_TracedRows.push_back(
+          std::min(y + m_BlockOffsetY, m_ViewportHeight - 1));
+  }
 
-      glm::vec4 color = PerPixel(x, y);
+  Walnut::Timer timer;
 
-      uint32_t imageIndex = x + y * m_ViewportWidth;
-      m_AccumulationData[imageIndex] += color;
+#define MT 1
+#ifdef MT
+  std::for_each(std::execution::par, m_TracedRows.begin(), m_TracedRows.end(),
+                [this](uint32_t y) {
+                  std::for_each(
+                      std::execution::par, m_TracedColumns.begin(),
+                      m_TracedColumns.end(),
+                      [this, y](uint32_t column) { TracePixel(column, y); });
+                });
+
+  UpdateFrameBudget(timer.ElapsedMillis(),
+                    m_TracedRows.size() * m_TracedColumns.size());
+
+  std::for_each(std::execution::par, m_ImageVerticalIter.begin(),
+                m_ImageVerticalIter.end(), [this](uint32_t y) {
+                  for (uint32_t x = 0; x < m_ViewportWidth; x++)
+                    ResolvePixel(x, y);
+                });
 
-      glm::vec4 accumulatedColor = m_AccumulationData[imageIndex];
-      accumulatedColor /= (float)m_FrameIndex;
+#else
 
-      accumulatedColor =
-          glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
+  for (uint32_t y : m_TracedRows)
+    for (uint32_t column : m_TracedColumns)
+      TracePixel(column, y);
 
-      m_ImageData[imageIndex] = Utils::ConvertToRGBA(color);
-    }
-  }
+  UpdateFrameBudget(timer.ElapsedMillis(),
+                    m_TracedRows.size() * m_TracedColumns.size());
+
+  for (uint32_t y = 0; y < m_ViewportHeight; y++)
+    for (uint32_t x = 0; x < m_ViewportWidth; x++)
+      ResolvePixel(x, y);
 #endif
 
-  m_FinalImage->SetData(m_ImageData);
+  // the view the accumulation belongs to, for the next reprojection
+  m_AccumulationViewProjection = Utils::ViewProjection(camera);
+  m_AccumulationPosition = camera.GetPosition();
 
   if (m_Settings.Accumulate)
     m_FrameIndex++;
   else
     m_FrameIndex = 1;
+
+  if (m_Checkpoint && m_Settings.Accumulate &&
+      m_Settings.CheckpointInterval > 0.0f &&
+      std::chrono::steady_clock::now() - m_LastCheckpoint >=
+          std::chrono::duration<float>(m_Settings.CheckpointInterval))
+    SaveCheckpoint();
+}
+
+void Renderer::Reproject() {
+  std::for_each(std::execution::par, m_ImageVerticalIter.begin(),
+                m_ImageVerticalIter.end(), [this](uint32_t y) {
+                  for (uint32_t x = 0; x < m_ViewportWidth; x++)
+                    ReprojectPixel(x, y);
+                });
+
+  // the reprojected history becomes the accumulation
+  std::swap(m_AccumulationData, m_HistoryAccumulationData);
+  std::swap(m_SampleCountData, m_HistorySampleCountData);
+  std::swap(m_DepthData, m_HistoryDepthData);
+}
+
+void Renderer::ReprojectPixel(uint32_t x, uint32_t y) {
+  const uint32_t imageIndex = x + y * m_ViewportWidth;
+  m_HistoryAccumulationData[imageIndex] = glm::vec4(0.0f);
+  m_HistorySampleCountData[imageIndex] = 0;
+
+  // where the pixel sees the scene now, a point far away for the sky
+  Ray ray;
+  ray.Origin = m_ActiveCamera->GetPosition();
+  ray.Direction = m_ActiveCamera->GetRayDirections()[imageIndex];
+  const Renderer::HitPayload payload = TraceRay(ray);
+  const bool hit = payload.HitDistance >= 0.0f;
+  const glm::vec3 position =
+      hit ? payload.WorldPosition
+          : ray.Origin + ray.Direction * Utils::SkyDistance;
+  m_HistoryDepthData[imageIndex] =
+      hit ? payload.HitDistance : std::numeric_limits<float>::infinity();
+
+  // the pixel that saw that point before the move
+  const glm::vec4 clip =
+      m_AccumulationViewProjection * glm::vec4(position, 1.0f);
+  if (clip.w <= 0.0f)
+    return;
+  const glm::vec2 coord =
+      (glm::vec2(clip.x, clip.y) / clip.w * 0.5f + 0.5f) *
+      glm::vec2((float)m_ViewportWidth, (float)m_ViewportHeight);
+  const int previousX = (int)std::floor(coord.x + 0.5f);
+  const int previousY = (int)std::floor(coord.y + 0.5f);
+  if (previousX < 0 || previousY < 0 || previousX >= (int)m_ViewportWidth ||
+      previousY >= (int)m_ViewportHeight)
+    return;
+  const uint32_t previousIndex = previousX + previousY * m_ViewportWidth;
+  const uint32_t sampleCount = m_SampleCountData[previousIndex];
+  if (sampleCount == 0)
+    return;
+
+  // disoccluded: the previous pixel saw something else in front of or
+  // behind the point
+  const float previousDepth = m_DepthData[previousIndex];
+  if (hit) {
+    const float expectedDepth = glm::length(position - m_AccumulationPosition);
+    if (std::abs(previousDepth - expectedDepth) >
+        Utils::ReprojectionDepthTolerance * expectedDepth)
+      return;
+  } else if (previousDepth != std::numeric_limits<float>::infinity()) {
+    return;
+  }
+
+  // a long history adapts slowly to what the reprojection got wrong
+  const uint32_t keptCount =
+      std::min(sampleCount, Utils::MaxReprojectedSamples);
+  m_HistoryAccumulationData[imageIndex] =
+      m_AccumulationData[previousIndex] *
+      ((float)keptCount / (float)sampleCount);
+  m_HistorySampleCountData[imageIndex] = keptCount;
+}
+
+uint32_t Renderer::TracedColumn(uint32_t column, uint32_t y) const {
+  return m_Checkerboard ? column + ((y + m_CheckerboardPhase) & 1) : column;
+}
+
+void Renderer::TracePixel(uint32_t column, uint32_t y) {
+  const uint32_t x = TracedColumn(column, y);
+  if (x >= m_ViewportWidth)
+    return;
+
+  const uint32_t imageIndex = x + y * m_ViewportWidth;
+  for (uint32_t i = 0; i < m_SamplesPerFrame; i++) {
+    Utils::SeedRandom(m_Seed, imageIndex, m_SampleCountData[imageIndex]);
+    m_AccumulationData[imageIndex] += PerPixel(x, y);
+    m_SampleCountData[imageIndex]++;
+  }
+}
+
+void Renderer::ResolvePixel(uint32_t x, uint32_t y) {
+  uint32_t imageIndex = x + y * m_ViewportWidth;
+  glm::vec4 accumulatedColor(0.0f);
+  if (m_SampleCountData[imageIndex] > 0) {
+    accumulatedColor =
+        m_AccumulationData[imageIndex] / (float)m_SampleCountData[imageIndex];
+  } else if (m_Checkerboard) {
+    // not traced yet at this view: the four neighbours were, this frame
+    float weight = 0.0f;
+    const auto gather = [&](uint32_t neighbourIndex) {
+      if (m_SampleCountData[neighbourIndex] == 0)
+        return;
+      accumulatedColor += m_AccumulationData[neighbourIndex] /
+                          (float)m_SampleCountData[neighbourIndex];
+      weight += 1.0f;
+    };
+    if (x > 0)
+      gather(imageIndex - 1);
+    if (x + 1 < m_ViewportWidth)
+      gather(imageIndex + 1);
+    if (y > 0)
+      gather(imageIndex - m_ViewportWidth);
+    if (y + 1 < m_ViewportHeight)
+      gather(imageIndex + m_ViewportWidth);
+    accumulatedColor /= std::max(weight, 1.0f);
+  } else {
+    // not traced yet at this view: upscale from the pixel traced in its block
+    const uint32_t scale = m_FrameScale;
+    const uint32_t source =
+        std::min(x - x % scale + m_BlockOffsetX, m_ViewportWidth - 1) +
+        std::min(y - y % scale + m_BlockOffsetY, m_ViewportHeight - 1) *
+            m_ViewportWidth;
+    accumulatedColor = m_AccumulationData[source] /
+                       (float)std::max(m_SampleCountData[source], 1u);
+  }
+  accumulatedColor =
+      glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
+
+  m_ImageData[imageIndex] = Utils::ConvertToRGBA(accumulatedColor);
+}
+
+void Renderer::UpdateFrameBudget(float elapsed, size_t tracedPixels) {
+  if (m_Settings.TargetFrameTime <= 0.0f || tracedPixels == 0) {
+    m_RenderScale = 1;
+    m_SamplesPerFrame = 1;
+    m_SampleCost = 0.0f;
+    return;
+  }
+
+  // smoothed, a single slow frame shouldn't drop the resolution
+  const float cost = elapsed / (float)(tracedPixels * m_SamplesPerFrame);
+  m_SampleCost =
+      m_SampleCost > 0.0f ? glm::mix(m_SampleCost, cost, 0.25f) : cost;
+
+  const float affordable = m_Settings.TargetFrameTime / m_SampleCost;
+  const float pixels = (float)m_ViewportWidth * (float)m_ViewportHeight;
+  if (affordable >= pixels) {
+    // every pixel fits, spend what's left on more samples per pixel
+    m_RenderScale = 1;
+    m_SamplesPerFrame = (uint32_t)glm::clamp(
+        affordable / pixels, 1.0f, (float)Utils::MaxSamplesPerFrame);
+  } else {
+    m_RenderScale =
+        (uint32_t)glm::clamp(std::ceil(std::sqrt(pixels / affordable)), 1.0f,
+                             (float)Utils::MaxRenderScale);
+    m_SamplesPerFrame = 1;
+  }
 }
 
 glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y) {
   Ray ray;
   ray.Origin = m_ActiveCamera->GetPosition();
   ray.Direction =
-      m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
+      m_ActiveCamera->GetRayDirections()[x + y * m_ViewportWidth];
 
   glm::vec3 light(0.0f);
+  glm::vec3 throughput(1.0f);
+  // pdf of the BRDF sample that produced `ray`, to weight the emitters it hits
+  float bsdfPdf = 0.0f;
+  const bool sampleLights = m_Settings.SampleLights && !m_EmissiveSpheres.empty();
 
   int bounces = 5;
   for (int i = 0; i < bounces; i++) {
     Renderer::HitPayload payload = TraceRay(ray);
+    // first hit, what the reprojection checks history against
+    if (i == 0)
+      m_DepthData[x + y * m_ViewportWidth] =
+          payload.HitDistance < 0.0f ? std::numeric_limits<float>::infinity()
+                                     : payload.HitDistance;
     if (payload.HitDistance < 0.0f) {
+      light += throughput * m_Settings.SkyColor;
       break;
     }
 
     const Sphere &sphere = m_ActiveScene->Spheres[payload.ObjectIndex];
     const Material &material = m_ActiveScene->Materials[sphere.MaterialIndex];
 
-    light += material.GetImage()->GetAlbedo(payload.u, payload.v) +
-             material.GetEmission(); // get Emisson from material
+    // emitters seen by camera rays are not light sampled, nothing to weight
+    float emissionWeight = 1.0f;
+    if (sampleLights && i > 0) {
+      const float lightPdf = Utils::SphereConePdf(ray.Origin, sphere) /
+                             (float)m_EmissiveSpheres.size();
+      emissionWeight = Utils::PowerHeuristic(bsdfPdf, lightPdf);
+    }
+    light += throughput * material.GetEmission() * emissionWeight;
+
+    const glm::vec3 albedo =
+        material.GetImage()->GetAlbedo(payload.u, payload.v);
 
     ray.Origin = payload.WorldPosition + payload.WorldNormal * 1e-4f;
-    ray.Direction =
-        glm::normalize(payload.WorldNormal + Walnut::Random::InUnitSphere());
+    if (sampleLights)
+      light += throughput * albedo *
+               SampleLight(ray.Origin, payload.WorldNormal, payload.ObjectIndex);
+
+    // cosine-weighted bounce: the lambertian albedo / pi * cos / pdf is the
+    // albedo alone
+    ray.Direction = Utils::CosineSampleHemisphere(payload.WorldNormal);
+    bsdfPdf = glm::dot(payload.WorldNormal, ray.Direction) / glm::pi<float>();
+    throughput *= albedo;
   }
 
   return glm::vec4(light, 1.0f);
 }
 
+glm::vec3 Renderer::SampleLight(const glm::vec3 &origin,
+                                const glm::vec3 &normal, int objectIndex) {
+  const size_t lightCount = m_EmissiveSpheres.size();
+  const int lightIndex = m_EmissiveSpheres[std::min(
+      lightCount - 1, (size_t)(Utils::RandomFloat() * lightCount))];
+  // a sphere never lights itself
+  if (lightIndex == objectIndex)
+    return glm::vec3(0.0f);
+
+  const Sphere &light = m_ActiveScene->Spheres[lightIndex];
+  const glm::vec3 toCenter = light.Center - origin;
+  const float distance2 = glm::dot(toCenter, toCenter);
+  const float radius2 = light.Radius * light.Radius;
+  if (distance2 <= radius2)
+    return glm::vec3(0.0f);
+
+  // uniform direction inside the cone towards the sphere
+  const float cosThetaMax = glm::sqrt(1.0f - radius2 / distance2);
+  const float cosTheta =
+      1.0f - Utils::RandomFloat() * (1.0f - cosThetaMax);
+  const float sinTheta = glm::sqrt(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+  const float phi = 2.0f * glm::pi<float>() * Utils::RandomFloat();
+  const glm::vec3 direction = Utils::FromLocal(
+      glm::normalize(toCenter),
+      glm::vec3(sinTheta * glm::cos(phi), sinTheta * glm::sin(phi), cosTheta));
+
+  const float cosSurface = glm::dot(normal, direction);
+  if (cosSurface <= 0.0f)
+    return glm::vec3(0.0f);
+
+  // shadow ray: the light is visible if it is the closest thing along it
+  Ray shadowRay;
+  shadowRay.Origin = origin;
+  shadowRay.Direction = direction;
+  const Renderer::HitPayload payload = TraceRay(shadowRay);
+  if (payload.HitDistance < 0.0f || payload.ObjectIndex != lightIndex)
+    return glm::vec3(0.0f);
+
+  const float lightPdf =
+      Utils::SphereConePdf(origin, light) / (float)lightCount;
+  const float bsdfPdf = cosSurface / glm::pi<float>();
+  const glm::vec3 emission =
+      m_ActiveScene->Materials[light.MaterialIndex].GetEmission();
+  return emission * (cosSurface / glm::pi<float>()) *
+         Utils::PowerHeuristic(lightPdf, bsdfPdf) / lightPdf;
+}
+
 Renderer::HitPayload Renderer::TraceRay(const Ray &ray) {
   // (bx^2 + by^2)t^2 + (2(axbx + ayby))t + (ax^2 + ay^2 - r^2) = 0
   // where
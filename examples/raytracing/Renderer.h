@@ -1,22 +1,42 @@
 #pragma once
 
 #include "ResourceManager.h"
-#include "Walnut/Image.h"
 
 #include "Camera.h"
+#include "Checkpoint.h"
 #include "Ray.h"
 #include "Scene.h"
 
+#include <chrono>
 #include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 
 using VertexAttributes = ResourceManager::VertexAttributes;
 
 class Renderer {
 public:
+  // pixels traced per frame while the camera moves, the others show their
+  // reprojected history or are filled from the traced ones
+  enum class MotionPattern { Full, Checkerboard, Quarter };
+
   struct Settings {
     bool Accumulate = true;
+    // next-event estimation: one shadow ray towards an emissive sphere per bounce,
+    // combined with the BRDF-sampled bounces by multiple importance sampling
+    bool SampleLights = true;
+    // keeps the accumulated samples across camera moves, see
+    // ReprojectAccumulation()
+    bool Reproject = true;
+    MotionPattern WhileMoving = MotionPattern::Checkerboard;
+    glm::vec3 SkyColor{0.6f, 0.7f, 0.9f};
+    // milliseconds the tracing of a frame should take, 0 traces every pixel
+    // once per frame. The renderer lowers the resolution to stay within it,
+    // or takes more samples per pixel if there's time left.
+    float TargetFrameTime = 0.0f;
+    // seconds between two checkpoints of an accumulating render, 0 disables
+    float CheckpointInterval = 30.0f;
   };
 
 public:
@@ -26,11 +46,37 @@ public:
   void OnResize(uint32_t width, uint32_t height);
   void Render(const Scene &scene, const Camera &camera);
 
-  std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; }
-
-  void ResetFrameIndex() { m_FrameIndex = 1; }
+  // RGBA of the last frame, GetWidth() * GetHeight() pixels
+  const uint32_t *GetImageData() const { return m_ImageData; }
+  uint32_t GetWidth() const { return m_ViewportWidth; }
+  uint32_t GetHeight() const { return m_ViewportHeight; }
+
+  // the accumulation restarts from scratch, a checkpoint is no longer resumed
+  void ResetFrameIndex() {
+    m_FrameIndex = 1;
+    m_ResumeCheckpoint = false;
+  }
+  // The camera moved: the next frame carries the accumulation over to the
+  // new view where the first hit of a pixel can be found in the old one, and
+  // starts over where it's disoccluded
+  void ReprojectAccumulation() {
+    m_ReprojectPending = true;
+    m_ResumeCheckpoint = false;
+  }
   Settings &GetSettings() { return m_Settings; }
 
+  // Saves the accumulation to `path` every Settings::CheckpointInterval and
+  // resumes from it on the first frame if it matches the scene, camera and
+  // viewport. An empty path turns checkpoints off.
+  void SetCheckpoint(const std::string &path);
+  const Checkpoint *GetCheckpoint() const { return m_Checkpoint.get(); }
+  uint32_t GetFrameIndex() const { return m_FrameIndex; }
+
+  // one pixel in GetRenderScale()^2 is traced per frame, each of them
+  // GetSamplesPerFrame() times
+  uint32_t GetRenderScale() const { return m_RenderScale; }
+  uint32_t GetSamplesPerFrame() const { return m_SamplesPerFrame; }
+
 private:
   struct HitPayload {
     float HitDistance;
@@ -56,14 +102,33 @@ private:
     }
   };
 
+  // moves the accumulation to the view of the active camera
+  void Reproject();
+  void ReprojectPixel(uint32_t x, uint32_t y);
+  // x of the pixel traced in `column` of m_TracedColumns on row `y`
+  uint32_t TracedColumn(uint32_t column, uint32_t y) const;
+  // adds m_SamplesPerFrame samples to the accumulation of a pixel
+  void TracePixel(uint32_t column, uint32_t y);
+  // writes the accumulated color of a pixel to the image
+  void ResolvePixel(uint32_t x, uint32_t y);
+  // picks the resolution and samples of the next frame from the time the
+  // tracing of this one took
+  void UpdateFrameBudget(float elapsed, size_t tracedPixels);
+
   glm::vec4 PerPixel(uint32_t x, uint32_t y); // RayGen
 
   HitPayload TraceRay(const Ray &ray);
   HitPayload ClosestHit(const Ray &ray, float hitDistance, int objectIndex);
   HitPayload Miss(const Ray &ray);
 
+  // Direct light from one randomly picked emissive sphere, already divided by the albedo
+  glm::vec3 SampleLight(const glm::vec3 &origin, const glm::vec3 &normal, int objectIndex);
+
+  // Hash of what the accumulated samples depend on: scene, camera and settings
+  uint64_t StateKey() const;
+  void SaveCheckpoint();
+
 private:
-  std::shared_ptr<Walnut::Image> m_FinalImage;
   Settings m_Settings;
 
   // texture stuff
@@ -72,13 +137,49 @@ private:
 
   // Walnut stuff
   std::vector<uint32_t> m_ImageHorizontalIter, m_ImageVerticalIter;
+  // the pixels traced this frame are the crossings of these
+  std::vector<uint32_t> m_TracedColumns, m_TracedRows;
+
+  // frame budget
+  uint32_t m_RenderScale = 1;
+  uint32_t m_SamplesPerFrame = 1;
+  float m_SampleCost = 0.0f; // milliseconds per traced sample
+  uint32_t m_SubframeIndex = 0;
+  // pattern of the frame being rendered
+  uint32_t m_FrameScale = 1;
+  uint32_t m_BlockOffsetX = 0, m_BlockOffsetY = 0;
+  bool m_Checkerboard = false;
+  uint32_t m_CheckerboardPhase = 0;
 
   const Scene *m_ActiveScene = nullptr;
   const Camera *m_ActiveCamera = nullptr;
+  // spheres with an emissive material, gathered at the start of every frame
+  std::vector<int> m_EmissiveSpheres;
 
   uint32_t *m_ImageData = nullptr;
   glm::vec4 *m_AccumulationData = nullptr;
+  // samples summed in m_AccumulationData, per pixel
+  uint32_t *m_SampleCountData = nullptr;
+  // distance to the first hit of each pixel, infinite for the sky
+  float *m_DepthData = nullptr;
+
+  // reprojection
+  bool m_ReprojectPending = false;
+  glm::mat4 m_AccumulationViewProjection{1.0f};
+  glm::vec3 m_AccumulationPosition{0.0f};
+  // the buffers above are swapped with these after a reprojection
+  glm::vec4 *m_HistoryAccumulationData = nullptr;
+  uint32_t *m_HistorySampleCountData = nullptr;
+  float *m_HistoryDepthData = nullptr;
 
   uint32_t m_FrameIndex = 1;
-  uint32_t m_ViewportWidth, m_ViewportHeight = 0;
+  // random sequences are keyed by this, the pixel and its sample count, so a
+  // render continues with the same sequence after a restore
+  uint32_t m_Seed = 0;
+
+  std::unique_ptr<Checkpoint> m_Checkpoint;
+  bool m_ResumeCheckpoint = false;
+  std::chrono::steady_clock::time_point m_LastCheckpoint;
+  uint64_t m_StateKey = 0; // StateKey() of the last frame
+  uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
 };
@@ -17,9 +17,54 @@
 
 using namespace RTIAW::Render::Shapes;
 namespace RTIAW {
-ApplicationLayer::ApplicationLayer()
-    : m_logger{spdlog::stdout_color_st("ApplicationLayer")} {
+// open with chrome://tracing or ui.perfetto.dev
+static constexpr auto traceFilePath = "raytracing2_trace.json";
+
+// Blends one rectangle per finished quad over the image at `origin`, from blue (cheapest) to red (most
+// expensive quad) and labels it with its cost
+static void DrawTileHeatmap(const Render::Renderer &renderer, const ImVec2 origin, const ImVec2 size,
+                            const bool byRays, const float opacity) {
+  const auto tiles = renderer.TileStatistics();
+  const auto imageSize = renderer.ImageSize();
+  if (tiles.empty() || imageSize.x == 0 || imageSize.y == 0)
+    return;
+
+  const auto cost = [byRays](const Render::Renderer::TileStats &tile) {
+    return byRays ? static_cast<float>(tile.rays) : tile.milliseconds;
+  };
+  float maxCost = 0.0f;
+  for (const auto &tile : tiles)
+    maxCost = std::max(maxCost, cost(tile));
+  if (maxCost <= 0.0f)
+    return;
+
+  // the image is shown flipped vertically, and possibly at a different size than it was rendered at
+  const float scaleX = size.x / static_cast<float>(imageSize.x);
+  const float scaleY = size.y / static_cast<float>(imageSize.y);
+  const auto alpha = static_cast<int>(255.0f * opacity);
+
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  for (const auto &tile : tiles) {
+    if (tile.milliseconds <= 0.0f)
+      continue;
+
+    const float t = cost(tile) / maxCost;
+    const ImVec2 min{origin.x + tile.minCoo.x * scaleX, origin.y + (imageSize.y - tile.maxCoo.y) * scaleY};
+    const ImVec2 max{origin.x + tile.maxCoo.x * scaleX, origin.y + (imageSize.y - tile.minCoo.y) * scaleY};
+    drawList->AddRectFilled(min, max, IM_COL32(static_cast<int>(255.0f * t), 32, static_cast<int>(255.0f * (1.0f - t)), alpha));
+    drawList->AddRect(min, max, IM_COL32(0, 0, 0, alpha));
+
+    const auto label = byRays ? fmt::format("{}", tile.rays) : fmt::format("{:.1f} ms", tile.milliseconds);
+    drawList->AddText(ImVec2{min.x + 4.0f, min.y + 4.0f}, IM_COL32(255, 255, 255, 255), label.c_str());
+  }
+}
+
+ApplicationLayer::ApplicationLayer() : ApplicationLayer(0, Utils::Affinity::None) {}
+
+ApplicationLayer::ApplicationLayer(const std::size_t threadCount, const Utils::Affinity affinity)
+    : m_logger{spdlog::stdout_color_st("ApplicationLayer")}, m_renderer{threadCount, affinity} {
   spdlog::set_level(spdlog::level::debug);
+  RTIAW_TRACE_THREAD_NAME("UI");
 
   m_renderer.SetScene(RTIAW::Render::Renderer::Scenes::OneSphereScene);
 }
@@ -27,6 +72,7 @@ ApplicationLayer::ApplicationLayer()
 void ApplicationLayer::OnUpdate(float ts) { m_renderer.OnUpdate(ts); }
 
 void ApplicationLayer::OnUIRender() {
+  RTIAW_TRACE_SCOPE("OnUIRender");
   //   #define R 1
 
   // my stuff here?
@@ -58,10 +104,16 @@ void ApplicationLayer::OnUIRender() {
 
   const void *imagebuffer = m_renderer.ImageBuffer();
   if (imagebuffer) {
-    m_image->SetData(imagebuffer);
-    ImGui::Image(m_image->GetDescriptorSet(),
-                 {(float)m_image->GetWidth(), (float)m_image->GetHeight()},
-                 ImVec2(0, 1), ImVec2(1, 0));
+    {
+      RTIAW_TRACE_SCOPE("TextureUpload");
+      m_image->SetData(imagebuffer);
+    }
+    const ImVec2 imageOrigin = ImGui::GetCursorScreenPos();
+    const ImVec2 imageSize{(float)m_image->GetWidth(), (float)m_image->GetHeight()};
+    ImGui::Image(m_image->GetDescriptorSet(), imageSize, ImVec2(0, 1), ImVec2(1, 0));
+    if (m_showTileHeatmap) {
+      DrawTileHeatmap(m_renderer, imageOrigin, imageSize, m_heatmapMetric == HeatmapMetric::Rays, m_heatmapOpacity);
+    }
   }
 #ifdef R
 #endif // R
@@ -88,6 +140,8 @@ void ApplicationLayer::OnUIRender() {
     }
     ImGui::EndCombo();
   }
+  if (m_selectedScene == Render::Renderer::Scenes::FromFile)
+    ImGui::InputText("Scene file", m_sceneFilePath, sizeof(m_sceneFilePath));
 
   ImGui::Text(magic_enum::enum_name(m_renderer.State()).data());
   const bool startDisable =
@@ -101,6 +155,7 @@ void ApplicationLayer::OnUIRender() {
   if (ImGui::Button("Start!")) {
     // (re-)initialize buffer
     m_renderer.SetScene(m_selectedScene);
+    m_renderer.SetSceneFile(m_sceneFilePath);
     m_renderer.SetImageSize(imx, imy);
     m_renderer.StartRender();
   }
@@ -111,13 +166,16 @@ void ApplicationLayer::OnUIRender() {
     }
   }
 
-  // TODO: mvp matrix to update vertex coordinates
-  ImGui::DragFloat3("translate x", value_ptr(m_renderer.mvp.model[0]), 0.1f,
-                    -1.0f, 1.0f);
-  ImGui::DragFloat3("translate y", value_ptr(m_renderer.mvp.model[1]), 0.1f,
-                    -1.0f, 1.0f);
-  ImGui::DragFloat3("translate z", value_ptr(m_renderer.mvp.model[2]), 0.1f,
-                    -1.0f, 1.0f);
+  // the model matrix places the cube instance, the prototype geometry stays as it is
+  if (ImGui::DragFloat3("translate x", value_ptr(m_renderer.mvp.model[0]), 0.1f,
+                        -1.0f, 1.0f))
+    m_renderer.UpdateModel();
+  if (ImGui::DragFloat3("translate y", value_ptr(m_renderer.mvp.model[1]), 0.1f,
+                        -1.0f, 1.0f))
+    m_renderer.UpdateModel();
+  if (ImGui::DragFloat3("translate z", value_ptr(m_renderer.mvp.model[2]), 0.1f,
+                        -1.0f, 1.0f))
+    m_renderer.UpdateModel();
 
   ImGui::DragFloat3("view x", value_ptr(m_renderer.mvp.view[0]), 0.1f, -1.0f,
                     1.0f);
@@ -128,14 +186,37 @@ void ApplicationLayer::OnUIRender() {
 
   // TODO: mvp matrix to update vertex coordinates
 
-  // camera position
-  ImGui::DragFloat3("Camera Position", glm::value_ptr(m_renderer.lookfrom),
-                    0.1f, -30.f, 30.0f);
-  ImGui::DragFloat3("Camera LookAt", glm::value_ptr(m_renderer.lookat), 0.0f,
-                    -100.0f, 100.0f);
+  // camera position, edits are sent to the renderer right away and restart the frame in progress
+  if (ImGui::DragFloat3("Camera Position", glm::value_ptr(m_renderer.lookfrom),
+                        0.1f, -30.f, 30.0f))
+    m_renderer.UpdateCamera();
+  if (ImGui::DragFloat3("Camera LookAt", glm::value_ptr(m_renderer.lookat), 0.0f,
+                        -100.0f, 100.0f))
+    m_renderer.UpdateCamera();
 
-  ImGui::DragFloat3("Base Color", glm::value_ptr(m_renderer.material_color),
-                    0.1f, 0.0f, 1.0f);
+  if (ImGui::DragFloat3("Base Color", glm::value_ptr(m_renderer.material_color),
+                        0.1f, 0.0f, 1.0f))
+    m_renderer.UpdateScene();
+
+  if (ImGui::BeginCombo("BVH layout", magic_enum::enum_name(m_renderer.bvhLayout).data())) {
+    for (auto layout : magic_enum::enum_values<Render::BVHLayout>()) {
+      if (ImGui::Selectable(magic_enum::enum_name(layout).data(), m_renderer.bvhLayout == layout)) {
+        m_renderer.bvhLayout = layout;
+        m_renderer.UpdateScene();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  if (ImGui::BeginCombo("BVH builder", magic_enum::enum_name(m_renderer.bvhBuilder).data())) {
+    for (auto builder : magic_enum::enum_values<Render::BVHBuilder>()) {
+      if (ImGui::Selectable(magic_enum::enum_name(builder).data(), m_renderer.bvhBuilder == builder)) {
+        m_renderer.bvhBuilder = builder;
+        m_renderer.UpdateScene();
+      }
+    }
+    ImGui::EndCombo();
+  }
 
   ImGui::DragFloat("Scale", &m_renderer.scale, 0.1f, 0.0f, 100.0f);
   ImGui::End();
@@ -143,23 +224,58 @@ void ApplicationLayer::OnUIRender() {
   // --------------------------------------------------------------
 
   ImGui::Begin("Render Settings");
-  ImGui::DragInt("Samples", (int *)&m_renderer.samplesPerPixel, 1, 1, 10);
-  ImGui::DragInt("Bounces", (int *)&m_renderer.maxRayDepth, 1, 1, 10);
-  //   ImGui::Text("Last render time: %d ms", m_renderer.lastRenderTimeMS);
-  ImGui::Text("Last render: %.3fms", m_renderer.lastRenderTime);
-  ImGui::Separator();
-
-  auto objects = m_renderer.getScene().GetObjects();
-  for (uint32_t i = 0; i < objects.size(); i++) {
-    ImGui::PushID(i);
-    /* Sphere sphere = std::get<Sphere>(objects[i].GetShape()); */
-    /* ImGui::DragFloat3("Position", glm::value_ptr(sphere.m_center), 0.1f); */
-    /* ImGui::DragFloat("Radius", &sphere.m_radius, 0.1f); */
-    /* Rectangle rect = std::get<Rectangle>(objects[i].GetShape()); */
-    /* ImGui::DragFloat3("Position", glm::value_ptr(rect.center), 0.1f); */
-    ImGui::PopID();
+  bool settingsChanged = false;
+  settingsChanged |= ImGui::DragInt("Samples", (int *)&m_renderer.samplesPerPixel, 1, 1, 10);
+  settingsChanged |= ImGui::DragInt("Bounces", (int *)&m_renderer.maxRayDepth, 1, 1, 10);
+  settingsChanged |= ImGui::Checkbox("Sort hits by material", &m_renderer.sortHitsByMaterial);
+  settingsChanged |= ImGui::Checkbox("Wavefront", &m_renderer.wavefront);
+  if (settingsChanged)
+    m_renderer.UpdateSettings();
+  ImGui::Text("Rendered version %llu of %llu", static_cast<unsigned long long>(m_renderer.RenderedVersion()),
+              static_cast<unsigned long long>(m_renderer.SubmittedVersion()));
+  ImGui::Text("Last render: %.3fms", m_renderer.LastRenderTime());
+  if constexpr (Trace::enabled) {
+    if (ImGui::Button("Write trace")) {
+      try {
+        Trace::WriteChromeJson(traceFilePath);
+        m_logger->info("Trace written to {}", traceFilePath);
+      } catch (const std::exception &e) {
+        m_logger->error(e.what());
+      }
+    }
+  }
+  ImGui::Checkbox("Tile heatmap", &m_showTileHeatmap);
+  if (m_showTileHeatmap) {
+    if (ImGui::BeginCombo("Heatmap metric", magic_enum::enum_name(m_heatmapMetric).data())) {
+      for (auto metric : magic_enum::enum_values<HeatmapMetric>()) {
+        if (ImGui::Selectable(magic_enum::enum_name(metric).data(), m_heatmapMetric == metric))
+          m_heatmapMetric = metric;
+      }
+      ImGui::EndCombo();
+    }
+    ImGui::SliderFloat("Heatmap opacity", &m_heatmapOpacity, 0.0f, 1.0f);
   }
+  ImGui::End();
+  // --------------------------------------------------------------
 
+  ImGui::Begin("Render Stats");
+  const auto stats = m_renderer.LastStats();
+  const auto rays = static_cast<double>(stats.Rays());
+  const double seconds = m_renderer.LastRenderTime() * 1e-3;
+  ImGui::Text("Rays: %llu primary, %llu secondary", (unsigned long long)stats.primaryRays,
+              (unsigned long long)stats.secondaryRays);
+  ImGui::Text("Mrays/s: %.2f", seconds > 0.0 ? rays * 1e-6 / seconds : 0.0);
+  ImGui::Text("Tests per ray: %.2f", rays > 0.0 ? static_cast<double>(stats.IntersectionTests()) / rays : 0.0);
+  ImGui::Text("Early terminations: %llu", (unsigned long long)stats.earlyTerminations);
+  ImGui::Text("Hierarchy: %.1f KiB, built in %.2f ms", static_cast<double>(m_renderer.HierarchyBytes()) / 1024.0,
+              m_renderer.HierarchyBuildTime());
+  ImGui::Separator();
+  ImGui::Text("Intersection tests");
+  for (size_t i = 0; i < stats.intersectionTests.size(); ++i)
+    ImGui::BulletText("%s: %llu", Render::RenderStats::shapeNames[i], (unsigned long long)stats.intersectionTests[i]);
+  ImGui::Text("Scatter calls");
+  for (size_t i = 0; i < stats.scatterCalls.size(); ++i)
+    ImGui::BulletText("%s: %llu", Render::RenderStats::materialNames[i], (unsigned long long)stats.scatterCalls[i]);
   ImGui::End();
   // --------------------------------------------------------------
 }
@@ -13,6 +13,8 @@ namespace RTIAW {
 class ApplicationLayer : public Walnut::Layer {
 public:
   ApplicationLayer();
+  // renderer with `threadCount` workers (0 for the default) placed according to `affinity`
+  ApplicationLayer(std::size_t threadCount, Utils::Affinity affinity);
   ~ApplicationLayer() override = default;
 
   void OnUIRender() override;
@@ -30,6 +32,14 @@ private:
   Render::Renderer m_renderer;
   Render::Renderer::Scenes m_selectedScene{
       Render::Renderer::Scenes::DefaultScene};
+  // binary scene used when m_selectedScene is FromFile
+  char m_sceneFilePath[256]{"scenes/three_spheres.rtsb"};
+
+  // per-quad cost overlay on the rendered image
+  enum class HeatmapMetric { Time, Rays };
+  bool m_showTileHeatmap{false};
+  HeatmapMetric m_heatmapMetric{HeatmapMetric::Time};
+  float m_heatmapOpacity{0.5f};
 };
 } // namespace RTIAW
 
@@ -0,0 +1,61 @@
+#ifndef RTIAW_aabb
+#define RTIAW_aabb
+
+#include <algorithm>
+
+#include "Renderer/Ray.h"
+#include "Renderer/Utils.h"
+
+namespace RTIAW::Render {
+struct AABB {
+  point3 min{Utils::infinity, Utils::infinity, Utils::infinity};
+  point3 max{-Utils::infinity, -Utils::infinity, -Utils::infinity};
+
+  [[nodiscard]] static AABB Infinite() {
+    return {point3{-Utils::infinity, -Utils::infinity, -Utils::infinity},
+            point3{Utils::infinity, Utils::infinity, Utils::infinity}};
+  }
+
+  void Expand(const point3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void Expand(const AABB &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  [[nodiscard]] bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+  [[nodiscard]] bool IsFinite() const {
+    return std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(min.z) && std::isfinite(max.x) &&
+           std::isfinite(max.y) && std::isfinite(max.z);
+  }
+
+  [[nodiscard]] point3 Centroid() const { return 0.5f * (min + max); }
+  [[nodiscard]] vec3 Extent() const { return max - min; }
+  [[nodiscard]] int LongestAxis() const {
+    const vec3 e = Extent();
+    return (e.x > e.y && e.x > e.z) ? 0 : (e.y > e.z ? 1 : 2);
+  }
+  [[nodiscard]] float SurfaceArea() const {
+    if (IsEmpty())
+      return 0.0f;
+    const vec3 e = Extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+
+  // Slab test, returns the entry distance or infinity when the box is missed
+  [[nodiscard]] float Hit(const Ray &r, const float t_min, const float t_max) const {
+    const vec3 t0 = (min - r.origin) * r.inverseDirection;
+    const vec3 t1 = (max - r.origin) * r.inverseDirection;
+    const vec3 tNear = glm::min(t0, t1);
+    const vec3 tFar = glm::max(t0, t1);
+
+    const float tEnter = std::max({tNear.x, tNear.y, tNear.z, t_min});
+    const float tExit = std::min({tFar.x, tFar.y, tFar.z, t_max});
+    return tEnter <= tExit ? tEnter : Utils::infinity;
+  }
+};
+} // namespace RTIAW::Render
+
+#endif
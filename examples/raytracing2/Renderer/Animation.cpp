@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <glm/gtc/constants.hpp>
+
+#include "Renderer/Animation.h"
+
+namespace RTIAW::Render {
+CameraKey Animation::At(const float frame) const {
+  if (keys.empty())
+    throw std::runtime_error("Animation: the camera path has no keys");
+
+  const auto next = std::upper_bound(begin(keys), end(keys), frame,
+                                     [](const float f, const CameraKey &key) { return f < key.frame; });
+  if (next == begin(keys))
+    return keys.front();
+  if (next == end(keys))
+    return keys.back();
+
+  const auto &a = *(next - 1);
+  const auto &b = *next;
+  const float t = (frame - a.frame) / (b.frame - a.frame);
+  return {frame, glm::mix(a.lookfrom, b.lookfrom, t), glm::mix(a.lookat, b.lookat, t),
+          a.aperture + (b.aperture - a.aperture) * t};
+}
+
+std::string Animation::FramePath(const unsigned int frame) const {
+  return fmt::format("{}/frame_{:04}.ppm", outputDirectory, frame);
+}
+
+void Animation::WriteFrame(const unsigned int frame, const uint8_t *rgba, const glm::uvec2 size) const {
+  const auto path = FramePath(frame);
+  std::ofstream out{path, std::ios::binary};
+  if (!out)
+    throw std::runtime_error(fmt::format("Animation: can't write {}", path));
+
+  out << fmt::format("P6\n{} {}\n255\n", size.x, size.y);
+  std::vector<char> row(static_cast<size_t>(size.x) * 3);
+  for (unsigned int y = size.y; y > 0; --y) {
+    const uint8_t *pixel = rgba + static_cast<size_t>(y - 1) * size.x * 4;
+    for (size_t x = 0; x < size.x; ++x, pixel += 4) {
+      std::copy_n(pixel, 3, &row[x * 3]);
+    }
+    out.write(row.data(), static_cast<std::streamsize>(row.size()));
+  }
+  if (!out)
+    throw std::runtime_error(fmt::format("Animation: can't write {}", path));
+}
+
+void Animation::AddTurntable(const unsigned int frames, const point3 lookfrom, const point3 lookat,
+                             const float aperture) {
+  const float start = keys.empty() ? 0.0f : keys.back().frame + 1.0f;
+  const vec3 offset = lookfrom - lookat;
+  for (unsigned int i = 0; i < frames; ++i) {
+    const float angle = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(frames);
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    const vec3 rotated{c * offset.x + s * offset.z, offset.y, -s * offset.x + c * offset.z};
+    keys.push_back({start + static_cast<float>(i), lookat + rotated, lookat, aperture});
+  }
+}
+
+Animation Animation::Load(const std::string &path) {
+  std::ifstream in{path};
+  if (!in)
+    throw std::runtime_error(fmt::format("Animation: can't open {}", path));
+
+  Animation animation;
+  bool framesGiven = false;
+
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+    const auto fail = [&](const std::string &what) {
+      return std::runtime_error(fmt::format("{}:{}: {}", path, lineNumber, what));
+    };
+
+    if (const auto comment = line.find('#'); comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream tokens{line};
+    std::string keyword;
+    if (!(tokens >> keyword))
+      continue;
+
+    const auto readCamera = [&](point3 &lookfrom, point3 &lookat, float &aperture) {
+      std::string key;
+      while (tokens >> key) {
+        if (key == "lookfrom" && tokens >> lookfrom.x >> lookfrom.y >> lookfrom.z)
+          continue;
+        if (key == "lookat" && tokens >> lookat.x >> lookat.y >> lookat.z)
+          continue;
+        if (key == "aperture" && tokens >> aperture)
+          continue;
+        throw fail(fmt::format("bad camera property '{}'", key));
+      }
+    };
+
+    if (keyword == "scene") {
+      if (!(tokens >> animation.scene))
+        throw fail("'scene' expects a name or a path");
+    } else if (keyword == "size") {
+      if (!(tokens >> animation.imageSize.x >> animation.imageSize.y) || animation.imageSize.x < 2 ||
+          animation.imageSize.y < 2)
+        throw fail("'size' expects a width and a height");
+    } else if (keyword == "samples") {
+      if (!(tokens >> animation.samplesPerPixel) || animation.samplesPerPixel == 0)
+        throw fail("'samples' expects a positive number");
+    } else if (keyword == "depth") {
+      if (!(tokens >> animation.maxRayDepth))
+        throw fail("'depth' expects a number");
+    } else if (keyword == "frames") {
+      if (!(tokens >> animation.firstFrame >> animation.lastFrame) || animation.lastFrame < animation.firstFrame)
+        throw fail("'frames' expects a first and a last frame");
+      framesGiven = true;
+    } else if (keyword == "output") {
+      if (!(tokens >> animation.outputDirectory))
+        throw fail("'output' expects a directory");
+    } else if (keyword == "key") {
+      CameraKey key{0.0f, point3{13, 2, 3}, point3{0, 0, 0}, 0.1f};
+      if (!(tokens >> key.frame))
+        throw fail("'key' expects a frame number");
+      readCamera(key.lookfrom, key.lookat, key.aperture);
+      if (!animation.keys.empty() && key.frame <= animation.keys.back().frame)
+        throw fail("keys have to be given in frame order");
+      animation.keys.push_back(key);
+    } else if (keyword == "turntable") {
+      unsigned int frames = 0;
+      point3 lookfrom{13, 2, 3}, lookat{0, 0, 0};
+      float aperture = 0.1f;
+      if (!(tokens >> frames) || frames == 0)
+        throw fail("'turntable' expects a number of frames");
+      readCamera(lookfrom, lookat, aperture);
+      animation.AddTurntable(frames, lookfrom, lookat, aperture);
+    } else {
+      throw fail(fmt::format("unknown keyword '{}'", keyword));
+    }
+  }
+
+  if (animation.keys.empty())
+    throw std::runtime_error(fmt::format("{}: the camera path has no keys", path));
+  // all the keyed frames by default
+  if (!framesGiven) {
+    animation.firstFrame = static_cast<unsigned int>(std::max(0.0f, animation.keys.front().frame));
+    animation.lastFrame = static_cast<unsigned int>(std::max(0.0f, animation.keys.back().frame));
+  }
+  return animation;
+}
+} // namespace RTIAW::Render
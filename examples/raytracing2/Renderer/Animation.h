@@ -0,0 +1,56 @@
+#ifndef RTIAW_animation
+#define RTIAW_animation
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Renderer/Utils.h"
+
+namespace RTIAW::Render {
+// Camera of one keyframe
+struct CameraKey {
+  float frame;
+  point3 lookfrom;
+  point3 lookat;
+  float aperture;
+};
+
+// Batch render of a camera path, see Renderer::RenderAnimation(). Frames in between the keys are interpolated
+// linearly, frames outside them hold the first or the last key.
+//
+// The text form (*.rtanim) has one statement per line, '#' starts a comment:
+//   scene     <scene name, as in the Scene menu> | <path to a binary scene file>
+//   size      <width> <height>
+//   samples   <samples per pixel>
+//   depth     <max ray bounces>
+//   frames    <first> <last>
+//   output    <directory of the numbered images>
+//   key       <frame> lookfrom x y z lookat x y z aperture a
+//   turntable <frames> lookfrom x y z lookat x y z aperture a   (one orbit around lookat, after the last key)
+struct Animation {
+  std::vector<CameraKey> keys; // sorted by frame
+  unsigned int firstFrame{0};
+  unsigned int lastFrame{0}; // included
+  std::string outputDirectory{"."};
+
+  // only read by the command line front end, the renderer uses its own settings
+  std::string scene{"DefaultScene"};
+  glm::uvec2 imageSize{800, 450};
+  unsigned int samplesPerPixel{10};
+  unsigned int maxRayDepth{10};
+
+  [[nodiscard]] CameraKey At(float frame) const;
+  // frame_0042.ppm in the output directory
+  [[nodiscard]] std::string FramePath(unsigned int frame) const;
+  // writes the image of `frame` as a binary PPM, `rgba` holds the rows bottom first like the render buffer
+  void WriteFrame(unsigned int frame, const uint8_t *rgba, glm::uvec2 size) const;
+
+  // appends `frames` keys going once around `lookat`, starting from `lookfrom`
+  void AddTurntable(unsigned int frames, point3 lookfrom, point3 lookat, float aperture);
+
+  static Animation Load(const std::string &path);
+};
+} // namespace RTIAW::Render
+
+#endif
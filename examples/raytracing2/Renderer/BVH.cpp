@@ -0,0 +1,508 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <numeric>
+
+#include "Renderer/BVH.h"
+#include "Renderer/ThreadPool.h"
+
+namespace RTIAW::Render {
+void BVH::Node::SetBounds(const AABB &box) {
+  for (int axis = 0; axis < 3; ++axis) {
+    bmin[axis] = box.min[axis];
+    bmax[axis] = box.max[axis];
+  }
+}
+
+void BVH::Refit(const std::vector<AABB> &bounds) {
+  // children come after their parents
+  for (size_t i = m_nodes.size(); i > 0; --i) {
+    Node &node = m_nodes[i - 1];
+    AABB box{};
+    if (node.IsLeaf()) {
+      for (uint32_t primitive = node.leftFirst; primitive < node.leftFirst + node.count; ++primitive)
+        box.Expand(bounds[primitive]);
+    } else {
+      box = m_nodes[node.leftFirst].Bounds();
+      box.Expand(m_nodes[node.leftFirst + 1].Bounds());
+    }
+    node.SetBounds(box);
+  }
+}
+
+bool BVH::IsValid(const std::span<const Node> nodes, const size_t primitiveCount) {
+  // children come after their parents, so the depth of a node is known by the time it is reached
+  std::vector<uint8_t> depths(nodes.size(), 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Node &node = nodes[i];
+    if (node.IsLeaf()) {
+      if (node.leftFirst + uint64_t{node.count} > primitiveCount)
+        return false;
+      continue;
+    }
+    if (node.leftFirst <= i || node.leftFirst + uint64_t{1} >= nodes.size())
+      return false;
+    const auto childDepth = static_cast<uint8_t>(depths[i] + 1);
+    if (childDepth >= maxDepth)
+      return false;
+    for (const uint32_t child : {node.leftFirst, node.leftFirst + 1})
+      depths[child] = std::max(depths[child], childDepth);
+  }
+  return true;
+}
+
+namespace {
+// primitives handled in one piece by a thread, passes over fewer stay on the calling thread
+constexpr size_t parallelGrain = 16 * 1024;
+constexpr int binCount = 16;
+constexpr int mortonBits = 10; // per axis
+constexpr int radixBits = 10;
+constexpr uint32_t radixSize = 1u << radixBits;
+
+// spreads the low 10 bits of `v` three bits apart
+uint32_t SpreadBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// primitive bounds and counts in the bins of every axis
+struct Bins {
+  std::array<std::array<AABB, binCount>, 3> bounds{};
+  std::array<std::array<uint32_t, binCount>, 3> counts{};
+
+  Bins &operator+=(const Bins &other) {
+    for (int axis = 0; axis < 3; ++axis) {
+      for (int bin = 0; bin < binCount; ++bin) {
+        bounds[axis][bin].Expand(other.bounds[axis][bin]);
+        counts[axis][bin] += other.counts[axis][bin];
+      }
+    }
+    return *this;
+  }
+};
+
+// Top-down build shared by the strategies. The nodes above the subtree size are split one at a time, with
+// parallel passes over their primitives, then the subtrees below are built whole on the pool threads into nodes
+// of their own that are appended afterwards. Node bounds are computed bottom-up once the splits are done.
+class Builder {
+public:
+  Builder(const std::vector<AABB> &bounds, std::vector<uint32_t> &order, const BVHBuilder builder,
+          Utils::Pool *pool)
+      : m_bounds{bounds}, m_order{order}, m_builder{builder}, m_pool{pool} {}
+
+  void Build(std::vector<BVH::Node> &nodes) {
+    const size_t count = m_bounds.size();
+    m_order.resize(count);
+    m_centroids.resize(count);
+    For(0, count, true, [this](const size_t first, const size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        m_order[i] = static_cast<uint32_t>(i);
+        m_centroids[i] = m_bounds[i].Centroid();
+      }
+    });
+    if (count == 0)
+      return;
+    if (m_builder == BVHBuilder::LBVH)
+      SortMorton();
+
+    // a binary tree with at least one primitive per leaf never has more than 2n - 1 nodes
+    nodes.reserve(2 * count);
+    BVH::Node &root = nodes.emplace_back();
+    root.leftFirst = 0;
+    root.count = static_cast<uint32_t>(count);
+
+    // top levels, breadth first, until the nodes are small enough to be left to one thread
+    const size_t threadCount = m_pool != nullptr ? m_pool->ThreadCount() + 1 : 1;
+    const size_t subtreeSize = m_pool != nullptr ? std::max(parallelGrain, count / (8 * threadCount)) : count;
+    std::vector<Pending> queue{{0, 0}};
+    std::vector<Pending> subtrees;
+    std::vector<uint32_t> topNodes;
+    for (size_t next = 0; next < queue.size(); ++next) {
+      const Pending pending = queue[next];
+      if (nodes[pending.node].count <= subtreeSize) {
+        subtrees.push_back(pending);
+        continue;
+      }
+      topNodes.push_back(pending.node);
+      uint32_t leftCount = 0;
+      if (!Split(nodes[pending.node].leftFirst, nodes[pending.node].count, pending.depth, true, leftCount))
+        continue;
+      const uint32_t left = AddChildren(nodes, pending.node, leftCount);
+      queue.push_back({left, pending.depth + 1});
+      queue.push_back({left + 1, pending.depth + 1});
+    }
+
+    if (subtrees.size() == 1 && subtrees.front().node == 0)
+      Subdivide(nodes, 0, 0);
+    else
+      BuildSubtrees(nodes, subtrees);
+
+    for (auto index = topNodes.rbegin(); index != topNodes.rend(); ++index) {
+      BVH::Node &node = nodes[*index];
+      if (node.IsLeaf()) {
+        node.SetBounds(RangeBounds(node.leftFirst, node.count, true));
+      } else {
+        AABB box = nodes[node.leftFirst].Bounds();
+        box.Expand(nodes[node.leftFirst + 1].Bounds());
+        node.SetBounds(box);
+      }
+    }
+  }
+
+private:
+  struct Pending {
+    uint32_t node;
+    size_t depth;
+  };
+
+  const std::vector<AABB> &m_bounds;
+  std::vector<uint32_t> &m_order;
+  const BVHBuilder m_builder;
+  Utils::Pool *m_pool;
+  std::vector<point3> m_centroids;
+  std::vector<uint32_t> m_codes; // LBVH: Morton code of the primitive at each position of m_order
+
+  // `function(first, last)` over [begin, end), on the pool when asked to and the range is worth it
+  template <typename Function>
+  void For(const size_t begin, const size_t end, const bool parallel, Function &&function) {
+    if (parallel && m_pool != nullptr && end - begin > parallelGrain)
+      m_pool->ParallelFor(begin, end, parallelGrain, function);
+    else
+      function(begin, end);
+  }
+
+  template <typename Value, typename Map, typename Reduce>
+  Value Fold(const size_t begin, const size_t end, const bool parallel, Value identity, Map &&map, Reduce &&reduce) {
+    if (parallel && m_pool != nullptr && end - begin > parallelGrain)
+      return m_pool->ParallelReduce(begin, end, parallelGrain, std::move(identity), map, reduce);
+    return reduce(std::move(identity), map(begin, end));
+  }
+
+  // bounds of the primitives, or of their centroids, at [first, first + count) of the order
+  AABB RangeBounds(const uint32_t first, const uint32_t count, const bool parallel, const bool centroids = false) {
+    return Fold(
+        first, first + count, parallel, AABB{},
+        [this, centroids](const size_t begin, const size_t end) {
+          AABB box{};
+          for (size_t i = begin; i < end; ++i) {
+            if (centroids)
+              box.Expand(m_centroids[m_order[i]]);
+            else
+              box.Expand(m_bounds[m_order[i]]);
+          }
+          return box;
+        },
+        [](AABB lhs, const AABB &rhs) {
+          lhs.Expand(rhs);
+          return lhs;
+        });
+  }
+
+  // turns the leaf `index` into an inner node over its first `leftCount` primitives and the others, returns the
+  // index of its left child
+  static uint32_t AddChildren(std::vector<BVH::Node> &nodes, const uint32_t index, const uint32_t leftCount) {
+    const uint32_t first = nodes[index].leftFirst;
+    const uint32_t count = nodes[index].count;
+    const auto left = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[left].leftFirst = first;
+    nodes[left].count = leftCount;
+    nodes[left + 1].leftFirst = first + leftCount;
+    nodes[left + 1].count = count - leftCount;
+
+    nodes[index].leftFirst = left;
+    nodes[index].count = 0;
+    return left;
+  }
+
+  // Builds the subtree under the leaf `index` on the calling thread, returns its bounds
+  AABB Subdivide(std::vector<BVH::Node> &nodes, const uint32_t index, const size_t depth) {
+    uint32_t leftCount = 0;
+    if (!Split(nodes[index].leftFirst, nodes[index].count, depth, false, leftCount)) {
+      const AABB box = RangeBounds(nodes[index].leftFirst, nodes[index].count, false);
+      nodes[index].SetBounds(box);
+      return box;
+    }
+
+    const uint32_t left = AddChildren(nodes, index, leftCount);
+    AABB box = Subdivide(nodes, left, depth + 1);
+    box.Expand(Subdivide(nodes, left + 1, depth + 1));
+    nodes[index].SetBounds(box);
+    return box;
+  }
+
+  // One task per subtree, largest first. The subtree roots stay in place, the nodes below them are appended.
+  void BuildSubtrees(std::vector<BVH::Node> &nodes, std::vector<Pending> &subtrees) {
+    std::sort(begin(subtrees), end(subtrees), [&nodes](const Pending &lhs, const Pending &rhs) {
+      return nodes[lhs.node].count > nodes[rhs.node].count;
+    });
+
+    std::vector<std::vector<BVH::Node>> built(subtrees.size());
+    m_pool->ParallelFor(0, subtrees.size(), 1, [&](const size_t first, const size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        built[i] = {nodes[subtrees[i].node]};
+        Subdivide(built[i], 0, subtrees[i].depth);
+      }
+    });
+
+    std::vector<size_t> offsets(subtrees.size());
+    size_t size = nodes.size();
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+      offsets[i] = size;
+      size += built[i].size() - 1;
+    }
+    nodes.resize(size);
+    m_pool->ParallelFor(0, subtrees.size(), 1, [&](const size_t first, const size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        // local node j > 0 lands at offsets[i] + j - 1
+        const auto place = [offset = offsets[i]](BVH::Node node) {
+          if (!node.IsLeaf())
+            node.leftFirst = static_cast<uint32_t>(offset + node.leftFirst - 1);
+          return node;
+        };
+        nodes[subtrees[i].node] = place(built[i].front());
+        std::transform(begin(built[i]) + 1, end(built[i]), begin(nodes) + offsets[i], place);
+        built[i] = {};
+      }
+    });
+  }
+
+  // Decides whether the primitives at [first, first + count) of the order are split and reorders them so that
+  // the first `leftCount` go left. False for a leaf.
+  bool Split(const uint32_t first, const uint32_t count, const size_t depth, const bool parallel,
+             uint32_t &leftCount) {
+    // the traversal stack holds at most one entry per level
+    if (count <= BVH::maxLeafSize || depth + 1 >= BVH::maxDepth)
+      return false;
+
+    if (m_builder == BVHBuilder::LBVH) {
+      leftCount = MortonSplit(first, count);
+      return true;
+    }
+
+    const AABB centroidBounds = RangeBounds(first, count, parallel, true);
+    if (m_builder == BVHBuilder::BinnedSAH && SahSplit(first, count, centroidBounds, parallel, leftCount))
+      return true;
+
+    // Median split along the axis where the centroids are spread the most
+    const int axis = centroidBounds.LongestAxis();
+    if (centroidBounds.Extent()[axis] <= 0.0f)
+      return false;
+
+    const auto rangeBegin = begin(m_order) + first;
+    const auto rangeEnd = rangeBegin + count;
+    const auto rangeMid = rangeBegin + count / 2;
+    std::nth_element(rangeBegin, rangeMid, rangeEnd,
+                     [&](uint32_t lhs, uint32_t rhs) { return m_centroids[lhs][axis] < m_centroids[rhs][axis]; });
+    leftCount = count / 2;
+    return true;
+  }
+
+  // Bins the centroids along each axis and takes the bin boundary with the lowest surface area cost. False when
+  // no boundary has primitives on both sides.
+  bool SahSplit(const uint32_t first, const uint32_t count, const AABB &centroidBounds, const bool parallel,
+                uint32_t &leftCount) {
+    const vec3 extent = centroidBounds.Extent();
+    vec3 scale{0.0f};
+    for (int axis = 0; axis < 3; ++axis) {
+      if (extent[axis] > 0.0f)
+        scale[axis] = static_cast<float>(binCount) / extent[axis];
+    }
+    const auto binOf = [&](const uint32_t primitive, const int axis) {
+      return std::min(binCount - 1,
+                      static_cast<int>((m_centroids[primitive][axis] - centroidBounds.min[axis]) * scale[axis]));
+    };
+
+    const Bins bins = Fold(
+        first, first + count, parallel, Bins{},
+        [&](const size_t begin, const size_t end) {
+          Bins partial{};
+          for (size_t i = begin; i < end; ++i) {
+            const uint32_t primitive = m_order[i];
+            for (int axis = 0; axis < 3; ++axis) {
+              const int bin = binOf(primitive, axis);
+              partial.bounds[axis][bin].Expand(m_bounds[primitive]);
+              ++partial.counts[axis][bin];
+            }
+          }
+          return partial;
+        },
+        [](Bins lhs, const Bins &rhs) { return lhs += rhs; });
+
+    // cost of a split after bin b: area * count on both sides
+    float bestCost = Utils::infinity;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (scale[axis] == 0.0f)
+        continue;
+      std::array<float, binCount> rightArea{};
+      std::array<uint32_t, binCount> rightCount{};
+      AABB box{};
+      uint32_t n = 0;
+      for (int bin = binCount - 1; bin > 0; --bin) {
+        box.Expand(bins.bounds[axis][bin]);
+        n += bins.counts[axis][bin];
+        rightArea[bin] = box.SurfaceArea();
+        rightCount[bin] = n;
+      }
+      box = AABB{};
+      n = 0;
+      for (int bin = 0; bin < binCount - 1; ++bin) {
+        box.Expand(bins.bounds[axis][bin]);
+        n += bins.counts[axis][bin];
+        if (n == 0 || rightCount[bin + 1] == 0)
+          continue;
+        const float cost = box.SurfaceArea() * static_cast<float>(n) +
+                           rightArea[bin + 1] * static_cast<float>(rightCount[bin + 1]);
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = bin;
+        }
+      }
+    }
+    if (bestAxis < 0)
+      return false;
+
+    leftCount = Partition(first, count, parallel,
+                          [&](const uint32_t primitive) { return binOf(primitive, bestAxis) <= bestBin; });
+    return true;
+  }
+
+  // std::partition() of [first, first + count) of the order, in chunks on the pool for large ranges: the chunks
+  // count what goes left, then scatter to the offsets of their part
+  template <typename Predicate>
+  uint32_t Partition(const uint32_t first, const uint32_t count, const bool parallel, Predicate &&goesLeft) {
+    const auto rangeBegin = begin(m_order) + first;
+    if (!parallel || m_pool == nullptr || count <= parallelGrain)
+      return static_cast<uint32_t>(std::partition(rangeBegin, rangeBegin + count, goesLeft) - rangeBegin);
+
+    const size_t chunkCount = (count + parallelGrain - 1) / parallelGrain;
+    const auto chunkBegin = [&](const size_t chunk) {
+      return rangeBegin + static_cast<std::ptrdiff_t>(std::min<size_t>(chunk * parallelGrain, count));
+    };
+    std::vector<uint32_t> leftOffsets(chunkCount);
+    m_pool->ParallelFor(0, chunkCount, 1, [&](const size_t firstChunk, const size_t lastChunk) {
+      for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+        leftOffsets[chunk] = static_cast<uint32_t>(std::count_if(chunkBegin(chunk), chunkBegin(chunk + 1), goesLeft));
+    });
+    const uint32_t leftCount = std::accumulate(begin(leftOffsets), end(leftOffsets), 0u);
+    std::exclusive_scan(begin(leftOffsets), end(leftOffsets), begin(leftOffsets), 0u);
+
+    std::vector<uint32_t> partitioned(count);
+    m_pool->ParallelFor(0, chunkCount, 1, [&](const size_t firstChunk, const size_t lastChunk) {
+      for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk) {
+        uint32_t left = leftOffsets[chunk];
+        // the primitives before this chunk that go right
+        uint32_t right = leftCount + static_cast<uint32_t>(chunk * parallelGrain) - leftOffsets[chunk];
+        for (auto i = chunkBegin(chunk); i != chunkBegin(chunk + 1); ++i)
+          partitioned[goesLeft(*i) ? left++ : right++] = *i;
+      }
+    });
+    For(0, count, true, [&](const size_t begin, const size_t end) {
+      std::copy(partitioned.begin() + begin, partitioned.begin() + end, rangeBegin + begin);
+    });
+    return leftCount;
+  }
+
+  // Sorts the order by the Morton codes of the centroids in the centroid bounds, with a radix sort in chunks
+  void SortMorton() {
+    const size_t count = m_order.size();
+    const AABB centroidBounds = RangeBounds(0, static_cast<uint32_t>(count), true, true);
+    const vec3 extent = centroidBounds.Extent();
+    constexpr float cells = static_cast<float>((1u << mortonBits) - 1);
+    vec3 scale{0.0f};
+    for (int axis = 0; axis < 3; ++axis) {
+      if (extent[axis] > 0.0f)
+        scale[axis] = cells / extent[axis];
+    }
+
+    std::vector<uint32_t> keys(count);
+    For(0, count, true, [&](const size_t first, const size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        const vec3 cell = (m_centroids[i] - centroidBounds.min) * scale;
+        keys[i] = SpreadBits(static_cast<uint32_t>(cell.x)) | (SpreadBits(static_cast<uint32_t>(cell.y)) << 1) |
+                  (SpreadBits(static_cast<uint32_t>(cell.z)) << 2);
+      }
+    });
+
+    // Least significant digit first. Every chunk counts its digits, the offsets are laid out digit by digit and
+    // chunk by chunk within a digit, then the chunks scatter in order: each pass is stable.
+    const size_t threadCount = m_pool != nullptr ? m_pool->ThreadCount() + 1 : 1;
+    const size_t chunkSize = std::max(parallelGrain, (count + 4 * threadCount - 1) / (4 * threadCount));
+    const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    const auto forChunks = [&](auto &&function) {
+      const auto run = [&](const size_t firstChunk, const size_t lastChunk) {
+        for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+          function(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+      };
+      if (m_pool != nullptr && chunkCount > 1)
+        m_pool->ParallelFor(0, chunkCount, 1, run);
+      else
+        run(0, chunkCount);
+    };
+
+    std::vector<uint32_t> values = std::move(m_order);
+    std::vector<uint32_t> sortedKeys(count);
+    std::vector<uint32_t> sortedValues(count);
+    std::vector<uint32_t> offsets(chunkCount * radixSize);
+    for (int shift = 0; shift < 3 * mortonBits; shift += radixBits) {
+      const auto digit = [shift](const uint32_t key) { return (key >> shift) & (radixSize - 1); };
+      forChunks([&](const size_t chunk, const size_t first, const size_t last) {
+        uint32_t *histogram = offsets.data() + chunk * radixSize;
+        std::fill_n(histogram, radixSize, 0u);
+        for (size_t i = first; i < last; ++i)
+          ++histogram[digit(keys[i])];
+      });
+      uint32_t sum = 0;
+      for (uint32_t d = 0; d < radixSize; ++d) {
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+          const uint32_t digitCount = offsets[chunk * radixSize + d];
+          offsets[chunk * radixSize + d] = sum;
+          sum += digitCount;
+        }
+      }
+      forChunks([&](const size_t chunk, const size_t first, const size_t last) {
+        uint32_t *offset = offsets.data() + chunk * radixSize;
+        for (size_t i = first; i < last; ++i) {
+          const uint32_t to = offset[digit(keys[i])]++;
+          sortedKeys[to] = keys[i];
+          sortedValues[to] = values[i];
+        }
+      });
+      std::swap(keys, sortedKeys);
+      std::swap(values, sortedValues);
+    }
+    m_order = std::move(values);
+    m_codes = std::move(keys);
+  }
+
+  // Splits where the highest bit that differs in the range flips, the codes of a range share all the bits above
+  // it. A range in a single cell is halved.
+  uint32_t MortonSplit(const uint32_t first, const uint32_t count) const {
+    const uint32_t firstCode = m_codes[first];
+    const uint32_t lastCode = m_codes[first + count - 1];
+    if (firstCode == lastCode)
+      return count / 2;
+
+    const uint32_t bit = 1u << (31 - std::countl_zero(firstCode ^ lastCode));
+    const auto rangeBegin = begin(m_codes) + first;
+    const auto split =
+        std::partition_point(rangeBegin, rangeBegin + count, [bit](const uint32_t code) { return !(code & bit); });
+    return static_cast<uint32_t>(split - rangeBegin);
+  }
+};
+} // namespace
+
+void BVH::Build(const std::vector<AABB> &bounds, std::vector<uint32_t> &order, const BVHBuilder builder,
+                Utils::Pool *pool) {
+  m_nodes.clear();
+  Builder{bounds, order, builder, pool}.Build(m_nodes);
+  m_nodes.shrink_to_fit();
+}
+} // namespace RTIAW::Render
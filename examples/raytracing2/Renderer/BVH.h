@@ -0,0 +1,140 @@
+#ifndef RTIAW_bvh
+#define RTIAW_bvh
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Renderer/AABB.h"
+#include "Renderer/Ray.h"
+
+namespace RTIAW::Utils {
+class Pool;
+}
+
+namespace RTIAW::Render {
+// How BVH::Build() splits the primitives:
+// - Median halves every node along the axis its centroids spread the most,
+// - BinnedSAH picks the cheapest of the bin boundaries by the surface area heuristic, for final renders,
+// - LBVH sorts the primitives along a Morton curve once and splits on the bits of their codes, the fastest to
+//   build, for scenes rebuilt all the time.
+enum class BVHBuilder { Median, BinnedSAH, LBVH };
+
+// A flat bounding volume hierarchy over a set of bounding boxes.
+// Nodes are plain old data, so a built hierarchy can be written to and adopted from a scene file verbatim.
+class BVH {
+public:
+  struct Node {
+    float bmin[3];
+    uint32_t leftFirst; // left child index for inner nodes (the right one follows it), first primitive for leaves
+    float bmax[3];
+    uint32_t count; // number of primitives in a leaf, 0 for inner nodes
+
+    [[nodiscard]] bool IsLeaf() const { return count > 0; }
+    [[nodiscard]] AABB Bounds() const {
+      return {point3{bmin[0], bmin[1], bmin[2]}, point3{bmax[0], bmax[1], bmax[2]}};
+    }
+    void SetBounds(const AABB &box);
+  };
+  static_assert(sizeof(Node) == 32, "BVH nodes are stored as-is in scene files");
+
+  static constexpr uint32_t maxLeafSize = 4;
+  static constexpr size_t maxDepth = 64;
+
+  // Builds the hierarchy over `bounds`. On return `order` holds the primitive indices in the order the
+  // caller has to store its primitives in: leaves reference contiguous ranges of that order.
+  // With a `pool` the top levels are split with parallel passes over the primitives, then the subtrees below
+  // them are built on its threads. Must not be called from a task of `pool`.
+  void Build(const std::vector<AABB> &bounds, std::vector<uint32_t> &order, BVHBuilder builder = BVHBuilder::Median,
+             Utils::Pool *pool = nullptr);
+
+  // Recomputes the node bounds, bottom-up, after primitives moved: `bounds` are in the order Build() returned.
+  // The tree keeps its shape, it gets looser the further the primitives move.
+  void Refit(const std::vector<AABB> &bounds);
+  // Takes over a hierarchy built elsewhere, e.g. one loaded from a scene file, see IsValid()
+  void Adopt(std::vector<Node> nodes) { m_nodes = std::move(nodes); }
+  // Whether `nodes` can be traversed safely: leaves within [0, primitiveCount), children after their parent (as
+  // Build() lays them out, so there are no cycles) and no path deeper than the traversal stacks
+  [[nodiscard]] static bool IsValid(std::span<const Node> nodes, size_t primitiveCount);
+  void Clear() { m_nodes.clear(); }
+
+  [[nodiscard]] bool Empty() const { return m_nodes.empty(); }
+  [[nodiscard]] const std::vector<Node> &Nodes() const { return m_nodes; }
+
+  // Closest-hit traversal, nearest child first. `intersectLeaf(first, count, closest)` has to test the
+  // primitives [first, first + count) and shrink `closest` whenever it finds a nearer hit.
+  template <typename IntersectLeaf>
+  void Traverse(const Ray &r, const float t_min, float &closest, IntersectLeaf &&intersectLeaf) const {
+    if (m_nodes.empty() || m_nodes[0].Bounds().Hit(r, t_min, closest) == Utils::infinity)
+      return;
+
+    std::pair<uint32_t, float> stack[maxDepth];
+    size_t stackSize = 0;
+    uint32_t current = 0;
+
+    while (true) {
+      const Node &node = m_nodes[current];
+      if (node.IsLeaf()) {
+        intersectLeaf(node.leftFirst, node.count, closest);
+      } else {
+        uint32_t nearChild = node.leftFirst;
+        uint32_t farChild = node.leftFirst + 1;
+        float tNear = m_nodes[nearChild].Bounds().Hit(r, t_min, closest);
+        float tFar = m_nodes[farChild].Bounds().Hit(r, t_min, closest);
+        if (tFar < tNear) {
+          std::swap(nearChild, farChild);
+          std::swap(tNear, tFar);
+        }
+
+        if (tNear != Utils::infinity) {
+          if (tFar != Utils::infinity)
+            stack[stackSize++] = {farChild, tFar};
+          current = nearChild;
+          continue;
+        }
+      }
+
+      // pop the next subtree that can still contain a closer hit
+      do {
+        if (stackSize == 0)
+          return;
+        --stackSize;
+      } while (stack[stackSize].second > closest);
+      current = stack[stackSize].first;
+    }
+  }
+
+  // Any-hit traversal: stops as soon as `anyLeaf(first, count)` reports an intersection in one of the leaves
+  // and returns whether one did. Children are visited in the order they are stored, no distances are kept.
+  template <typename AnyLeaf>
+  [[nodiscard]] bool TraverseAny(const Ray &r, const float t_min, const float t_max, AnyLeaf &&anyLeaf) const {
+    if (m_nodes.empty())
+      return false;
+
+    uint32_t stack[maxDepth];
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+      const Node &node = m_nodes[stack[--stackSize]];
+      if (node.Bounds().Hit(r, t_min, t_max) == Utils::infinity)
+        continue;
+
+      if (node.IsLeaf()) {
+        if (anyLeaf(node.leftFirst, node.count))
+          return true;
+      } else {
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+      }
+    }
+    return false;
+  }
+
+private:
+  std::vector<Node> m_nodes;
+};
+} // namespace RTIAW::Render
+
+#endif
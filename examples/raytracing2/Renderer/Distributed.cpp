@@ -0,0 +1,553 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <magic_enum.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "Renderer/Distributed.h"
+#include "Renderer/Renderer.h"
+#include "Renderer/SceneFile.h"
+
+namespace RTIAW::Render::Distributed {
+namespace {
+static_assert(std::endian::native == std::endian::little, "the messages are sent as they are in memory");
+
+// ------------------------------------------------------------------ messages
+// A message is a header followed by `size` bytes of payload
+enum class MessageType : uint32_t { Job, Lease, Result, Done };
+
+struct MessageHeader {
+  MessageType type;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+// coordinator -> worker, once. Followed by the binary scene file when sceneBytes is not 0, `scene` names one of
+// the built-in scenes otherwise
+struct JobRecord {
+  uint32_t width;
+  uint32_t height;
+  uint32_t maxRayDepth;
+  uint32_t sceneBytes;
+  char scene[64];
+};
+
+// coordinator -> worker, and worker -> coordinator followed by the sums of the region (3 floats per pixel)
+struct LeaseRecord {
+  uint32_t id;
+  uint32_t frame;
+  uint32_t minCoo[2];
+  uint32_t maxCoo[2];
+  uint32_t samples;
+  float aperture;
+  float lookfrom[3];
+  float lookat[3];
+};
+
+static_assert(sizeof(MessageHeader) == 16 && sizeof(JobRecord) == 80 && sizeof(LeaseRecord) == 56);
+
+constexpr uint64_t maxPayload = uint64_t{1} << 32;
+
+template <typename T> std::span<const std::byte> AsBytes(const T &value) {
+  return std::as_bytes(std::span<const T, 1>{&value, 1});
+}
+
+// ------------------------------------------------------------------ sockets
+class Socket {
+public:
+  Socket() = default;
+  explicit Socket(const int fd) : m_fd{fd} {}
+  Socket(Socket &&other) noexcept : m_fd{std::exchange(other.m_fd, -1)} {}
+  Socket &operator=(Socket &&other) noexcept {
+    std::swap(m_fd, other.m_fd);
+    return *this;
+  }
+  ~Socket() {
+    if (m_fd >= 0)
+      close(m_fd);
+  }
+
+  [[nodiscard]] int Fd() const { return m_fd; }
+
+  // a receive that waits longer than `timeout` throws
+  void SetReceiveTimeout(const std::chrono::seconds timeout) const {
+    const timeval value{static_cast<time_t>(timeout.count()), 0};
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &value, sizeof(value));
+  }
+
+  void SendMessage(const MessageType type, const std::span<const std::byte> first,
+                   const std::span<const std::byte> second = {}) const {
+    const MessageHeader header{type, 0, first.size() + second.size()};
+    Send(AsBytes(header));
+    Send(first);
+    Send(second);
+  }
+
+  MessageHeader ReceiveMessage(std::vector<std::byte> &payload) const {
+    MessageHeader header;
+    Receive(std::as_writable_bytes(std::span<MessageHeader, 1>{&header, 1}));
+    if (header.size > maxPayload)
+      throw std::runtime_error(fmt::format("message of {} bytes, the stream is corrupt", header.size));
+    payload.resize(header.size);
+    Receive(payload);
+    return header;
+  }
+
+private:
+  int m_fd{-1};
+
+  void Send(std::span<const std::byte> data) const {
+    while (!data.empty()) {
+      const auto sent = send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+        continue;
+      if (sent <= 0)
+        throw std::runtime_error(fmt::format("send failed: {}", std::strerror(errno)));
+      data = data.subspan(static_cast<size_t>(sent));
+    }
+  }
+
+  void Receive(std::span<std::byte> data) const {
+    while (!data.empty()) {
+      const auto received = recv(m_fd, data.data(), data.size(), 0);
+      if (received < 0 && errno == EINTR)
+        continue;
+      if (received == 0)
+        throw std::runtime_error("connection closed");
+      if (received < 0)
+        throw std::runtime_error(errno == EAGAIN || errno == EWOULDBLOCK
+                                     ? std::string{"timed out"}
+                                     : fmt::format("receive failed: {}", std::strerror(errno)));
+      data = data.subspan(static_cast<size_t>(received));
+    }
+  }
+};
+
+// Calls `attempt(family, address, length)` for each address `address` resolves to, until one returns a socket
+template <typename F> Socket ForEachAddress(const std::string &address, const bool passive, F &&attempt) {
+  if (address.starts_with("unix:")) {
+    sockaddr_un local{};
+    local.sun_family = AF_UNIX;
+    const auto path = address.substr(5);
+    if (path.empty() || path.size() >= sizeof(local.sun_path))
+      throw std::runtime_error(fmt::format("Invalid socket path '{}'", path));
+    std::copy(begin(path), end(path), local.sun_path);
+    if (passive)
+      unlink(local.sun_path);
+    if (auto socket = attempt(AF_UNIX, reinterpret_cast<const sockaddr *>(&local), sizeof(local)); socket.Fd() >= 0)
+      return socket;
+    throw std::runtime_error(fmt::format("Can't use {}: {}", address, std::strerror(errno)));
+  }
+
+  const auto hostPort = address.starts_with("tcp:") ? address.substr(4) : address;
+  const auto colon = hostPort.rfind(':');
+  if (colon == std::string::npos)
+    throw std::runtime_error(fmt::format("Address '{}' has no port", address));
+  const auto host = hostPort.substr(0, colon);
+  const auto port = hostPort.substr(colon + 1);
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo *found = nullptr;
+  if (const int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found); error != 0)
+    throw std::runtime_error(fmt::format("Can't resolve {}: {}", address, gai_strerror(error)));
+
+  Socket result;
+  for (const addrinfo *info = found; info && result.Fd() < 0; info = info->ai_next) {
+    result = attempt(info->ai_family, info->ai_addr, info->ai_addrlen);
+  }
+  freeaddrinfo(found);
+  if (result.Fd() < 0)
+    throw std::runtime_error(fmt::format("Can't use {}: {}", address, std::strerror(errno)));
+  return result;
+}
+
+Socket Listen(const std::string &address) {
+  return ForEachAddress(address, true, [](const int family, const sockaddr *addr, const socklen_t length) {
+    Socket socket{::socket(family, SOCK_STREAM, 0)};
+    if (socket.Fd() < 0)
+      return Socket{};
+    const int yes = 1;
+    setsockopt(socket.Fd(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(socket.Fd(), addr, length) != 0 || listen(socket.Fd(), 64) != 0)
+      return Socket{};
+    return socket;
+  });
+}
+
+Socket Connect(const std::string &address) {
+  return ForEachAddress(address, false, [](const int family, const sockaddr *addr, const socklen_t length) {
+    Socket socket{::socket(family, SOCK_STREAM, 0)};
+    if (socket.Fd() < 0 || connect(socket.Fd(), addr, length) != 0)
+      return Socket{};
+    if (family != AF_UNIX) {
+      // leases and results are sent as soon as they are ready
+      const int yes = 1;
+      setsockopt(socket.Fd(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    }
+    return socket;
+  });
+}
+
+std::shared_ptr<spdlog::logger> Logger() {
+  static const auto logger = spdlog::stdout_color_mt("Distributed");
+  return logger;
+}
+
+// ------------------------------------------------------------------ coordinator
+class Coordinator {
+public:
+  Coordinator(const Animation &animation, const Options &options);
+  void Run();
+
+private:
+  struct Lease {
+    uint32_t id;
+    unsigned int frame;
+    glm::uvec2 minCoo;
+    glm::uvec2 maxCoo;
+    unsigned int samples;
+  };
+  // sums of the leases merged so far
+  struct Frame {
+    std::vector<color> sums;
+    size_t leasesLeft;
+  };
+
+  const Animation &m_animation;
+  const Options &m_options;
+  std::shared_ptr<spdlog::logger> m_logger{Logger()};
+  std::vector<std::byte> m_job; // payload of the job message, the same for every worker
+
+  // lease ids enumerate frames, then tiles, then sample ranges: a lease is rebuilt from its id
+  std::vector<std::pair<glm::uvec2, glm::uvec2>> m_tiles;
+  uint32_t m_rangesPerTile;
+  uint32_t m_leasesPerFrame;
+  uint32_t m_leaseCount;
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  uint32_t m_nextLease{0};
+  std::deque<Lease> m_lost; // handed out again before any new lease
+  std::vector<bool> m_merged;
+  std::map<unsigned int, Frame> m_frames;
+  unsigned int m_framesLeft;
+  std::exception_ptr m_failure; // a frame could not be written, no more leases are handed out
+
+  [[nodiscard]] Lease MakeLease(uint32_t id) const;
+  // next lease to hand out, waits for one to be lost or for the end when `wait`
+  std::optional<Lease> Take(bool wait);
+  void Return(const std::deque<Lease> &leases);
+  void Merge(const Lease &lease, std::span<const color> sums);
+  void Serve(Socket connection);
+};
+
+Coordinator::Coordinator(const Animation &animation, const Options &options)
+    : m_animation{animation}, m_options{options} {
+  const auto size = animation.imageSize;
+  for (unsigned int y = 0; y < size.y; y += options.tileSize) {
+    for (unsigned int x = 0; x < size.x; x += options.tileSize) {
+      m_tiles.emplace_back(glm::uvec2{x, y}, glm::min(glm::uvec2{x, y} + options.tileSize, size));
+    }
+  }
+  m_rangesPerTile = (animation.samplesPerPixel + options.samplesPerLease - 1) / options.samplesPerLease;
+  m_leasesPerFrame = static_cast<uint32_t>(m_tiles.size()) * m_rangesPerTile;
+  m_framesLeft = animation.lastFrame - animation.firstFrame + 1;
+  m_leaseCount = m_leasesPerFrame * m_framesLeft;
+  m_merged.resize(m_leaseCount);
+
+  // the scene goes along with the job: a file is sent whole, a built-in scene by name
+  JobRecord job{size.x, size.y, animation.maxRayDepth, 0, {}};
+  std::unique_ptr<SceneFile::MappedFile> sceneFile;
+  if (!magic_enum::enum_cast<Renderer::Scenes>(animation.scene)) {
+    sceneFile = std::make_unique<SceneFile::MappedFile>(animation.scene);
+    job.sceneBytes = static_cast<uint32_t>(sceneFile->Size());
+  } else if (animation.scene.size() < sizeof(job.scene)) {
+    std::copy(begin(animation.scene), end(animation.scene), job.scene);
+  }
+  const auto record = AsBytes(job);
+  m_job.assign(begin(record), end(record));
+  if (sceneFile) {
+    m_job.insert(end(m_job), sceneFile->Data(), sceneFile->Data() + sceneFile->Size());
+  }
+}
+
+Coordinator::Lease Coordinator::MakeLease(const uint32_t id) const {
+  const auto frame = id / m_leasesPerFrame;
+  const auto tile = (id % m_leasesPerFrame) / m_rangesPerTile;
+  const auto range = id % m_rangesPerTile;
+  const auto firstSample = range * m_options.samplesPerLease;
+  return {id, m_animation.firstFrame + frame, m_tiles[tile].first, m_tiles[tile].second,
+          std::min(m_options.samplesPerLease, m_animation.samplesPerPixel - firstSample)};
+}
+
+std::optional<Coordinator::Lease> Coordinator::Take(const bool wait) {
+  std::unique_lock lock{m_mutex};
+  if (wait) {
+    m_changed.wait(lock, [this] {
+      return !m_lost.empty() || m_nextLease < m_leaseCount || m_framesLeft == 0 || m_failure;
+    });
+  }
+  if (m_failure) {
+    return std::nullopt;
+  }
+  if (!m_lost.empty()) {
+    const auto lease = m_lost.front();
+    m_lost.pop_front();
+    return lease;
+  }
+  if (m_nextLease < m_leaseCount) {
+    return MakeLease(m_nextLease++);
+  }
+  return std::nullopt;
+}
+
+void Coordinator::Return(const std::deque<Lease> &leases) {
+  {
+    const std::lock_guard lock{m_mutex};
+    m_lost.insert(end(m_lost), begin(leases), end(leases));
+  }
+  m_changed.notify_all();
+}
+
+void Coordinator::Merge(const Lease &lease, const std::span<const color> sums) {
+  std::optional<std::pair<unsigned int, Frame>> finished;
+  {
+    const std::lock_guard lock{m_mutex};
+    // a lease that was given up on may still come back from its first worker
+    if (m_merged[lease.id])
+      return;
+    m_merged[lease.id] = true;
+
+    const auto size = m_animation.imageSize;
+    auto [it, inserted] = m_frames.try_emplace(lease.frame);
+    auto &frame = it->second;
+    if (inserted) {
+      frame.sums.assign(static_cast<size_t>(size.x) * size.y, color{0, 0, 0});
+      frame.leasesLeft = m_leasesPerFrame;
+    }
+
+    const unsigned int width = lease.maxCoo.x - lease.minCoo.x;
+    for (unsigned int y = lease.minCoo.y; y < lease.maxCoo.y; ++y) {
+      for (unsigned int x = lease.minCoo.x; x < lease.maxCoo.x; ++x) {
+        frame.sums[x + static_cast<size_t>(y) * size.x] += sums[(x - lease.minCoo.x) + (y - lease.minCoo.y) * width];
+      }
+    }
+    if (--frame.leasesLeft == 0) {
+      finished.emplace(it->first, std::move(frame));
+      m_frames.erase(it);
+    }
+  }
+
+  if (finished) {
+    const auto size = m_animation.imageSize;
+    std::vector<uint8_t> rgba(finished->second.sums.size() * 4);
+    for (size_t pixel = 0; pixel < finished->second.sums.size(); ++pixel) {
+      Renderer::ResolvePixel(finished->second.sums[pixel], m_animation.samplesPerPixel, &rgba[pixel * 4]);
+    }
+    // not the worker's fault: the batch ends, Run() rethrows it
+    try {
+      m_animation.WriteFrame(finished->first, rgba.data(), size);
+      m_logger->info("Frame {} written", finished->first);
+      const std::lock_guard lock{m_mutex};
+      --m_framesLeft;
+    } catch (const std::exception &error) {
+      m_logger->error("Cannot write frame {}: {}", finished->first, error.what());
+      const std::lock_guard lock{m_mutex};
+      if (!m_failure)
+        m_failure = std::current_exception();
+    }
+    m_changed.notify_all();
+  }
+}
+
+void Coordinator::Serve(Socket connection) {
+  std::deque<Lease> inFlight;
+  try {
+    connection.SetReceiveTimeout(m_options.leaseTimeout);
+    connection.SendMessage(MessageType::Job, m_job);
+
+    std::vector<std::byte> payload;
+    std::vector<color> sums;
+    while (true) {
+      while (inFlight.size() < m_options.leasesPerWorker) {
+        const auto lease = Take(inFlight.empty());
+        if (!lease)
+          break;
+        LeaseRecord record{lease->id, lease->frame, {lease->minCoo.x, lease->minCoo.y},
+                           {lease->maxCoo.x, lease->maxCoo.y}, lease->samples, 0.0f, {}, {}};
+        const auto camera = m_animation.At(static_cast<float>(lease->frame));
+        record.aperture = camera.aperture;
+        std::copy_n(&camera.lookfrom.x, 3, record.lookfrom);
+        std::copy_n(&camera.lookat.x, 3, record.lookat);
+        connection.SendMessage(MessageType::Lease, AsBytes(record));
+        inFlight.push_back(*lease);
+      }
+      if (inFlight.empty())
+        break;
+
+      const auto header = connection.ReceiveMessage(payload);
+      LeaseRecord record;
+      if (header.type != MessageType::Result || payload.size() < sizeof(record))
+        throw std::runtime_error("unexpected message");
+      std::memcpy(&record, payload.data(), sizeof(record));
+      const auto lease = std::find_if(begin(inFlight), end(inFlight),
+                                      [&record](const Lease &held) { return held.id == record.id; });
+      if (lease == end(inFlight))
+        throw std::runtime_error(fmt::format("result of lease {}, which it does not hold", record.id));
+
+      const glm::uvec2 extent = lease->maxCoo - lease->minCoo;
+      sums.resize(static_cast<size_t>(extent.x) * extent.y);
+      if (payload.size() != sizeof(record) + sums.size() * sizeof(color))
+        throw std::runtime_error(fmt::format("result of lease {} has the wrong size", record.id));
+      std::memcpy(sums.data(), payload.data() + sizeof(record), sums.size() * sizeof(color));
+
+      Merge(*lease, sums);
+      inFlight.erase(lease);
+    }
+    connection.SendMessage(MessageType::Done, {});
+  } catch (const std::exception &error) {
+    m_logger->warn("Worker lost ({}), {} leases handed out again", error.what(), inFlight.size());
+    Return(inFlight);
+  }
+}
+
+void Coordinator::Run() {
+  const Socket listener = Listen(m_options.address);
+  m_logger->info("Waiting for workers on {}, {} leases of up to {} samples", m_options.address, m_leaseCount,
+                 m_options.samplesPerLease);
+
+  std::vector<std::thread> servers;
+  const auto done = [this] {
+    const std::lock_guard lock{m_mutex};
+    return m_framesLeft == 0 || m_failure;
+  };
+  while (!done()) {
+    pollfd listening{listener.Fd(), POLLIN, 0};
+    if (poll(&listening, 1, 200) > 0) {
+      if (const int fd = accept(listener.Fd(), nullptr, nullptr); fd >= 0) {
+        const int yes = 1; // fails on local sockets, which don't need it
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        servers.emplace_back(&Coordinator::Serve, this, Socket{fd});
+      }
+    }
+  }
+  for (auto &server : servers) {
+    server.join();
+  }
+  if (m_failure) {
+    std::rethrow_exception(m_failure);
+  }
+}
+
+// removed when the worker is done
+struct TemporaryFile {
+  std::filesystem::path path;
+  ~TemporaryFile() {
+    std::error_code ignored;
+    if (!path.empty())
+      std::filesystem::remove(path, ignored);
+  }
+};
+} // namespace
+
+void Coordinate(const Animation &animation, const Options &options) {
+  if (options.tileSize == 0 || options.samplesPerLease == 0 || options.leasesPerWorker == 0)
+    throw std::runtime_error("Distributed: tiles, leases and samples per lease can't be empty");
+  std::filesystem::create_directories(animation.outputDirectory);
+  Coordinator{animation, options}.Run();
+}
+
+void Work(const std::string &address, const std::size_t threadCount, const Utils::Affinity affinity) {
+  const auto logger = Logger();
+
+  // the coordinator may not be listening yet
+  Socket connection;
+  for (int attempt = 0;; ++attempt) {
+    try {
+      connection = Connect(address);
+      break;
+    } catch (const std::exception &error) {
+      if (attempt == 150)
+        throw;
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+  }
+
+  std::vector<std::byte> payload;
+  JobRecord job;
+  if (connection.ReceiveMessage(payload).type != MessageType::Job || payload.size() < sizeof(job))
+    throw std::runtime_error("Distributed: expected a job from the coordinator");
+  std::memcpy(&job, payload.data(), sizeof(job));
+  if (payload.size() != sizeof(job) + job.sceneBytes)
+    throw std::runtime_error("Distributed: the job has the wrong size");
+
+  Renderer renderer{threadCount, affinity};
+  TemporaryFile sceneFile;
+  if (job.sceneBytes > 0) {
+    sceneFile.path = std::filesystem::temp_directory_path() / fmt::format("rtiaw-worker-{}.rtsb", getpid());
+    SceneFile::Write(sceneFile.path.string(), std::span{payload}.subspan(sizeof(job)));
+    renderer.SetScene(Renderer::Scenes::FromFile);
+    renderer.SetSceneFile(sceneFile.path.string());
+  } else {
+    const std::string name{job.scene, strnlen(job.scene, sizeof(job.scene))};
+    const auto scene = magic_enum::enum_cast<Renderer::Scenes>(name);
+    if (!scene)
+      throw std::runtime_error(fmt::format("Distributed: unknown scene '{}'", name));
+    renderer.SetScene(*scene);
+  }
+  renderer.SetImageSize(job.width, job.height);
+  renderer.SetMaxRayBounces(job.maxRayDepth);
+  renderer.UpdateScene();
+  renderer.UpdateModel();
+  renderer.UpdateSettings();
+  logger->info("Rendering {}x{} for {}", job.width, job.height, address);
+
+  size_t leases = 0;
+  while (true) {
+    const auto header = connection.ReceiveMessage(payload);
+    if (header.type == MessageType::Done)
+      break;
+    LeaseRecord record;
+    if (header.type != MessageType::Lease || payload.size() != sizeof(record))
+      throw std::runtime_error("Distributed: unexpected message from the coordinator");
+    std::memcpy(&record, payload.data(), sizeof(record));
+
+    const CameraKey camera{static_cast<float>(record.frame), point3{record.lookfrom[0], record.lookfrom[1], record.lookfrom[2]},
+                           point3{record.lookat[0], record.lookat[1], record.lookat[2]}, record.aperture};
+    const auto sums = renderer
+                          .RenderRegion(camera, glm::uvec2{record.minCoo[0], record.minCoo[1]},
+                                        glm::uvec2{record.maxCoo[0], record.maxCoo[1]}, record.samples)
+                          .get();
+    connection.SendMessage(MessageType::Result, AsBytes(record), std::as_bytes(std::span{sums}));
+    ++leases;
+  }
+  logger->info("Done, {} leases rendered", leases);
+}
+} // namespace RTIAW::Render::Distributed
@@ -0,0 +1,42 @@
+#ifndef RTIAW_distributed
+#define RTIAW_distributed
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Renderer/Animation.h"
+#include "Renderer/Topology.h"
+
+namespace RTIAW::Render::Distributed {
+// Rendering spread over processes, possibly on other machines.
+//
+// A coordinator owns an animation (a still is a one frame animation) and splits its frames into leases: one
+// tile and a range of samples. Workers connect to it, receive the scene once, then render the leases they are
+// handed with a headless Renderer (see Renderer::RenderRegion()) and send back the unresolved radiance sums.
+// The coordinator adds the sums up per frame and writes each frame once all of its leases are in.
+//
+// A worker that disconnects or takes longer than the lease timeout loses its leases, they are handed to the
+// next worker asking for work. Results of a lease are only merged once.
+//
+// Addresses are "host:port" (or "tcp:host:port") for TCP and "unix:/path/to/socket" for a local socket. Both
+// ends are expected to share the byte order.
+struct Options {
+  std::string address{"127.0.0.1:7878"};
+  unsigned int tileSize{64};
+  unsigned int samplesPerLease{16};
+  // leases a worker holds at once, the next one is on its way while it renders
+  unsigned int leasesPerWorker{2};
+  std::chrono::seconds leaseTimeout{120};
+};
+
+// Renders the frames of `animation` on the workers that connect to `options.address`, writing them like a
+// batch render (Animation::FramePath()). Returns once every frame is written, throws when one can't be.
+void Coordinate(const Animation &animation, const Options &options = {});
+
+// Connects to the coordinator at `address` (retrying for a while) and renders leases until it is done
+void Work(const std::string &address, std::size_t threadCount = 0, Utils::Affinity affinity = Utils::Affinity::None);
+} // namespace RTIAW::Render::Distributed
+
+#endif
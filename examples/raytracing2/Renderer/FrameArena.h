@@ -0,0 +1,127 @@
+#ifndef RTIAW_utils_framearena
+#define RTIAW_utils_framearena
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace RTIAW::Utils {
+// ============================================================================ FrameArena
+// FrameArena
+//
+// Bump allocator for objects that live for one frame (or one task). Deallocation is a no-op, everything is
+// released at once by Reset() or by rewinding to a Marker.
+//
+// Memory comes in blocks from the general purpose heap. Running out of the current block adds another one,
+// and the next Reset() merges them into a single block large enough for the whole frame, so once a frame
+// shape has been seen the arena stops allocating and Reset() is O(1).
+// ----------------------------------------------------------------------------
+class FrameArena final : public std::pmr::memory_resource {
+public:
+  struct Marker {
+    std::size_t block;
+    std::size_t offset;
+  };
+
+  explicit FrameArena(const std::size_t initialCapacity = 64 * 1024) { AddBlock(initialCapacity); }
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  // Everything allocated so far is gone, callers have to be done with it (destructors are not run)
+  void Reset() {
+    if (m_blocks.size() > 1) {
+      std::size_t total = 0;
+      for (const auto &block : m_blocks)
+        total += block.size;
+      m_blocks.clear();
+      AddBlock(total);
+    }
+    m_current = 0;
+    m_offset = 0;
+  }
+
+  [[nodiscard]] Marker Mark() const { return {m_current, m_offset}; }
+  // Releases what was allocated after `marker` was taken
+  void Rewind(const Marker marker) {
+    if (marker.block == 0 && marker.offset == 0) {
+      Reset();
+      return;
+    }
+    m_current = marker.block;
+    m_offset = marker.offset;
+  }
+
+  [[nodiscard]] std::size_t Capacity() const {
+    std::size_t total = 0;
+    for (const auto &block : m_blocks)
+      total += block.size;
+    return total;
+  }
+
+  // scratch arena of the calling thread, for allocations that do not outlive a task (see ArenaScope)
+  static FrameArena &ThreadLocal() {
+    thread_local FrameArena arena{};
+    return arena;
+  }
+
+private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    std::size_t size;
+  };
+
+  std::vector<Block> m_blocks;
+  std::size_t m_current{0};
+  std::size_t m_offset{0};
+
+  void AddBlock(const std::size_t size) { m_blocks.push_back({std::make_unique<std::byte[]>(size), size}); }
+
+  void *do_allocate(const std::size_t bytes, const std::size_t alignment) override {
+    while (true) {
+      Block &block = m_blocks[m_current];
+      const auto base = reinterpret_cast<std::uintptr_t>(block.data.get());
+      const std::size_t aligned = ((base + m_offset + alignment - 1) & ~(alignment - 1)) - base;
+      if (aligned + bytes <= block.size) {
+        m_offset = aligned + bytes;
+        return block.data.get() + aligned;
+      }
+
+      // blocks past the current one are left over from before a Rewind(), reuse them before growing
+      if (m_current + 1 == m_blocks.size())
+        AddBlock(std::max(2 * block.size, bytes + alignment));
+      ++m_current;
+      m_offset = 0;
+    }
+  }
+
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+  [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+// ============================================================================ ArenaScope
+// ArenaScope
+//
+// Releases the allocations made in an arena during the lifetime of the scope
+// ----------------------------------------------------------------------------
+class ArenaScope {
+public:
+  explicit ArenaScope(FrameArena &arena) : m_arena{arena}, m_marker{arena.Mark()} {}
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+  ~ArenaScope() { m_arena.Rewind(m_marker); }
+
+private:
+  FrameArena &m_arena;
+  FrameArena::Marker m_marker;
+};
+} // namespace RTIAW::Utils
+
+#endif
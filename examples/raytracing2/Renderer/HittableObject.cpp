@@ -30,4 +30,8 @@ std::optional<HitRecord> HittableObject::Hit(const Ray &r, float t_min, float t_
       },
       m_shape);
 }
+
+AABB HittableObject::BoundingBox() const {
+  return std::visit(overloaded{[](const auto &shape) { return shape.BoundingBox(); }}, m_shape);
+}
 } // namespace RTIAW::Render
@@ -12,6 +12,12 @@
 namespace RTIAW::Render {
 using HitResult =
     std::pair<std::optional<HitRecord>, std::optional<ScatteringRecord>>;
+
+// closest intersection without any shading done on it
+struct SurfaceHit {
+  HitRecord record;
+  size_t materialIndex;
+};
 class HittableObject {
 
  public:
@@ -24,8 +30,9 @@ class HittableObject {
   [[nodiscard]] HitRecord ComputeHitRecord(const Ray &r, float t) const;
   [[nodiscard]] std::optional<HitRecord> Hit(const Ray &r, float t_min,
                                              float t_max) const;
+  [[nodiscard]] AABB BoundingBox() const;
 
-  Shape GetShape() { return m_shape; };
+  [[nodiscard]] const Shape &GetShape() const { return m_shape; };
 
   size_t getMaterialIndex() { return m_materialIndex; };
 
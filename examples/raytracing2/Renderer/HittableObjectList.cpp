@@ -1,7 +1,13 @@
 #include <algorithm>
+#include <iterator>
 #include <numeric>
+#include <stdexcept>
+
+#include <fmt/format.h>
 
 #include "Renderer/HittableObjectList.h"
+#include "Renderer/Stats.h"
+#include "Renderer/ThreadPool.h"
 
 template <class... Ts> struct overloaded : Ts... {
   using Ts::operator()...;
@@ -10,41 +16,299 @@ template <class... Ts> struct overloaded : Ts... {
 template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
 namespace RTIAW::Render {
-void HittableObjectList::Add(const Shape &shape, const Material &material) {
-  size_t materialIndex = std::numeric_limits<size_t>::max();
+void HittableObjectList::Clear() {
+  m_objects.clear();
+  materials.clear();
+  m_bvh.Clear();
+  m_bvh4.Clear();
+  m_bvh8.Clear();
+  m_boundedCount = 0;
+  m_prototypes.clear();
+  m_instances.clear();
+  m_instanceSlots.clear();
+  m_instanceBVH.Clear();
+}
 
+size_t HittableObjectList::MaterialIndex(const Material &material) {
   if (const auto materialIt = std::find(begin(materials), end(materials), material); materialIt == end(materials)) {
     materials.push_back(material);
-    materialIndex = materials.size() - 1;
+    return materials.size() - 1;
   } else {
-    materialIndex = std::distance(begin(materials), materialIt);
+    return std::distance(begin(materials), materialIt);
+  }
+}
+
+void HittableObjectList::Add(const Shape &shape, const Material &material) {
+  m_objects.emplace_back(shape, MaterialIndex(material));
+
+  m_bvh.Clear();
+  m_bvh4.Clear();
+  m_bvh8.Clear();
+  m_boundedCount = 0;
+}
+
+uint32_t HittableObjectList::AddPrototype(const HittableObjectList &geometry) {
+  Prototype prototype;
+  prototype.objects.reserve(geometry.m_objects.size());
+  for (const auto &object : geometry.m_objects) {
+    const auto bounds = object.BoundingBox();
+    if (!bounds.IsFinite())
+      throw std::runtime_error("Prototypes can't contain unbounded shapes");
+    prototype.bounds.Expand(bounds);
+    prototype.objects.emplace_back(object.GetShape(), MaterialIndex(geometry.materials[object.MaterialIndex()]));
   }
+  BuildHierarchy(prototype.objects, prototype.bvh, m_builder);
+
+  m_prototypes.push_back(std::move(prototype));
+  return static_cast<uint32_t>(m_prototypes.size() - 1);
+}
+
+uint32_t HittableObjectList::AddInstance(const uint32_t prototype, const glm::mat4 &objectToWorld,
+                                         const std::optional<Material> &material) {
+  if (prototype >= m_prototypes.size())
+    throw std::runtime_error(fmt::format("Invalid prototype {}, there are {}", prototype, m_prototypes.size()));
+
+  m_instanceSlots.push_back(static_cast<uint32_t>(m_instances.size()));
+  m_instances.push_back({objectToWorld, glm::inverse(objectToWorld), prototype,
+                         material ? static_cast<uint32_t>(MaterialIndex(*material)) : Instance::ownMaterials});
+  m_instanceBVH.Clear();
+  return static_cast<uint32_t>(m_instanceSlots.size() - 1);
+}
+
+void HittableObjectList::SetInstanceTransform(const uint32_t instance, const glm::mat4 &objectToWorld) {
+  if (instance >= m_instanceSlots.size())
+    throw std::runtime_error(fmt::format("Invalid instance {}, there are {}", instance, m_instanceSlots.size()));
+
+  auto &placed = m_instances[m_instanceSlots[instance]];
+  placed.objectToWorld = objectToWorld;
+  placed.worldToObject = glm::inverse(objectToWorld);
+  if (m_instanceBVH.Empty())
+    return;
+
+  std::vector<AABB> bounds(m_instances.size());
+  std::transform(begin(m_instances), end(m_instances), begin(bounds),
+                 [this](const Instance &instance) { return instance.WorldBounds(m_prototypes[instance.prototype].bounds); });
+  m_instanceBVH.Refit(bounds);
+}
+
+void HittableObjectList::Assign(std::vector<HittableObject> objects, std::vector<Material> materials,
+                                std::vector<BVH::Node> nodes, const size_t boundedCount) {
+  // checked before anything is taken over, the wide layouts are collapsed by walking the nodes
+  if (boundedCount > objects.size())
+    throw std::runtime_error(
+        fmt::format("Invalid hierarchy: {} bounded objects, there are {}", boundedCount, objects.size()));
+  if (!BVH::IsValid(nodes, boundedCount))
+    throw std::runtime_error("Invalid hierarchy: children have to follow their parent, within the maximum depth");
+  m_objects = std::move(objects);
+  this->materials = std::move(materials);
+  m_bvh.Adopt(std::move(nodes));
+  m_boundedCount = m_bvh.Empty() ? 0 : boundedCount;
+  ApplyLayout();
+}
+
+void HittableObjectList::Build(Utils::Pool *pool) {
+  m_boundedCount = BuildHierarchy(m_objects, m_bvh, m_builder, pool);
+  ApplyLayout();
+
+  // top level, over the world bounds of the instances
+  std::vector<AABB> bounds(m_instances.size());
+  std::transform(begin(m_instances), end(m_instances), begin(bounds),
+                 [this](const Instance &instance) { return instance.WorldBounds(m_prototypes[instance.prototype].bounds); });
+
+  std::vector<uint32_t> order;
+  m_instanceBVH.Build(bounds, order, m_builder);
+
+  std::vector<Instance> sorted;
+  sorted.reserve(m_instances.size());
+  std::transform(begin(order), end(order), std::back_inserter(sorted), [this](uint32_t i) { return m_instances[i]; });
+  m_instances = std::move(sorted);
+
+  // the handles follow their instance
+  std::vector<uint32_t> positions(order.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    positions[order[i]] = static_cast<uint32_t>(i);
+  for (auto &slot : m_instanceSlots)
+    slot = positions[slot];
+}
+
+void HittableObjectList::ApplyLayout() {
+  m_bvh4.Clear();
+  m_bvh8.Clear();
+  if (m_layout == BVHLayout::Binary || m_bvh.Empty())
+    return;
+
+  // the leaves index the objects in hierarchy order
+  std::vector<AABB> bounds(m_boundedCount);
+  std::transform(begin(m_objects), begin(m_objects) + m_boundedCount, begin(bounds),
+                 [](const auto &object) { return object.BoundingBox(); });
+  if (m_layout == BVHLayout::Wide4)
+    m_bvh4.Build(m_bvh, bounds);
+  else
+    m_bvh8.Build(m_bvh, bounds);
+  m_bvh.Clear();
+}
+
+size_t HittableObjectList::HierarchyBytes() const {
+  return m_bvh.Nodes().size() * sizeof(BVH::Node) + m_bvh4.Bytes() + m_bvh8.Bytes();
+}
 
-  m_objects.emplace_back(shape, materialIndex);
+size_t HittableObjectList::BuildHierarchy(std::vector<HittableObject> &objects, BVH &bvh, const BVHBuilder builder,
+                                          Utils::Pool *pool) {
+  // Unbounded shapes (i.e. planes) can't be put in the hierarchy, keep them at the back
+  const auto boundedEnd = std::stable_partition(begin(objects), end(objects),
+                                                [](const auto &object) { return object.BoundingBox().IsFinite(); });
+  const auto boundedCount = static_cast<size_t>(std::distance(begin(objects), boundedEnd));
+
+  std::vector<AABB> bounds(boundedCount);
+  const auto computeBounds = [&](const size_t first, const size_t last) {
+    for (size_t i = first; i < last; ++i)
+      bounds[i] = objects[i].BoundingBox();
+  };
+  if (pool != nullptr)
+    pool->ParallelFor(0, boundedCount, 16 * 1024, computeBounds);
+  else
+    computeBounds(0, boundedCount);
+
+  std::vector<uint32_t> order;
+  bvh.Build(bounds, order, builder, pool);
+
+  std::vector<HittableObject> sorted;
+  sorted.reserve(objects.size());
+  std::transform(begin(order), end(order), std::back_inserter(sorted), [&objects](uint32_t i) { return objects[i]; });
+  std::copy(boundedEnd, end(objects), std::back_inserter(sorted));
+  objects = std::move(sorted);
+  return boundedCount;
 }
 
 HitResult HittableObjectList::Hit(const Ray &r, float t_min, float t_max) const {
   static constexpr HitResult empty_result{};
 
+  if (const auto hit = Intersect(r, t_min, t_max); hit) {
+    const auto &[hitr, materialIndex] = hit.value();
+    ++Stats::Local().scatterCalls[materials[materialIndex].index()];
+    return {hitr, std::visit(
+                      overloaded{
+                          [&](const auto &material) { return material.Scatter(r, hitr); },
+                      },
+                      materials[materialIndex])};
+  }
+
+  return empty_result;
+}
+
+std::optional<SurfaceHit> HittableObjectList::Intersect(const Ray &r, float t_min, float t_max) const {
   float closest_t = t_max;
   const HittableObject *closest_obj = nullptr;
+  const Instance *closest_instance = nullptr; // set when closest_obj belongs to a prototype
+  auto &tests = Stats::Local().intersectionTests;
+
+  const auto intersectRange = [&](const size_t first, const size_t count, float &closest) {
+    for (size_t i = first; i < first + count; ++i) {
+      ++tests[m_objects[i].GetShape().index()];
+      if (const float temp_t = m_objects[i].FastHit(r, t_min, closest); temp_t < std::numeric_limits<float>::max()) {
+        closest_obj = &m_objects[i];
+        closest_instance = nullptr;
+        closest = temp_t;
+      }
+    }
+  };
+
+  // the prototype is traversed in object space, where distances along the ray are scaled by distanceScale
+  const auto intersectInstances = [&](const size_t first, const size_t count, float &closest) {
+    for (size_t i = first; i < first + count; ++i) {
+      const auto &instance = m_instances[i];
+      const auto &prototype = m_prototypes[instance.prototype];
+      float distanceScale;
+      const Ray objectRay = instance.ToObject(r, distanceScale);
+      float objectClosest = closest * distanceScale;
 
-  for (const auto &object : m_objects) {
-    if (const float temp_t = object.FastHit(r, t_min, closest_t); temp_t < std::numeric_limits<float>::max()) {
-      closest_obj = &object;
-      closest_t = temp_t;
+      prototype.bvh.Traverse(objectRay, t_min * distanceScale, objectClosest,
+                             [&](const size_t leafFirst, const size_t leafCount, float &leafClosest) {
+                               for (size_t j = leafFirst; j < leafFirst + leafCount; ++j) {
+                                 const auto &object = prototype.objects[j];
+                                 ++tests[object.GetShape().index()];
+                                 if (const float temp_t = object.FastHit(objectRay, t_min * distanceScale, leafClosest);
+                                     temp_t < std::numeric_limits<float>::max()) {
+                                   closest_obj = &object;
+                                   closest_instance = &instance;
+                                   leafClosest = temp_t;
+                                 }
+                               }
+                             });
+      if (closest_instance == &instance) {
+        closest = objectClosest / distanceScale;
+      }
     }
+  };
+
+  if (!HasHierarchy()) {
+    intersectRange(0, m_objects.size(), closest_t);
+  } else {
+    VisitHierarchy([&](const auto &bvh) { bvh.Traverse(r, t_min, closest_t, intersectRange); });
+    intersectRange(m_boundedCount, m_objects.size() - m_boundedCount, closest_t);
   }
 
-  if (!closest_obj) {
-    return empty_result;
+  if (m_instanceBVH.Empty()) {
+    intersectInstances(0, m_instances.size(), closest_t);
   } else {
-    const auto hitr = closest_obj->ComputeHitRecord(r, closest_t);
-    return {hitr, std::visit(
-                      overloaded{
-                          [&](const auto &material) { return material.Scatter(r, hitr); },
-                      },
-                      materials[closest_obj->MaterialIndex()])};
+    m_instanceBVH.Traverse(r, t_min, closest_t, intersectInstances);
+  }
+
+  if (!closest_obj) {
+    return std::nullopt;
   }
+  if (closest_instance) {
+    const auto material = closest_instance->material == Instance::ownMaterials ? closest_obj->MaterialIndex()
+                                                                                 : closest_instance->material;
+    return SurfaceHit{closest_instance->ToWorld(*closest_obj, r, closest_t), material};
+  }
+  return SurfaceHit{closest_obj->ComputeHitRecord(r, closest_t), closest_obj->MaterialIndex()};
+}
+
+bool HittableObjectList::Occluded(const Ray &r, float t_min, float t_max) const {
+  auto &tests = Stats::Local().intersectionTests;
+
+  const auto anyInRange = [&](const size_t first, const size_t count) {
+    for (size_t i = first; i < first + count; ++i) {
+      ++tests[m_objects[i].GetShape().index()];
+      if (m_objects[i].FastHit(r, t_min, t_max) < std::numeric_limits<float>::max()) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const auto anyInstance = [&](const size_t first, const size_t count) {
+    for (size_t i = first; i < first + count; ++i) {
+      const auto &prototype = m_prototypes[m_instances[i].prototype];
+      float distanceScale;
+      const Ray objectRay = m_instances[i].ToObject(r, distanceScale);
+      const bool occluded = prototype.bvh.TraverseAny(
+          objectRay, t_min * distanceScale, t_max * distanceScale, [&](const size_t leafFirst, const size_t leafCount) {
+            for (size_t j = leafFirst; j < leafFirst + leafCount; ++j) {
+              ++tests[prototype.objects[j].GetShape().index()];
+              if (prototype.objects[j].FastHit(objectRay, t_min * distanceScale, t_max * distanceScale) <
+                  std::numeric_limits<float>::max()) {
+                return true;
+              }
+            }
+            return false;
+          });
+      if (occluded) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const bool objectsOccluded =
+      !HasHierarchy() ? anyInRange(0, m_objects.size())
+                      // the unbounded objects are few and large, the most likely to end the query early
+                      : anyInRange(m_boundedCount, m_objects.size() - m_boundedCount) ||
+                            VisitHierarchy([&](const auto &bvh) {
+                              return bvh.TraverseAny(r, t_min, t_max, anyInRange);
+                            });
+  return objectsOccluded || (m_instanceBVH.Empty() ? anyInstance(0, m_instances.size())
+                                                   : m_instanceBVH.TraverseAny(r, t_min, t_max, anyInstance));
 }
 } // namespace RTIAW::Render
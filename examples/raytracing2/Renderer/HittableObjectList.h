@@ -2,17 +2,46 @@
 #define RTIAW_hittableobjectlist
 
 #include <memory>
+#include <optional>
 #include <vector>
 
+#include <glm/mat4x4.hpp>
+
+#include "Renderer/BVH.h"
 #include "Renderer/HittableObject.h"
+#include "Renderer/Instance.h"
+#include "Renderer/WideBVH.h"
 
 namespace RTIAW::Render {
 class HittableObjectList {
  public:
   HittableObjectList() = default;
 
-  void Clear() { m_objects.clear(); }
+  void Clear();
   void Add(const Shape &shape, const Material &material);
+  // Takes over objects, materials and a hierarchy that already match each other (see Build()). Throws when the
+  // hierarchy is not safe to traverse (see BVH::IsValid()) or `boundedCount` exceeds the objects.
+  void Assign(std::vector<HittableObject> objects, std::vector<Material> materials, std::vector<BVH::Node> nodes,
+              size_t boundedCount);
+
+  // Copies the objects of `geometry` into a new prototype and returns its index for AddInstance(). Their materials
+  // are merged into this list. Prototypes are bounded: throws on unbounded shapes (planes).
+  uint32_t AddPrototype(const HittableObjectList &geometry);
+  // Places `prototype` in the scene, with `material` in place of the prototype's own ones when given. Returns a
+  // handle for SetInstanceTransform(), it stays valid across Build().
+  uint32_t AddInstance(uint32_t prototype, const glm::mat4 &objectToWorld,
+                       const std::optional<Material> &material = {});
+  // Moves an instance, the instance hierarchy is refitted rather than rebuilt
+  void SetInstanceTransform(uint32_t instance, const glm::mat4 &objectToWorld);
+
+  // Builds the acceleration structures, reordering the objects and the instances. Adding objects or instances
+  // afterwards drops them again. The object hierarchy is built on `pool` when given (see BVH::Build()).
+  void Build(Utils::Pool *pool = nullptr);
+  // Split strategy of the hierarchies built from then on
+  void SetBuilder(BVHBuilder builder) { m_builder = builder; };
+  // Node layout of the object hierarchy, applied by the next Build() or Assign(). The wide layouts are collapsed
+  // from the binary hierarchy, which is released afterwards (GetBVH() is then empty).
+  void SetLayout(BVHLayout layout) { m_layout = layout; };
   // void Add(const HittableObject &object) { m_objects.push_back(object); }
   // void Add(HittableObject &&object) { m_objects.push_back(object); }
 
@@ -20,13 +49,58 @@ class HittableObjectList {
   // m_objects.emplace_back(std::forward<Args>(args)...); }
 
   [[nodiscard]] HitResult Hit(const Ray &r, float t_min, float t_max) const;
+  // closest-hit query only, materials are left for the caller to evaluate (see MaterialBuckets)
+  [[nodiscard]] std::optional<SurfaceHit> Intersect(const Ray &r, float t_min, float t_max) const;
+  // visibility query: true if anything lies along the ray in (t_min, t_max), without looking for the closest
+  [[nodiscard]] bool Occluded(const Ray &r, float t_min, float t_max) const;
 
-  std::vector<HittableObject> GetObjects() { return m_objects; };
-  std::vector<Material> GetMaterials() { return materials; };
+  [[nodiscard]] const std::vector<HittableObject> &GetObjects() const { return m_objects; };
+  [[nodiscard]] const std::vector<Material> &GetMaterials() const { return materials; };
+  [[nodiscard]] const BVH &GetBVH() const { return m_bvh; };
+  [[nodiscard]] BVHLayout Layout() const { return m_layout; };
+  // the objects have a hierarchy, whatever its layout
+  [[nodiscard]] bool HasHierarchy() const { return !m_bvh.Empty() || !m_bvh4.Empty() || !m_bvh8.Empty(); };
+  // memory of the object hierarchy nodes
+  [[nodiscard]] size_t HierarchyBytes() const;
+  [[nodiscard]] const std::vector<Prototype> &GetPrototypes() const { return m_prototypes; };
+  [[nodiscard]] const std::vector<Instance> &GetInstances() const { return m_instances; };
+  // objects before this index are in the hierarchy, the unbounded ones after it are tested one by one
+  [[nodiscard]] size_t BoundedCount() const { return m_boundedCount; };
 
  private:
   std::vector<HittableObject> m_objects;
   std::vector<Material> materials;
+
+  BVH m_bvh;
+  BVHBuilder m_builder{BVHBuilder::Median};
+  BVHLayout m_layout{BVHLayout::Binary};
+  WideBVH<4> m_bvh4;
+  WideBVH<8> m_bvh8;
+  size_t m_boundedCount{0};
+
+  // two-level structure: a BVH over the instances, each prototype has its own one
+  std::vector<Prototype> m_prototypes;
+  std::vector<Instance> m_instances;
+  std::vector<uint32_t> m_instanceSlots; // index in m_instances of each handle returned by AddInstance()
+  BVH m_instanceBVH;
+
+  size_t MaterialIndex(const Material &material);
+  // sorts the bounded objects to the front in hierarchy order, returns how many there are
+  static size_t BuildHierarchy(std::vector<HittableObject> &objects, BVH &bvh, BVHBuilder builder,
+                               Utils::Pool *pool = nullptr);
+  // collapses m_bvh into the wide layout, if that is the one in use
+  void ApplyLayout();
+  // calls `visit` with the object hierarchy of the current layout
+  template <typename Visit> decltype(auto) VisitHierarchy(Visit &&visit) const {
+    switch (m_layout) {
+    case BVHLayout::Wide4:
+      return visit(m_bvh4);
+    case BVHLayout::Wide8:
+      return visit(m_bvh8);
+    default:
+      return visit(m_bvh);
+    }
+  }
 };
 }  // namespace RTIAW::Render
 
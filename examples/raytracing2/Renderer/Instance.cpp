@@ -0,0 +1,35 @@
+#include <glm/matrix.hpp>
+
+#include "Renderer/Instance.h"
+
+namespace RTIAW::Render {
+Ray Instance::ToObject(const Ray &r, float &distanceScale) const {
+  const vec3 direction = vec3{worldToObject * glm::vec4{r.direction, 0.0f}};
+  // world rays have a unit direction, object space ones are normalized again by Ray
+  distanceScale = glm::length(direction);
+  return Ray{vec3{worldToObject * glm::vec4{r.origin, 1.0f}}, direction};
+}
+
+HitRecord Instance::ToWorld(const HittableObject &object, const Ray &r, const float t) const {
+  float distanceScale;
+  const Ray objectRay = ToObject(r, distanceScale);
+  HitRecord record = object.ComputeHitRecord(objectRay, t * distanceScale);
+
+  // normals go through the inverse transpose, which keeps their side with respect to the ray
+  record.t = t;
+  record.p = r.At(t);
+  record.normal = glm::normalize(vec3{glm::transpose(worldToObject) * glm::vec4{record.normal, 0.0f}});
+  return record;
+}
+
+AABB Instance::WorldBounds(const AABB &objectBounds) const {
+  AABB result{};
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec4 p{corner & 1 ? objectBounds.max.x : objectBounds.min.x,
+                      corner & 2 ? objectBounds.max.y : objectBounds.min.y,
+                      corner & 4 ? objectBounds.max.z : objectBounds.min.z, 1.0f};
+    result.Expand(vec3{objectToWorld * p});
+  }
+  return result;
+}
+} // namespace RTIAW::Render
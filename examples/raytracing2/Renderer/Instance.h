@@ -0,0 +1,41 @@
+#ifndef RTIAW_instance
+#define RTIAW_instance
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+#include "Renderer/AABB.h"
+#include "Renderer/BVH.h"
+#include "Renderer/HittableObject.h"
+
+namespace RTIAW::Render {
+// Geometry shared by all of its instances: objects in their own (object) space, under their own hierarchy.
+// This is the bottom level of the two-level structure, the top level being a BVH over the instances.
+struct Prototype {
+  std::vector<HittableObject> objects;
+  BVH bvh;
+  AABB bounds;
+};
+
+// One placement of a prototype in the scene
+struct Instance {
+  static constexpr uint32_t ownMaterials = std::numeric_limits<uint32_t>::max();
+
+  glm::mat4 objectToWorld;
+  glm::mat4 worldToObject;
+  uint32_t prototype;
+  uint32_t material; // replaces the materials of the prototype objects, unless ownMaterials
+
+  // ray in object space, with the factor that turns world distances along `r` into object space ones
+  [[nodiscard]] Ray ToObject(const Ray &r, float &distanceScale) const;
+  // hit record of the prototype object at `t` (a world distance along `r`) in world space
+  [[nodiscard]] HitRecord ToWorld(const HittableObject &object, const Ray &r, float t) const;
+  // bounds of the transformed prototype
+  [[nodiscard]] AABB WorldBounds(const AABB &objectBounds) const;
+};
+} // namespace RTIAW::Render
+
+#endif
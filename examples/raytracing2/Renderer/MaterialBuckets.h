@@ -0,0 +1,86 @@
+#ifndef RTIAW_materialbuckets
+#define RTIAW_materialbuckets
+
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Renderer/HittableObject.h"
+#include "Renderer/Stats.h"
+
+namespace RTIAW::Render {
+// Hits of a batch of rays grouped by material type.
+//
+// Instead of dispatching on the Material variant right after each intersection, hits are collected first and
+// each bucket is then shaded in its own loop, where every iteration runs the same Scatter() code.
+class MaterialBuckets {
+public:
+  static constexpr size_t typeCount = std::variant_size_v<Material>;
+
+  struct Entry {
+    uint32_t path; // caller-defined index of the ray that produced the hit
+    uint32_t material;
+    HitRecord record;
+  };
+
+  MaterialBuckets() = default;
+  // buckets allocated from `resource`, e.g. a thread's FrameArena for batches that live in a single task
+  explicit MaterialBuckets(std::pmr::memory_resource *resource)
+      : m_buckets{MakeBuckets(resource, std::make_index_sequence<typeCount>{})} {}
+
+  void Clear() {
+    for (auto &bucket : m_buckets)
+      bucket.clear();
+  }
+
+  void Reserve(size_t size) {
+    for (auto &bucket : m_buckets)
+      bucket.reserve(size);
+  }
+
+  void Push(const std::vector<Material> &materials, const uint32_t path, const SurfaceHit &hit) {
+    m_buckets[materials[hit.materialIndex].index()].push_back(
+        {path, static_cast<uint32_t>(hit.materialIndex), hit.record});
+  }
+
+  [[nodiscard]] size_t Size(size_t type) const { return m_buckets[type].size(); }
+
+  // Calls `onScatter(path, std::optional<ScatteringRecord>)` for every hit, one material type after the other.
+  // `rayOf(path)` returns the incoming ray of a path.
+  template <typename RayOf, typename OnScatter>
+  void Shade(const std::vector<Material> &materials, RayOf &&rayOf, OnScatter &&onScatter) const {
+    ShadeAll(materials, rayOf, onScatter, std::make_index_sequence<typeCount>{});
+  }
+
+private:
+  std::array<std::pmr::vector<Entry>, typeCount> m_buckets{};
+
+  template <size_t... Types>
+  static std::array<std::pmr::vector<Entry>, typeCount> MakeBuckets(std::pmr::memory_resource *resource,
+                                                                    std::index_sequence<Types...>) {
+    return {((void)Types, std::pmr::vector<Entry>{resource})...};
+  }
+
+  template <typename RayOf, typename OnScatter, size_t... Types>
+  void ShadeAll(const std::vector<Material> &materials, RayOf &rayOf, OnScatter &onScatter,
+                std::index_sequence<Types...>) const {
+    (ShadeBucket<Types>(materials, rayOf, onScatter), ...);
+  }
+
+  template <size_t Type, typename RayOf, typename OnScatter>
+  void ShadeBucket(const std::vector<Material> &materials, RayOf &rayOf, OnScatter &onScatter) const {
+    Stats::Local().scatterCalls[Type] += m_buckets[Type].size();
+    for (const auto &[path, material, record] : m_buckets[Type]) {
+      // the bucket guarantees the alternative, no dispatch left in the loop
+      const auto &mat = *std::get_if<Type>(&materials[material]);
+      onScatter(path, mat.Scatter(rayOf(path), record));
+    }
+  }
+};
+} // namespace RTIAW::Render
+
+#endif
@@ -2,10 +2,7 @@
 
 #include "Renderer/HittableObject.h"
 #include "Renderer/Materials/Dielectric.h"
-
-// rng stuff
-static std::mt19937 m_rnGenerator{};
-static std::uniform_real_distribution<float> m_unifDistribution{0.0f, 1.0f};
+#include "Renderer/Utils.h"
 
 namespace RTIAW::Render::Materials {
 std::optional<ScatteringRecord> Dielectric::Scatter(const Ray &r_in, const HitRecord &rec) const {
@@ -16,7 +13,8 @@ std::optional<ScatteringRecord> Dielectric::Scatter(const Ray &r_in, const HitRe
   const float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
 
   if (const bool cannot_refract = refraction_ratio * sin_theta > 1.0f;
-      cannot_refract || Reflectance(cos_theta, refraction_ratio) > m_unifDistribution(m_rnGenerator)) {
+      cannot_refract || Reflectance(cos_theta, refraction_ratio) >
+                                std::uniform_real_distribution<float>{0.0f, 1.0f}(Random::Generator())) {
     return ScatteringRecord{white, Ray{rec.p, glm::reflect(r_in.direction, rec.normal)}};
   } else {
     return ScatteringRecord{white, Ray{rec.p, glm::refract(r_in.direction, rec.normal, refraction_ratio)}};
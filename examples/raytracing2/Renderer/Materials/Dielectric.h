@@ -16,6 +16,8 @@ public:
 
   [[nodiscard]] std::optional<ScatteringRecord> Scatter(const Ray &r_in, const HitRecord &rec) const;
 
+  [[nodiscard]] float RefractionIndex() const { return m_refractionIndex; }
+
 private:
   float m_refractionIndex;
   float m_invRefractionIndex;
@@ -16,6 +16,9 @@ public:
 
   [[nodiscard]] std::optional<ScatteringRecord> Scatter(const Ray &r_in, const HitRecord &rec) const;
 
+  [[nodiscard]] color Albedo() const { return m_albedo; }
+  [[nodiscard]] float Fuzzyness() const { return m_fuzzyness; }
+
 private:
   color m_albedo;
   float m_fuzzyness{1.0f};
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <magic_enum.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "Renderer/Regression.h"
+#include "Renderer/Renderer.h"
+
+namespace RTIAW::Render::Regression {
+namespace {
+constexpr const char *timingsFile = "timings.txt";
+
+std::shared_ptr<spdlog::logger> Logger() {
+  static const auto logger = spdlog::stdout_color_mt("Regression");
+  return logger;
+}
+
+// RGB of an image, rows top first like the PPM files
+struct Image {
+  glm::uvec2 size{0, 0};
+  std::vector<uint8_t> rgb;
+};
+
+// the render buffer holds RGBA rows bottom first
+Image FromRenderBuffer(const uint8_t *rgba, const glm::uvec2 size) {
+  Image image{size, std::vector<uint8_t>(static_cast<size_t>(size.x) * size.y * 3)};
+  auto *out = image.rgb.data();
+  for (unsigned int y = size.y; y > 0; --y) {
+    const uint8_t *pixel = rgba + static_cast<size_t>(y - 1) * size.x * 4;
+    for (unsigned int x = 0; x < size.x; ++x, pixel += 4, out += 3) {
+      std::copy_n(pixel, 3, out);
+    }
+  }
+  return image;
+}
+
+void WritePpm(const std::filesystem::path &path, const Image &image) {
+  std::ofstream out{path, std::ios::binary};
+  out << fmt::format("P6\n{} {}\n255\n", image.size.x, image.size.y);
+  out.write(reinterpret_cast<const char *>(image.rgb.data()), static_cast<std::streamsize>(image.rgb.size()));
+  if (!out)
+    throw std::runtime_error(fmt::format("Regression: can't write {}", path.string()));
+}
+
+// binary PPM with 8 bit channels, as written by WritePpm() (or Animation::WriteFrame())
+std::optional<Image> ReadPpm(const std::filesystem::path &path) {
+  std::ifstream in{path, std::ios::binary};
+  if (!in)
+    return std::nullopt;
+
+  std::string magic;
+  unsigned int maxValue = 0;
+  Image image;
+  in >> magic >> image.size.x >> image.size.y >> maxValue;
+  if (!in || magic != "P6" || maxValue != 255)
+    throw std::runtime_error(fmt::format("Regression: {} is not a binary 8 bit PPM", path.string()));
+  in.get(); // the single whitespace before the data
+
+  image.rgb.resize(static_cast<size_t>(image.size.x) * image.size.y * 3);
+  in.read(reinterpret_cast<char *>(image.rgb.data()), static_cast<std::streamsize>(image.rgb.size()));
+  if (!in)
+    throw std::runtime_error(fmt::format("Regression: {} is truncated", path.string()));
+  return image;
+}
+
+// root mean square of the channel differences, on the 0-255 scale
+float Rmse(const Image &a, const Image &b) {
+  double sum = 0.0;
+  for (size_t i = 0; i < a.rgb.size(); ++i) {
+    const double difference = static_cast<double>(a.rgb[i]) - static_cast<double>(b.rgb[i]);
+    sum += difference * difference;
+  }
+  return static_cast<float>(std::sqrt(sum / static_cast<double>(a.rgb.size())));
+}
+
+// "<scene> <milliseconds>" per line
+std::map<std::string, float> ReadTimings(const std::filesystem::path &path) {
+  std::map<std::string, float> timings;
+  std::ifstream in{path};
+  std::string scene;
+  float milliseconds;
+  while (in >> scene >> milliseconds) {
+    timings[scene] = milliseconds;
+  }
+  return timings;
+}
+
+void WriteTimings(const std::filesystem::path &path, const std::map<std::string, float> &timings) {
+  std::ofstream out{path};
+  for (const auto &[scene, milliseconds] : timings) {
+    out << fmt::format("{} {:.3f}\n", scene, milliseconds);
+  }
+  if (!out)
+    throw std::runtime_error(fmt::format("Regression: can't write {}", path.string()));
+}
+
+// renders one frame with what the renderer was given, returns its render time in ms
+float RenderOnce(Renderer &renderer) {
+  renderer.StartRender();
+  const uint64_t version = renderer.SubmittedVersion();
+  while (renderer.RenderedVersion() < version) {
+    if (renderer.State() == Renderer::RenderState::Stopped)
+      throw std::runtime_error("Regression: the render stopped");
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  return renderer.LastRenderTime();
+}
+} // namespace
+
+std::size_t Run(const Options &options, const std::size_t threadCount, const Utils::Affinity affinity) {
+  const std::filesystem::path directory{options.directory};
+  std::filesystem::create_directories(directory);
+  auto timings = ReadTimings(directory / timingsFile);
+  auto logger = Logger();
+
+  std::size_t failures = 0;
+  for (const auto scene : magic_enum::enum_values<Renderer::Scenes>()) {
+    if (scene == Renderer::Scenes::FromFile)
+      continue;
+    const std::string name{magic_enum::enum_name(scene)};
+
+    // a renderer of its own per scene: the scenes built from random numbers start from the same sequence
+    Renderer renderer{threadCount, affinity};
+    renderer.SetScene(scene);
+    renderer.SetImageSize(options.imageSize.x, options.imageSize.y);
+    renderer.SetSamplesPerPixel(options.samplesPerPixel);
+    renderer.SetMaxRayBounces(options.maxRayDepth);
+    renderer.seed = options.seed;
+
+    float milliseconds = std::numeric_limits<float>::max();
+    for (unsigned int repeat = 0; repeat < std::max(options.repeats, 1u); ++repeat) {
+      milliseconds = std::min(milliseconds, RenderOnce(renderer));
+    }
+    const Image image = FromRenderBuffer(static_cast<const uint8_t *>(renderer.ImageBuffer()), options.imageSize);
+    const auto referencePath = directory / (name + ".ppm");
+
+    if (options.update) {
+      WritePpm(referencePath, image);
+      timings[name] = milliseconds;
+      logger->info("{:<16} {:>9.1f} ms  reference written", name, milliseconds);
+      continue;
+    }
+
+    const auto reference = ReadPpm(referencePath);
+    if (!reference) {
+      logger->error("{:<16} {:>9.1f} ms  no reference image {}", name, milliseconds, referencePath.string());
+      ++failures;
+      continue;
+    }
+    if (reference->size != image.size) {
+      logger->error("{:<16} {:>9.1f} ms  reference is {}x{}, the render {}x{}", name, milliseconds,
+                    reference->size.x, reference->size.y, image.size.x, image.size.y);
+      ++failures;
+      continue;
+    }
+
+    const float rmse = Rmse(image, *reference);
+    const auto recorded = timings.find(name);
+    const float slowdown = recorded != timings.end() ? milliseconds / recorded->second - 1.0f : 0.0f;
+    const bool imageFailed = rmse > options.maxRmse;
+    const bool timeFailed = slowdown > options.maxSlowdown;
+    const auto line = fmt::format("{:<16} {:>9.1f} ms ({:+.1f}%)  rmse {:.3f}", name, milliseconds, 100.0f * slowdown,
+                                  rmse);
+    if (imageFailed || timeFailed) {
+      logger->error("{}  {}{}", line, imageFailed ? "image differs " : "", timeFailed ? "slower" : "");
+      ++failures;
+    } else {
+      logger->info("{}", line);
+    }
+  }
+
+  if (options.update) {
+    WriteTimings(directory / timingsFile, timings);
+  }
+  return failures;
+}
+} // namespace RTIAW::Render::Regression
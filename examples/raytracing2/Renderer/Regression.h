@@ -0,0 +1,37 @@
+#ifndef RTIAW_regression
+#define RTIAW_regression
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Renderer/Topology.h"
+#include "Renderer/Utils.h"
+
+namespace RTIAW::Render::Regression {
+// Golden image check of the built-in scenes.
+//
+// Each scene (but FromFile) is rendered headless with a fixed seed, size and sample count, then compared with
+// its reference image (<SceneName>.ppm in the directory): the run fails when the RMSE of the 8 bit channels is
+// above `maxRmse`. The render time (the best of `repeats` renders) is checked against the one recorded with the
+// references (timings.txt) and fails when it is more than `maxSlowdown` slower. Timings only compare on the
+// machine that recorded them, record them again (`update`) after moving to another one.
+struct Options {
+  std::string directory{"regression"};
+  glm::uvec2 imageSize{400, 225};
+  unsigned int samplesPerPixel{16};
+  unsigned int maxRayDepth{10};
+  uint32_t seed{1};
+  // the same build renders the same image, this leaves room for another compiler or standard library
+  float maxRmse{1.0f};
+  float maxSlowdown{0.15f}; // fraction of the recorded time
+  unsigned int repeats{3};
+  // writes the references and the timings instead of checking against them
+  bool update{false};
+};
+
+// Renders and checks every scene, logging one line each. Returns the number of scenes that failed
+std::size_t Run(const Options &options, std::size_t threadCount = 0, Utils::Affinity affinity = Utils::Affinity::None);
+} // namespace RTIAW::Render::Regression
+
+#endif
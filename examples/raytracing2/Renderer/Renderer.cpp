@@ -1,4 +1,7 @@
+#include <array>
 #include <cstdint>
+#include <filesystem>
+#include <memory_resource>
 #include <optional>
 
 #include "Walnut/Timer.h"
@@ -10,6 +13,7 @@
 
 // #include "Materials/Material.h"
 #include "Renderer/HittableObjectList.h"
+#include "Renderer/MaterialBuckets.h"
 
 #include "stb/stb_image.h"
 #include <numeric>
@@ -18,8 +22,11 @@ const std::string EARTHMAP_PATH = RESOURCE_DIR "/earthmap.jpeg";
 
 #define RENDER_PERQUAD
 
-namespace RTIAW::Render {
+template <class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+// explicit deduction guide (not needed as of C++20)
+template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
+namespace RTIAW::Render {
 static uint32_t ConvertToRGBA(const glm::vec4 &color) {
   auto r = (uint8_t)(color.r * 255.0f);
   auto g = (uint8_t)(color.g * 255.0f);
@@ -39,6 +46,14 @@ static color ConvertColor(color pixel_color) {
   return result;
 }
 
+static color SkyColor(const Ray &ray) {
+  constexpr color white{1.0, 1.0, 1.0};
+  constexpr color azure{0.5, 0.7, 1.0};
+
+  float t = 0.5f * (ray.direction.y + 1.0f);
+  return (1.0f - t) * white + t * azure;
+}
+
 static std::tuple<uint8_t *, int, int> LoadImage(std::string path) {
 
   int width, height, channels;
@@ -48,43 +63,358 @@ static std::tuple<uint8_t *, int, int> LoadImage(std::string path) {
   return result;
 }
 
+Renderer::Renderer(const std::size_t threadCount, const Utils::Affinity affinity)
+    : m_logger{spdlog::stdout_color_st("Renderer")},
+      m_threadPool{threadCount > 0 ? threadCount : Utils::Pool::DefaultThreadCount(), affinity} {
+  // started last, the service uses every other member
+  m_renderingThread = std::thread{&Renderer::Service, this};
+}
+
 Renderer::~Renderer() {
-  switch (m_state) {
-  case RenderState::Finished:
-  case RenderState::Stopped:
-    m_renderingThread.join();
-    break;
-  default:
-    break;
+  Submit(Quit{});
+  m_renderingThread.join();
+  stbi_image_free(std::get<0>(m_earthTexture));
+}
+
+uint64_t Renderer::Submit(Command::Payload payload) {
+  Command command{++m_nextVersion, std::move(payload)};
+  // the service drains the queue before it renders again, a full queue only lasts for a moment
+  while (!m_commands.Push(std::move(command))) {
+    std::this_thread::yield();
+  }
+  m_submitted.store(command.version, std::memory_order_release);
+  m_submitted.notify_one();
+  return command.version;
+}
+
+void Renderer::WaitSettled(const uint64_t version) const {
+  for (auto settled = m_settled.load(); settled < version; settled = m_settled.load()) {
+    m_settled.wait(settled);
   }
 }
 
+uint64_t Renderer::UpdateScene() {
+  return Submit(SceneSettings{m_sceneType, m_sceneFilePath, material_color, bvhLayout, bvhBuilder});
+}
+
+uint64_t Renderer::UpdateModel() { return Submit(ModelSettings{mvp.model}); }
+
+uint64_t Renderer::UpdateCamera() { return Submit(CameraSettings{lookfrom, lookat, aperture}); }
+
+uint64_t Renderer::UpdateSettings() {
+  return Submit(RenderSettings{samplesPerPixel, maxRayDepth, sortHitsByMaterial, wavefront, seed});
+}
+
 void Renderer::SetImageSize(unsigned int x, unsigned int y) {
+  if (m_imageSize == glm::uvec2{x, y} && m_renderBuffer) {
+    return;
+  }
+
+  // the buffer and the quads are replaced from this thread, the service has to be idle meanwhile: nothing else
+  // is submitted until the batch that ends with this Stop is done with
+  WaitSettled(Submit(Stop{}));
+
   m_imageSize = glm::uvec2{x, y};
-  m_renderBuffer.clear();
-  m_renderBuffer.resize(x * y * 4);
+  // left uninitialized, so that no page is touched on this thread
+  m_renderBuffer.reset(new uint8_t[static_cast<size_t>(x) * y * 4]);
+
+  // cleared in the same order and with the same split as the quads (top rows first), a page then lives on the
+  // NUMA node of the workers that will write it
+  const size_t rowSize = static_cast<size_t>(x) * 4;
+  m_threadPool.ParallelFor(0, y, 16, [this, rowSize](const size_t first, const size_t last) {
+    for (size_t row = first; row < last; ++row) {
+      std::fill_n(m_renderBuffer.get() + (m_imageSize.y - 1 - row) * rowSize, rowSize, uint8_t{0});
+    }
+  });
+
+  // sized here, while the service is idle, so that the workers never see them reallocated
+  SplitImage(m_quads);
+  m_tileStats.clear();
+  for (const auto &[minCoo, maxCoo] : m_quads) {
+    m_tileStats.push_back({minCoo, maxCoo, 0.0f, 0});
+  }
+  {
+    const std::lock_guard lock{m_statsMutex};
+    m_lastTileStats.clear();
+  }
+
+  Submit(Resized{});
 }
 
 void Renderer::StartRender() {
-  switch (m_state) {
-  case RenderState::Finished:
-  case RenderState::Stopped:
-    m_renderingThread.join();
-    break;
-  default:
-    break;
+  // unchanged parts are recognized by the service and cost nothing
+  UpdateScene();
+  UpdateModel();
+  UpdateCamera();
+  UpdateSettings();
+  Submit(RenderFrame{});
+}
+
+void Renderer::StopRender() { Submit(Stop{}); }
+
+std::future<std::vector<color>> Renderer::RenderRegion(const CameraKey &camera, const glm::uvec2 minCoo,
+                                                        const glm::uvec2 maxCoo, const unsigned int samples) {
+  Region region{camera, minCoo, maxCoo, samples, {}};
+  auto result = region.result.get_future();
+  Submit(std::move(region));
+  return result;
+}
+
+std::future<bool> Renderer::RenderAnimation(Animation animation) {
+  const auto first = animation.firstFrame;
+  Animate animate{std::move(animation), {}, first};
+  auto done = animate.done.get_future();
+
+  UpdateScene();
+  UpdateModel();
+  UpdateSettings();
+  Submit(std::move(animate));
+  return done;
+}
+
+void Renderer::Service() {
+  RTIAW_TRACE_THREAD_NAME("Render");
+
+  uint64_t seen = 0;
+  while (true) {
+    m_submitted.wait(seen, std::memory_order_acquire);
+    seen = m_submitted.load(std::memory_order_acquire);
+
+    const auto abandonAnimation = [this] {
+      if (m_animation) {
+        m_animation->done.set_value(false);
+        m_animation.reset();
+      }
+    };
+
+    // apply everything that is queued, remembering what it touched
+    bool sceneChanged = false, modelChanged = false, cameraChanged = false, settingsChanged = false;
+    Command command;
+    while (m_commands.Pop(command)) {
+      const bool quit = std::holds_alternative<Quit>(command.payload);
+      std::visit(overloaded{
+                     [](std::monostate) {},
+                     [&](SceneSettings &scene) {
+                       if (!m_sceneLoaded || scene != m_activeScene) {
+                         m_activeScene = std::move(scene);
+                         sceneChanged = true;
+                       }
+                     },
+                     [&](const ModelSettings &model) {
+                       if (model != m_activeModel) {
+                         m_activeModel = model;
+                         modelChanged = true;
+                       }
+                     },
+                     [&](const CameraSettings &camera) {
+                       if (camera != m_activeCamera) {
+                         m_activeCamera = camera;
+                         cameraChanged |= m_cameraFollowsSettings;
+                       }
+                     },
+                     [&](const RenderSettings &settings) {
+                       if (settings != m_settings) {
+                         m_settings = settings;
+                         settingsChanged = true;
+                       }
+                     },
+                     [&](Resized) { cameraChanged = true; },
+                     [&](RenderFrame) { m_renderPending = m_continuous = true; },
+                     [&](Region &region) { m_regions.push_back(std::move(region)); },
+                     [&](Animate &animate) {
+                       abandonAnimation();
+                       m_animation = std::move(animate);
+                     },
+                     [&](Stop) {
+                       abandonAnimation();
+                       m_renderPending = m_continuous = false;
+                       if (m_state != RenderState::Ready) {
+                         m_state = RenderState::Stopped;
+                       }
+                     },
+                     [&](Quit) { abandonAnimation(); },
+                 },
+                 command.payload);
+      m_applied.store(command.version, std::memory_order_release);
+      if (quit) {
+        return;
+      }
+    }
+
+    try {
+      if (sceneChanged) {
+        // the texture does not depend on the scene, decode it once
+        if (std::get<0>(m_earthTexture) == nullptr) {
+          RTIAW_TRACE_SCOPE("LoadTexture");
+          m_earthTexture = LoadImage(EARTHMAP_PATH);
+        }
+        LoadScene();
+        m_sceneLoaded = true;
+      } else if (m_sceneLoaded) {
+        // a moved instance only refits the instance hierarchy
+        if (modelChanged && m_modelInstance)
+          m_scene.SetInstanceTransform(*m_modelInstance, m_activeModel.model);
+        if (cameraChanged) {
+          if (m_cameraFollowsSettings)
+            FollowCameraSettings();
+          RebuildCamera();
+        }
+      }
+    } catch (const std::exception &error) {
+      m_logger->error("Cannot load the scene: {}", error.what());
+      m_sceneLoaded = m_renderPending = m_continuous = false;
+      abandonAnimation();
+      m_state = RenderState::Stopped;
+    }
+
+    // regions are small and wanted right away, they go before any frame
+    for (auto &region : m_regions) {
+      try {
+        if (!m_sceneLoaded || !m_renderBuffer)
+          throw std::runtime_error("No scene to render the region of");
+        region.result.set_value(TraceRegion(region));
+      } catch (const std::exception &) {
+        region.result.set_exception(std::current_exception());
+      }
+    }
+    m_regions.clear();
+
+    m_renderPending |= m_continuous && (sceneChanged || modelChanged || cameraChanged || settingsChanged);
+    const bool render = (m_renderPending || m_animation) && m_sceneLoaded && m_renderBuffer;
+    m_settled.store(m_applied.load(std::memory_order_relaxed), std::memory_order_release);
+    m_settled.notify_all();
+    if (!render) {
+      continue;
+    }
+
+    m_frameVersion = m_applied.load(std::memory_order_relaxed);
+    if (m_animation) {
+      try {
+        if (RenderAnimationFrames()) {
+          m_animation->done.set_value(true);
+          m_animation.reset();
+        }
+      } catch (const std::exception &error) {
+        m_logger->error("Cannot render the animation: {}", error.what());
+        abandonAnimation();
+        m_state = RenderState::Stopped;
+      }
+      // an interrupted batch goes on once the commands that interrupted it are applied
+      if (m_animation || !m_renderPending || Interrupted()) {
+        continue;
+      }
+    }
+
+    Render();
+    // an interrupted frame is redone once the commands that interrupted it are applied
+    if (!Interrupted()) {
+      m_renderPending = false;
+      m_renderedVersion = m_frameVersion;
+    }
+  }
+}
+
+bool Renderer::RenderAnimationFrames() {
+  RTIAW_TRACE_SCOPE("RenderAnimation");
+  Walnut::Timer timer;
+  Stats::Reset();
+  m_state = RenderState::Running;
+  m_frameSeed = m_settings.seed != 0 ? m_settings.seed : std::random_device{}();
+  m_threadPool.WaitIdle();
+
+  const auto &animation = m_animation->animation;
+  std::filesystem::create_directories(animation.outputDirectory);
+
+  // A few frames are in flight at once, the quads of all of them go to the pool together: a worker done with
+  // the last quads of a frame moves on to the next frame instead of waiting for the slowest one. The images are
+  // written by another thread while the next frames render, into the other set of buffers.
+  const size_t quadCount = m_quads.size();
+  const size_t framesInFlight =
+      std::clamp<size_t>((2 * m_threadPool.ThreadCount() + quadCount - 1) / quadCount, 2, 16);
+  const size_t frameBytes = static_cast<size_t>(m_imageSize.x) * m_imageSize.y * 4;
+  std::array<std::vector<std::unique_ptr<uint8_t[]>>, 2> buffers;
+  std::vector<Camera> cameras;
+  std::future<void> writing;
+  const auto finishWriting = [&writing] {
+    if (writing.valid()) {
+      writing.get();
+    }
+  };
+
+  for (size_t set = 0; m_animation->nextFrame <= animation.lastFrame; set ^= 1) {
+    const unsigned int first = m_animation->nextFrame;
+    const size_t count = std::min<size_t>(framesInFlight, animation.lastFrame - first + 1);
+
+    cameras.clear();
+    for (size_t frame = 0; frame < count; ++frame) {
+      cameras.push_back(KeyCamera(animation.At(static_cast<float>(first + frame))));
+    }
+    auto &frames = buffers[set];
+    while (frames.size() < count) {
+      frames.emplace_back(new uint8_t[frameBytes]);
+    }
+
+    m_threadPool.ParallelFor(0, count * quadCount, 1, [&](const size_t firstTile, const size_t lastTile) {
+      for (size_t tile = firstTile; tile < lastTile; ++tile) {
+        const auto frame = tile / quadCount;
+        const auto &[minCoo, maxCoo] = m_quads[tile % quadCount];
+        if (m_settings.sortHitsByMaterial) {
+          RenderQuadSorted(cameras[frame], frames[frame].get(), minCoo, maxCoo);
+        } else {
+          RenderQuad(cameras[frame], frames[frame].get(), minCoo, maxCoo);
+        }
+      }
+    });
+    if (Interrupted()) {
+      finishWriting();
+      return false;
+    }
+
+    finishWriting();
+    writing = std::async(std::launch::async, [&animation, &frames, first, count, size = m_imageSize] {
+      for (size_t frame = 0; frame < count; ++frame) {
+        animation.WriteFrame(first + static_cast<unsigned int>(frame), frames[frame].get(), size);
+      }
+    });
+    m_animation->nextFrame = first + static_cast<unsigned int>(count);
+    m_logger->info("Frames {} to {} rendered", first, m_animation->nextFrame - 1);
   }
+  finishWriting();
+
+  PublishStats(timer.ElapsedMillis());
+  m_state = RenderState::Finished;
+  return true;
+}
 
-  m_TextureData = LoadImage(EARTHMAP_PATH);
+void Renderer::PublishStats(const float milliseconds) {
+  const auto stats = Stats::Collect();
+  const std::lock_guard lock{m_statsMutex};
+  m_lastStats = stats;
+  m_lastTileStats = m_tileStats;
+  m_lastRenderTime = milliseconds;
+}
 
-  LoadScene();
-  m_renderingThread = std::thread{&Renderer::Render, this};
+Camera Renderer::KeyCamera(const CameraKey &key) const {
+  // the field of view comes with the scene, the key moves the camera
+  return {Camera::CameraOrientation{key.lookfrom, key.lookat, vec3(0, 1, 0)}, m_cameraSetup.verticalFov,
+          AspectRatio(), key.aperture, glm::length(key.lookfrom - key.lookat)};
 }
 
-void Renderer::StopRender() { m_state = RenderState::Stopped; }
+void Renderer::RebuildCamera() {
+  const auto &[orientation, verticalFov, cameraAperture, focusDist] = m_cameraSetup;
+  m_camera = std::make_unique<Camera>(orientation, verticalFov, AspectRatio(), cameraAperture, focusDist);
+  m_camera->OnResize(m_imageSize.x, m_imageSize.y);
+}
 
-std::vector<Renderer::Quad> Renderer::SplitImage(unsigned int quadSize) const {
-  std::vector<Quad> result;
+void Renderer::FollowCameraSettings() {
+  const Camera::CameraOrientation orientation{m_activeCamera.lookfrom, m_activeCamera.lookat, vec3(0, 1, 0)};
+  const auto lookDir = orientation.lookfrom - orientation.lookat;
+  m_cameraSetup = {orientation, 20.0f, m_activeCamera.aperture, std::sqrt(glm::dot(lookDir, lookDir))};
+  m_cameraFollowsSettings = true;
+}
+
+void Renderer::SplitImage(std::vector<Quad> &result, unsigned int quadSize) const {
+  result.clear();
   const auto nX = static_cast<unsigned int>(
       std::ceil(m_imageSize.x / static_cast<float>(quadSize)));
   const auto nY = static_cast<unsigned int>(
@@ -96,28 +426,32 @@ std::vector<Renderer::Quad> Renderer::SplitImage(unsigned int quadSize) const {
           glm::min(glm::uvec2{(i + 1) * quadSize, j * quadSize}, m_imageSize));
     }
   }
-
-  return result;
 }
 
 void Renderer::Render() {
+  RTIAW_TRACE_SCOPE("Render");
   m_logger->debug("Start rendering!!!");
-  timer = new Walnut::Timer();
+  Walnut::Timer timer;
+  Stats::Reset();
   m_state = RenderState::Running;
+  m_frameSeed = m_settings.seed != 0 ? m_settings.seed : std::random_device{}();
+
+  // the tasks of the previous frame may still be unwinding on the workers (e.g. after a stop), wait for them
+  // before handing their memory out again
+  m_threadPool.WaitIdle();
+  m_frameArena.Reset();
 
   auto renderPixel = [this]() {
-    if (m_state == RenderState::Stopped) {
+    if (Interrupted()) {
       return;
     }
 
-    auto [texture, textureWidth, textureHeight] = m_TextureData;
-
     for (int j = m_imageSize.y - 1; j >= 0; --j) {
       for (unsigned int i = 0; i < m_imageSize.x; ++i) {
         const auto pixelCoord = glm::uvec2{i, j};
         color pixel_color{0, 0, 0};
 
-        for (unsigned int i_sample = 0; i_sample < samplesPerPixel;
+        for (unsigned int i_sample = 0; i_sample < m_settings.samplesPerPixel;
              ++i_sample) {
           const auto u = (static_cast<float>(pixelCoord.x) +
                           m_unifDistribution(m_rnGenerator)) /
@@ -126,20 +460,11 @@ void Renderer::Render() {
                           m_unifDistribution(m_rnGenerator)) /
                          (m_imageSize.y - 1);
 
-          // TODO: texture mapping
-          uint32_t textureIdx =
-              pixelCoord.x * (textureWidth / m_imageSize.x) +
-              pixelCoord.y * textureWidth * (textureHeight / m_imageSize.y);
-          glm::vec3 textureColor =
-              glm::vec3(texture[4 * (textureIdx) + 0] / 255.0f,
-                        texture[4 * (textureIdx) + 1] / 255.0f,
-                        texture[4 * (textureIdx) + 2] / 255.0f);
-
           Ray r = m_camera->NewRay(u, v);
-          pixel_color += ShootRay(r, maxRayDepth);
-          pixel_color += textureColor;
+          pixel_color += ShootRay(r, m_settings.maxRayDepth);
+          pixel_color += TextureTint(pixelCoord);
         }
-        WritePixelToBuffer(pixelCoord.x, pixelCoord.y, samplesPerPixel,
+        WritePixelToBuffer(m_renderBuffer.get(), pixelCoord.x, pixelCoord.y, m_settings.samplesPerPixel,
                            pixel_color);
       }
     }
@@ -147,16 +472,15 @@ void Renderer::Render() {
 /* #define RENDER_PERLINE */
 #ifdef RENDER_PERLINE
   auto renderLine = [this](const unsigned int lineCoord) {
-    if (m_state == RenderState::Stopped) {
+    if (Interrupted()) {
       return;
     }
 
-    auto [texture, textureWidth, textureHeight] = m_TextureData;
     for (unsigned int i = 0; i < m_imageSize.x; ++i) {
       const auto pixelCoord = glm::uvec2{i, lineCoord};
       color pixel_color{0, 0, 0};
 
-      for (unsigned int i_sample = 0; i_sample < samplesPerPixel; ++i_sample) {
+      for (unsigned int i_sample = 0; i_sample < m_settings.samplesPerPixel; ++i_sample) {
         const auto u = (static_cast<float>(pixelCoord.x) +
                         m_unifDistribution(m_rnGenerator)) /
                        (m_imageSize.x - 1);
@@ -164,66 +488,18 @@ void Renderer::Render() {
                         m_unifDistribution(m_rnGenerator)) /
                        (m_imageSize.y - 1);
 
-        // TODO: texture mapping
-        uint32_t textureIdx =
-            pixelCoord.x * (textureWidth / m_imageSize.x) +
-            pixelCoord.y * textureWidth * (textureHeight / m_imageSize.y);
-        glm::vec3 textureColor =
-            glm::vec3(texture[4 * (textureIdx) + 0] / 255.0f,
-                      texture[4 * (textureIdx) + 1] / 255.0f,
-                      texture[4 * (textureIdx) + 2] / 255.0f);
-
         Ray r = m_camera->NewRay(u, v);
-        pixel_color += ShootRay(r, maxRayDepth);
-        pixel_color += textureColor;
+        pixel_color += ShootRay(r, m_settings.maxRayDepth);
+        pixel_color += TextureTint(pixelCoord);
       }
-      WritePixelToBuffer(pixelCoord.x, pixelCoord.y, samplesPerPixel,
+      WritePixelToBuffer(m_renderBuffer.get(), pixelCoord.x, pixelCoord.y, m_settings.samplesPerPixel,
                          pixel_color);
     }
   };
 #endif
 
-  auto renderQuad = [this](const glm::uvec2 minCoo, const glm::uvec2 maxCoo) {
-    if (m_state == RenderState::Stopped) {
-      return;
-    }
-
-    std::mt19937 generator{std::random_device{}()};
-
-    auto [texture, textureWidth, textureHeight] = m_TextureData;
-    for (unsigned int j = maxCoo.y; j > minCoo.y; --j) {
-      for (unsigned int i = minCoo.x; i < maxCoo.x; ++i) {
-        color pixel_color{0, 0, 0};
-        const auto pixelCoord = glm::uvec2{i, j - 1};
-        for (unsigned int i_sample = 0; i_sample < samplesPerPixel;
-             ++i_sample) {
-          const auto u = (static_cast<float>(pixelCoord.x) +
-                          m_unifDistribution(generator)) /
-                         (m_imageSize.x - 1);
-          const auto v = (static_cast<float>(pixelCoord.y) +
-                          m_unifDistribution(generator)) /
-                         (m_imageSize.y - 1);
-          // TODO: texture mapping
-          uint32_t textureIdx =
-              pixelCoord.x * (textureWidth / m_imageSize.x) +
-              pixelCoord.y * textureWidth * (textureHeight / m_imageSize.y);
-          glm::vec3 textureColor =
-              glm::vec3(texture[4 * (textureIdx) + 0] / 255.0f,
-                        texture[4 * (textureIdx) + 1] / 255.0f,
-                        texture[4 * (textureIdx) + 2] / 255.0f);
-          Ray r = m_camera->NewRay(u, v);
-          pixel_color += ShootRay(r, maxRayDepth);
-          pixel_color += textureColor;
-        }
-        WritePixelToBuffer(pixelCoord.x, pixelCoord.y, samplesPerPixel,
-                           pixel_color);
-      }
-    }
-  };
-
-  std::vector<std::future<void>> futures;
-
 #ifdef RENDER_PERLINE
+  std::vector<std::future<void>> futures;
   // Render per-line
   for (int j = m_imageSize.y - 1; j >= 0; --j) {
     futures.push_back(m_threadPool.AddTask(renderLine, j));
@@ -231,19 +507,111 @@ void Renderer::Render() {
   /* for (int j = m_imageSize.y - 1; j >= 0; --j) { */
   /*   futures.push_back(m_threadPool.AddTask(renderPixel)); */
   /* } */
+
+  // wait until all tasks are done...
+  std::for_each(begin(futures), end(futures),
+                [](auto &future) { future.wait(); });
 #else
-  // Render per-quad
-  for (const auto &[minCoo, maxCoo] : SplitImage()) {
-    futures.push_back(m_threadPool.AddTask(renderQuad, minCoo, maxCoo));
+  if (m_settings.wavefront) {
+    // Render the whole image stage by stage, the stages spread themselves over the pool
+    RenderWavefront();
+  } else {
+    // Render per-quad, measuring each one for the tile heatmap
+    auto renderTile = [this](const size_t tile) {
+      const auto &[minCoo, maxCoo] = m_quads[tile];
+      Walnut::Timer tileTimer;
+      const uint64_t raysBefore = Stats::Local().Rays();
+
+      if (m_settings.sortHitsByMaterial) {
+        RenderQuadSorted(*m_camera, m_renderBuffer.get(), minCoo, maxCoo);
+      } else {
+        RenderQuad(*m_camera, m_renderBuffer.get(), minCoo, maxCoo);
+      }
+
+      m_tileStats[tile].rays = Stats::Local().Rays() - raysBefore;
+      m_tileStats[tile].milliseconds = tileTimer.ElapsedMillis();
+    };
+    // one quad at a time, this thread helps the pool and the call returns when every quad is done
+    m_threadPool.ParallelFor(0, m_quads.size(), 1, [&renderTile](const size_t first, const size_t last) {
+      for (size_t tile = first; tile < last; ++tile) {
+        renderTile(tile);
+      }
+    });
   }
 
 #endif
 
-  // wait until all tasks are done...
-  std::for_each(begin(futures), end(futures),
-                [](auto &future) { future.wait(); });
+  PublishStats(timer.ElapsedMillis());
+  if (!Interrupted()) {
+    m_state = RenderState::Finished;
+  }
+}
 
-  m_state = RenderState::Finished;
+void Renderer::RenderQuad(const Camera &camera, uint8_t *buffer, const glm::uvec2 minCoo, const glm::uvec2 maxCoo) {
+  if (Interrupted()) {
+    return;
+  }
+  RTIAW_TRACE_SCOPE("RenderQuad");
+
+  // a sequence of the quad's own: the frame doesn't depend on which worker renders what
+  Random::Seed({m_frameSeed, minCoo.x, minCoo.y});
+  auto &generator = Random::Generator();
+
+  for (unsigned int j = maxCoo.y; j > minCoo.y; --j) {
+    // a newer command makes this frame stale, give the threads back quickly
+    if (Interrupted()) {
+      return;
+    }
+    for (unsigned int i = minCoo.x; i < maxCoo.x; ++i) {
+      const auto pixelCoord = glm::uvec2{i, j - 1};
+      WritePixelToBuffer(buffer, pixelCoord.x, pixelCoord.y, m_settings.samplesPerPixel,
+                         SamplePixel(camera, pixelCoord, m_settings.samplesPerPixel, generator));
+    }
+  }
+}
+
+color Renderer::TextureTint(const glm::uvec2 pixelCoord) const {
+  // TODO: texture mapping
+  const auto [texture, textureWidth, textureHeight] = m_TextureData;
+  const uint32_t textureIdx = pixelCoord.x * (textureWidth / m_imageSize.x) +
+                              pixelCoord.y * textureWidth * (textureHeight / m_imageSize.y);
+  return {texture[4 * textureIdx + 0] / 255.0f, texture[4 * textureIdx + 1] / 255.0f,
+          texture[4 * textureIdx + 2] / 255.0f};
+}
+
+color Renderer::SamplePixel(const Camera &camera, const glm::uvec2 pixelCoord, const unsigned int samples,
+                            std::mt19937 &generator) {
+  color pixel_color{0, 0, 0};
+  for (unsigned int i_sample = 0; i_sample < samples; ++i_sample) {
+    const auto u = (static_cast<float>(pixelCoord.x) +
+                    m_unifDistribution(generator)) /
+                   (m_imageSize.x - 1);
+    const auto v = (static_cast<float>(pixelCoord.y) +
+                    m_unifDistribution(generator)) /
+                   (m_imageSize.y - 1);
+    Ray r = camera.NewRay(u, v);
+    pixel_color += ShootRay(r, m_settings.maxRayDepth);
+    pixel_color += TextureTint(pixelCoord);
+  }
+  return pixel_color;
+}
+
+std::vector<color> Renderer::TraceRegion(const Region &region) {
+  RTIAW_TRACE_SCOPE("TraceRegion");
+  const Camera camera = KeyCamera(region.camera);
+  const glm::uvec2 size = region.maxCoo - region.minCoo;
+  std::vector<color> sums(static_cast<size_t>(size.x) * size.y);
+
+  m_threadPool.ParallelFor(0, size.y, 1, [&](const size_t firstRow, const size_t lastRow) {
+    std::mt19937 generator{std::random_device{}()};
+    for (size_t row = firstRow; row < lastRow; ++row) {
+      for (unsigned int i = 0; i < size.x; ++i) {
+        const glm::uvec2 pixelCoord{region.minCoo.x + i, region.minCoo.y + static_cast<unsigned int>(row)};
+        sums[i + row * size.x] = SamplePixel(camera, pixelCoord, region.samples, generator);
+      }
+    }
+  });
+  return sums;
 }
 
 color Renderer::ShootRay(const Ray &ray, unsigned int depth) {
@@ -251,6 +619,9 @@ color Renderer::ShootRay(const Ray &ray, unsigned int depth) {
   if (depth == 0)
     return {0, 0, 0};
 
+  auto &stats = Stats::Local();
+  ++(depth == m_settings.maxRayDepth ? stats.primaryRays : stats.secondaryRays);
+
   if (const auto &[o_hitRecord, o_scatterResult] =
           m_scene.Hit(ray, 0.001f, RTIAW::Utils::infinity);
       o_hitRecord) {
@@ -261,33 +632,159 @@ color Renderer::ShootRay(const Ray &ray, unsigned int depth) {
       return attenuation * ShootRay(scattered, depth - 1);
     }
 
+    ++stats.earlyTerminations;
     return {0, 0, 0};
   }
 
-  constexpr color white{1.0, 1.0, 1.0};
-  constexpr color azure{0.5, 0.7, 1.0};
+  return SkyColor(ray);
+}
 
-  float t = 0.5f * (ray.direction.y + 1.0f);
-  return (1.0f - t) * white + t * azure;
+void Renderer::RenderQuadSorted(const Camera &camera, uint8_t *buffer, const glm::uvec2 minCoo,
+                                const glm::uvec2 maxCoo) {
+  if (Interrupted()) {
+    return;
+  }
+  RTIAW_TRACE_SCOPE("RenderQuadSorted");
+
+  // the same paths as ShootRay, advanced one bounce at a time for the whole quad
+  struct Path {
+    Ray ray;
+    color throughput;
+    uint32_t pixel;
+    bool alive;
+  };
+
+  Random::Seed({m_frameSeed, minCoo.x, minCoo.y});
+  auto &generator = Random::Generator();
+
+  const auto &materials = m_scene.GetMaterials();
+  const glm::uvec2 quadSize = maxCoo - minCoo;
+
+  // scratch of this task only, the arena of the worker stops growing after its first quad
+  auto &scratch = Utils::FrameArena::ThreadLocal();
+  const Utils::ArenaScope scope{scratch};
+  std::pmr::vector<color> pixelColors(quadSize.x * quadSize.y, color{0, 0, 0}, &scratch);
+  std::pmr::vector<Path> paths{&scratch};
+  paths.reserve(pixelColors.size());
+  MaterialBuckets buckets{&scratch};
+  buckets.Reserve(pixelColors.size());
+  auto &stats = Stats::Local();
+
+  for (unsigned int i_sample = 0; i_sample < m_settings.samplesPerPixel; ++i_sample) {
+    if (Interrupted()) {
+      return;
+    }
+    paths.clear();
+    for (unsigned int j = maxCoo.y; j > minCoo.y; --j) {
+      for (unsigned int i = minCoo.x; i < maxCoo.x; ++i) {
+        const auto pixelCoord = glm::uvec2{i, j - 1};
+        const auto pixel = (pixelCoord.x - minCoo.x) + (pixelCoord.y - minCoo.y) * quadSize.x;
+        const auto u = (static_cast<float>(pixelCoord.x) + m_unifDistribution(generator)) / (m_imageSize.x - 1);
+        const auto v = (static_cast<float>(pixelCoord.y) + m_unifDistribution(generator)) / (m_imageSize.y - 1);
+        pixelColors[pixel] += TextureTint(pixelCoord);
+        paths.push_back({camera.NewRay(u, v), color{1, 1, 1}, pixel, true});
+      }
+    }
+
+    // paths still alive after maxRayDepth bounces gather no light, as in ShootRay
+    for (unsigned int depth = m_settings.maxRayDepth; depth > 0 && !paths.empty(); --depth) {
+      (depth == m_settings.maxRayDepth ? stats.primaryRays : stats.secondaryRays) += paths.size();
+      buckets.Clear();
+      for (uint32_t p = 0; p < paths.size(); ++p) {
+        auto &path = paths[p];
+        if (const auto hit = m_scene.Intersect(path.ray, 0.001f, RTIAW::Utils::infinity); hit) {
+          buckets.Push(materials, p, hit.value());
+        } else {
+          pixelColors[path.pixel] += path.throughput * SkyColor(path.ray);
+          path.alive = false;
+        }
+      }
+
+      buckets.Shade(
+          materials, [&paths](uint32_t p) -> const Ray & { return paths[p].ray; },
+          [&paths, &stats](uint32_t p, const std::optional<ScatteringRecord> &scattered) {
+            if (scattered) {
+              paths[p].throughput *= scattered->attenuation;
+              paths[p].ray = scattered->ray;
+            } else {
+              paths[p].alive = false;
+              ++stats.earlyTerminations;
+            }
+          });
+
+      paths.erase(std::remove_if(begin(paths), end(paths), [](const Path &path) { return !path.alive; }), end(paths));
+    }
+  }
+
+  RTIAW_TRACE_SCOPE("Resolve");
+  for (unsigned int j = minCoo.y; j < maxCoo.y; ++j) {
+    for (unsigned int i = minCoo.x; i < maxCoo.x; ++i) {
+      WritePixelToBuffer(buffer, i, j, m_settings.samplesPerPixel, pixelColors[(i - minCoo.x) + (j - minCoo.y) * quadSize.x]);
+    }
+  }
 }
 
-void Renderer::WritePixelToBuffer(unsigned int ix, unsigned int iy,
+void Renderer::RenderWavefront() {
+  const auto &materials = m_scene.GetMaterials();
+  const size_t pixelCount = static_cast<size_t>(m_imageSize.x) * m_imageSize.y;
+
+  std::pmr::vector<color> radiance{&m_frameArena};
+  radiance.reserve(std::min(waveSize, pixelCount));
+  for (size_t firstPixel = 0; firstPixel < pixelCount; firstPixel += waveSize) {
+    const size_t wavePixels = std::min(waveSize, pixelCount - firstPixel);
+    radiance.assign(wavePixels, color{0, 0, 0});
+
+    for (unsigned int i_sample = 0; i_sample < m_settings.samplesPerPixel; ++i_sample) {
+      m_wavefront.Generate(wavePixels, [&](const uint32_t pixel) {
+        static thread_local std::mt19937 generator{std::random_device{}()};
+        static thread_local std::uniform_real_distribution<float> unif{0.0f, 1.0f};
+
+        const auto pixelCoord = glm::uvec2{(firstPixel + pixel) % m_imageSize.x, (firstPixel + pixel) / m_imageSize.x};
+        const auto u = (static_cast<float>(pixelCoord.x) + unif(generator)) / (m_imageSize.x - 1);
+        const auto v = (static_cast<float>(pixelCoord.y) + unif(generator)) / (m_imageSize.y - 1);
+        radiance[pixel] += TextureTint(pixelCoord);
+        return m_camera->NewRay(u, v);
+      });
+
+      // paths still alive after maxRayDepth bounces gather no light, as in ShootRay
+      for (unsigned int depth = m_settings.maxRayDepth; depth > 0 && m_wavefront.ActivePaths() > 0; --depth) {
+        if (Interrupted()) {
+          return;
+        }
+        m_wavefront.Extend(m_scene);
+        m_wavefront.Shade(materials, radiance, SkyColor);
+        m_wavefront.Compact();
+      }
+    }
+
+    RTIAW_TRACE_SCOPE("Resolve");
+    for (size_t pixel = 0; pixel < wavePixels; ++pixel) {
+      WritePixelToBuffer(m_renderBuffer.get(), (firstPixel + pixel) % m_imageSize.x, (firstPixel + pixel) / m_imageSize.x, m_settings.samplesPerPixel,
+                         radiance[pixel]);
+    }
+  }
+}
+
+void Renderer::WritePixelToBuffer(uint8_t *buffer, unsigned int ix, unsigned int iy,
                                   unsigned int samples_per_pixel,
                                   color pixel_color) {
   // flip the vertical coordinate because the display backend follow the
   // opposite convention iy = m_imageSize.y - 1 - iy;
 
+  ResolvePixel(pixel_color, samples_per_pixel, buffer + 4 * (ix + iy * m_imageSize.x));
+};
+
+void Renderer::ResolvePixel(color pixel_color, const unsigned int samples_per_pixel, uint8_t *rgba) {
   pixel_color /= samples_per_pixel;
   pixel_color = glm::sqrt(pixel_color);
   pixel_color = glm::clamp(pixel_color, 0.0f, 1.0f);
 
-  const unsigned int idx = 4 * (ix + iy * m_imageSize.x);
   const auto new_color = ConvertColor(pixel_color);
 
-  m_renderBuffer[idx] = new_color.r;
-  m_renderBuffer[idx + 1] = new_color.g;
-  m_renderBuffer[idx + 2] = new_color.b;
-  m_renderBuffer[idx + 3] = 255;
-};
+  rgba[0] = new_color.r;
+  rgba[1] = new_color.g;
+  rgba[2] = new_color.b;
+  rgba[3] = 255;
+}
 
 } // namespace RTIAW::Render
@@ -4,23 +4,44 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include "Renderer/Animation.h"
 #include "Renderer/Camera.h"
+#include "Renderer/FrameArena.h"
 #include "Renderer/HittableObjectList.h"
+#include "Renderer/SceneFile.h"
+#include "Renderer/SpscQueue.h"
+#include "Renderer/Stats.h"
 #include "Renderer/ThreadPool.h"
+#include "Renderer/Trace.h"
 #include "Renderer/Utils.h"
+#include "Renderer/Wavefront.h"
 #include "Walnut/Timer.h"
 
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <variant>
 
 namespace RTIAW::Render {
 
+// Render service: a long-lived thread owns the scene and drives the pool. Every change is sent to it as a
+// versioned command (see StartRender() and the Update*() methods), which it applies in order before redoing
+// only what the change affects: a new scene is loaded, a new camera only rebuilds the camera, and any change
+// restarts the frame in progress. Commands are expected from a single thread, the UI.
 class Renderer {
 public:
+  // the public settings below are read when they are submitted, not while rendering
   point3 lookfrom{10.0f, 10.0f, 10.0f};
   point3 lookat{0.0f, 0.0f, 0.0f};
   point3 material_color{0.8f, 0.2f, 0.1f};
   float aperture = 0.1f;
   float scale = 2.0f;
+  // node layout of the scene hierarchy, a change rebuilds the scene (see WideBVH.h)
+  BVHLayout bvhLayout = BVHLayout::Binary;
+  // split strategy of the scene hierarchy, a change rebuilds the scene (see BVH.h)
+  BVHBuilder bvhBuilder = BVHBuilder::Median;
   enum class RenderState { Ready, Running, Finished, Stopped };
   enum class Scenes {
     DefaultScene,
@@ -28,12 +49,12 @@ public:
     TestScene,
     OneSphereScene,
     RectangleScene,
-    Cube
+    Cube,
+    FromFile
   };
 
   std::tuple<uint8_t *, int, int> m_TextureData;
 
-  Walnut::Timer *timer;
   // define a mvp struct holds all the mvp matrices
   struct MVP {
     glm::mat4 model = glm::mat4(1.0f);
@@ -43,51 +64,215 @@ public:
 
   MVP mvp;
 
-  Renderer() : m_logger{spdlog::stdout_color_st("Renderer")} {}
+  Renderer() : Renderer(Utils::Pool::DefaultThreadCount(), Utils::Affinity::None) {}
+  // `threadCount` workers (the default when 0) placed according to `affinity`
+  Renderer(std::size_t threadCount, Utils::Affinity affinity);
   Renderer(const Renderer &) = delete;
   ~Renderer();
 
-  HittableObjectList getScene() { return m_scene; };
+  // waits for the frame in progress to stop when the size changes
   void SetImageSize(unsigned int x, unsigned int y);
   void SetScene(Scenes scene = Scenes::DefaultScene) { m_sceneType = scene; };
+  // binary scene file used by Scenes::FromFile, see SceneFile.h
+  void SetSceneFile(std::string path) { m_sceneFilePath = std::move(path); };
 
   void SetSamplesPerPixel(unsigned int nSamples) { samplesPerPixel = nSamples; }
   void SetMaxRayBounces(unsigned int nBounces) { maxRayDepth = nBounces; }
 
+  // submits the current scene, camera and settings, then a frame. From then on every applied change renders a
+  // new frame, until StopRender()
   void StartRender();
   void StopRender();
+  // Renders the frames of `animation` into numbered images, with the scene and settings submitted along and the
+  // image size set by SetImageSize(). The scene and its hierarchy are built once for the whole sequence. Resolves
+  // to false when the batch is abandoned: StopRender(), another batch, or a scene that fails to load
+  std::future<bool> RenderAnimation(Animation animation);
+  // Sums of `samples` paths per pixel of [minCoo, maxCoo), rows bottom first, seen from `camera` with the submitted
+  // scene and settings. Not tone mapped, sums of different calls add up (see Distributed.h)
+  std::future<std::vector<color>> RenderRegion(const CameraKey &camera, glm::uvec2 minCoo, glm::uvec2 maxCoo,
+                                               unsigned int samples);
+  // averages `samples` summed in `pixel_color` into an RGBA8 pixel, as displayed
+  static void ResolvePixel(color pixel_color, unsigned int samples, uint8_t *rgba);
+  // submit one part of the public settings, each returns the version of its command
+  uint64_t UpdateScene();
+  // the placement of the Cube scene instance, moved without reloading the scene
+  uint64_t UpdateModel();
+  uint64_t UpdateCamera();
+  uint64_t UpdateSettings();
   void OnUpdate(float ts){
       // m_camera->OnUpdate(ts);
   };
 
+  // wall time and rays traced of one quad of the image
+  struct TileStats {
+    glm::uvec2 minCoo;
+    glm::uvec2 maxCoo;
+    float milliseconds;
+    uint64_t rays;
+  };
+
   [[nodiscard]] Scenes Scene() const { return m_sceneType; }
   [[nodiscard]] RenderState State() const { return m_state; }
+  // version of the last submitted command, and the one the last finished frame was rendered with
+  [[nodiscard]] uint64_t SubmittedVersion() const { return m_submitted.load(); }
+  [[nodiscard]] uint64_t RenderedVersion() const { return m_renderedVersion.load(); }
+  [[nodiscard]] glm::uvec2 ImageSize() const { return m_imageSize; }
+  // node memory of the object hierarchy of the loaded scene
+  [[nodiscard]] size_t HierarchyBytes() const { return m_hierarchyBytes.load(); }
+  // time spent building it, in ms
+  [[nodiscard]] float HierarchyBuildTime() const { return m_hierarchyBuildTime.load(); }
+  // one entry per quad of the last finished (or stopped) render, empty before the first one
+  [[nodiscard]] std::vector<TileStats> TileStatistics() const {
+    const std::lock_guard lock{m_statsMutex};
+    return m_lastTileStats;
+  }
   [[nodiscard]] const void *ImageBuffer() const {
-    return m_renderBuffer.empty() ? nullptr : m_renderBuffer.data();
+    return m_renderBuffer.get();
   }
 
   unsigned int samplesPerPixel = 10;
   unsigned int maxRayDepth = 10;
-  unsigned int lastRenderTimeMS = 0;
-  float lastRenderTime = 0.0f;
+  // trace each quad as a batch and shade its hits grouped by material type
+  bool sortHitsByMaterial = false;
+  // trace the whole image breadth first, see Wavefront.h
+  bool wavefront = false;
+  // frames with the same non zero seed, scene and settings come out identical (the quad integrators, not the
+  // wavefront one), 0 draws a new seed per frame
+  uint32_t seed = 0;
+  // counters of the last finished (or stopped) frame, copied out since the service replaces them
+  [[nodiscard]] RenderStats LastStats() const {
+    const std::lock_guard lock{m_statsMutex};
+    return m_lastStats;
+  }
+  // wall time of the last finished (or stopped) frame or batch, in ms
+  [[nodiscard]] float LastRenderTime() const {
+    const std::lock_guard lock{m_statsMutex};
+    return m_lastRenderTime;
+  }
 
 private:
   std::shared_ptr<spdlog::logger> m_logger;
 
   glm::uvec2 m_imageSize{0, 0};
 
-  Scenes m_sceneType{Scenes::DefaultScene};
+  // ------------------------------------------------------------------ commands
+  struct SceneSettings {
+    Scenes scene;
+    std::string file;
+    color materialColor;
+    BVHLayout bvhLayout;
+    BVHBuilder bvhBuilder;
+    bool operator==(const SceneSettings &) const = default;
+  };
+  struct ModelSettings {
+    glm::mat4 model; // placement of the Cube scene instance
+    bool operator==(const ModelSettings &) const = default;
+  };
+  struct CameraSettings {
+    point3 lookfrom;
+    point3 lookat;
+    float aperture;
+    bool operator==(const CameraSettings &) const = default;
+  };
+  struct RenderSettings {
+    unsigned int samplesPerPixel;
+    unsigned int maxRayDepth;
+    bool sortHitsByMaterial;
+    bool wavefront;
+    uint32_t seed;
+    bool operator==(const RenderSettings &) const = default;
+  };
+  struct Resized {};
+  struct RenderFrame {};
+  struct Animate {
+    Animation animation;
+    std::promise<bool> done;
+    unsigned int nextFrame; // first one not written yet, an interrupted batch resumes from there
+  };
+  struct Region {
+    CameraKey camera;
+    glm::uvec2 minCoo;
+    glm::uvec2 maxCoo;
+    unsigned int samples;
+    std::promise<std::vector<color>> result;
+  };
+  struct Stop {};
+  struct Quit {};
+  struct Command {
+    using Payload = std::variant<std::monostate, SceneSettings, ModelSettings, CameraSettings, RenderSettings, Resized,
+                                 RenderFrame, Animate, Region, Stop, Quit>;
+    uint64_t version{0};
+    Payload payload;
+  };
+
+  Utils::SpscQueue<Command, 64> m_commands;
+  uint64_t m_nextVersion{0};               // producer side
+  std::atomic<uint64_t> m_submitted{0};    // last pushed, waited on by the service
+  std::atomic<uint64_t> m_applied{0};      // last applied by the service
+  // last batch the service is done with, scene loading, camera and regions included. When it ended with a Stop
+  // the service is idle until the next command.
+  std::atomic<uint64_t> m_settled{0};
+  std::atomic<uint64_t> m_renderedVersion{0};
+  uint64_t m_frameVersion{0};              // applied when the frame in progress started
+
+  uint64_t Submit(Command::Payload payload);
+  void WaitSettled(uint64_t version) const;
+  // a newer command is waiting, the frame in progress is stale
+  [[nodiscard]] bool Interrupted() const { return m_submitted.load(std::memory_order_relaxed) != m_frameVersion; }
+
+  // ------------------------------------------------------------------ service state
+  Scenes m_sceneType{Scenes::DefaultScene}; // submitted by UpdateScene()
+  std::string m_sceneFilePath{};
+
+  SceneSettings m_activeScene{};
+  ModelSettings m_activeModel{glm::mat4{1.0f}};
+  CameraSettings m_activeCamera{};
+  RenderSettings m_settings{};
+  bool m_sceneLoaded{false};
+  bool m_renderPending{false}; // a frame was asked for (or interrupted) and has not been finished yet
+  bool m_continuous{false};    // re-render after every change, between StartRender() and StopRender()
+  std::optional<Animate> m_animation; // batch in progress, rendered before any other frame
+  std::vector<Region> m_regions;      // received since the last round of the service
+
   HittableObjectList m_scene;
+  std::optional<uint32_t> m_modelInstance; // the instance placed by m_activeModel, in the Cube scene
   void LoadScene();
 
-  RenderState m_state = RenderState::Ready;
+  // kept mapped while rendering, embedded textures point into it
+  std::unique_ptr<SceneFile::MappedFile> m_sceneFile;
+  // decoded on first use, used by the scenes without a texture of their own
+  std::tuple<uint8_t *, int, int> m_earthTexture{nullptr, 0, 0};
+
+  std::atomic<RenderState> m_state = RenderState::Ready;
+  std::atomic<size_t> m_hierarchyBytes{0};
+  std::atomic<float> m_hierarchyBuildTime{0.0f};
+
+  // camera of the loaded scene, rebuilt when the camera settings or the aspect ratio change
+  struct CameraSetup {
+    Camera::CameraOrientation orientation;
+    float verticalFov;
+    float aperture;
+    float focusDist;
+  };
+  CameraSetup m_cameraSetup{};
+  bool m_cameraFollowsSettings{false}; // the scene uses m_activeCamera
+  void RebuildCamera();
+  // camera setup of the scenes that follow the camera settings, from m_activeCamera
+  void FollowCameraSettings();
 
-  // render buffer
-  std::vector<uint8_t> m_renderBuffer{};
+  void Service();
+  // render buffer, its pages are first touched by the workers that render them (see SetImageSize)
+  std::unique_ptr<uint8_t[]> m_renderBuffer{};
 
-  // main rendering thread
+  // render service thread, started by the constructor (after everything else, see Renderer.cpp)
   std::thread m_renderingThread;
-  Utils::Pool m_threadPool{};
+  // transient allocations of a frame (wave radiance), reset when the next one starts.
+  // Declared before the pool so that workers are joined before it goes away
+  Utils::FrameArena m_frameArena{};
+  Utils::Pool m_threadPool;
+  Wavefront m_wavefront{m_threadPool};
+  // pixels per wave, bounds the memory of the path queues
+  static constexpr size_t waveSize = 1 << 18;
 
   // our camera :)
   std::unique_ptr<Camera> m_camera;
@@ -97,14 +282,37 @@ private:
     glm::uvec2 minCoo;
     glm::uvec2 maxCoo;
   };
-  std::vector<Quad> SplitImage(unsigned int quadSize = 100) const;
+  // fills `quads` in place, reusing its storage
+  void SplitImage(std::vector<Quad> &quads, unsigned int quadSize = 100) const;
+  std::vector<Quad> m_quads;
+  std::vector<TileStats> m_tileStats; // written by the workers while rendering
+  // published at the end of a frame, read by the UI
+  mutable std::mutex m_statsMutex;
+  RenderStats m_lastStats{};
+  std::vector<TileStats> m_lastTileStats;
+  float m_lastRenderTime{0.0f};
+  void PublishStats(float milliseconds);
   // actual internal implementation
   void Render();
+  // false when interrupted, the batch then resumes from m_animation->nextFrame
+  bool RenderAnimationFrames();
+  // quads are rendered with `camera` into `buffer`, the render buffer or a frame of a batch
+  void RenderQuad(const Camera &camera, uint8_t *buffer, glm::uvec2 minCoo, glm::uvec2 maxCoo);
+  void RenderQuadSorted(const Camera &camera, uint8_t *buffer, glm::uvec2 minCoo, glm::uvec2 maxCoo);
+  std::vector<color> TraceRegion(const Region &region);
+  // colour of the loaded texture at the same relative position as the pixel, added to every sample
+  [[nodiscard]] color TextureTint(glm::uvec2 pixelCoord) const;
+  // summed radiance of `samples` paths through a pixel
+  color SamplePixel(const Camera &camera, glm::uvec2 pixelCoord, unsigned int samples, std::mt19937 &generator);
+  // camera of an animation key, with the field of view of the loaded scene
+  [[nodiscard]] Camera KeyCamera(const CameraKey &key) const;
+  void RenderWavefront();
   color ShootRay(const Ray &ray, unsigned int depth);
-  void WritePixelToBuffer(unsigned int ix, unsigned int iy,
+  void WritePixelToBuffer(uint8_t *buffer, unsigned int ix, unsigned int iy,
                           unsigned int samples_per_pixel, color pixel_color);
 
   // rng stuff
+  uint32_t m_frameSeed{0}; // of the frame (or batch) in progress, each quad reseeds its worker with it
   std::mt19937 m_rnGenerator{};
   std::uniform_real_distribution<float> m_unifDistribution{0.0f, 1.0f};
 
@@ -0,0 +1,466 @@
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "Renderer/SceneFile.h"
+#include "stb/stb_image.h"
+
+template <class... Ts> struct overloaded : Ts... {
+  using Ts::operator()...;
+};
+// explicit deduction guide (not needed as of C++20)
+template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+namespace RTIAW::Render::SceneFile {
+namespace {
+constexpr uint64_t AlignUp(const uint64_t value) { return (value + alignment - 1) & ~uint64_t{alignment - 1}; }
+
+void StoreVec3(float *dst, const vec3 &v) {
+  dst[0] = v.x;
+  dst[1] = v.y;
+  dst[2] = v.z;
+}
+vec3 LoadVec3(const float *src) { return {src[0], src[1], src[2]}; }
+
+ShapeRecord ToRecord(const HittableObject &object) {
+  ShapeRecord record{};
+  record.material = static_cast<uint32_t>(object.MaterialIndex());
+
+  const auto storeVertices = [&record](const Shapes::Parallelogram &shape) {
+    const auto vertices = shape.Vertices();
+    for (size_t i = 0; i < 3; ++i)
+      StoreVec3(record.data + 3 * i, vertices[i]);
+  };
+
+  std::visit(overloaded{
+                 [&](const Shapes::Sphere &shape) {
+                   record.type = ShapeType::Sphere;
+                   StoreVec3(record.data, shape.m_center);
+                   record.data[3] = shape.m_radius;
+                 },
+                 [&](const Shapes::Plane &shape) {
+                   record.type = ShapeType::Plane;
+                   StoreVec3(record.data, shape.Origin());
+                   StoreVec3(record.data + 3, shape.Normal());
+                 },
+                 [&](const Shapes::Parallelogram &shape) {
+                   record.type = ShapeType::Parallelogram;
+                   storeVertices(shape);
+                 },
+                 [&](const Shapes::Rectangle &shape) {
+                   record.type = ShapeType::Rectangle;
+                   storeVertices(shape);
+                 },
+                 [&](const Shapes::Cube &shape) {
+                   record.type = ShapeType::Cube;
+                   StoreVec3(record.data, shape.Center());
+                   StoreVec3(record.data + 3, shape.HalfExtent());
+                   StoreVec3(record.data + 6, shape.Axes()[0]);
+                   StoreVec3(record.data + 9, shape.Axes()[1]);
+                 },
+             },
+             object.GetShape());
+
+  return record;
+}
+
+Shape ToShape(const ShapeRecord &record) {
+  const float *d = record.data;
+  const std::array<point3, 3> vertices{LoadVec3(d), LoadVec3(d + 3), LoadVec3(d + 6)};
+
+  switch (record.type) {
+  case ShapeType::Sphere:
+    return Shapes::Sphere(LoadVec3(d), d[3]);
+  case ShapeType::Plane:
+    return Shapes::Plane(LoadVec3(d), LoadVec3(d + 3));
+  case ShapeType::Parallelogram:
+    return Shapes::Parallelogram(vertices);
+  case ShapeType::Rectangle:
+    return Shapes::Rectangle(vertices);
+  case ShapeType::Cube: {
+    const vec3 x = LoadVec3(d + 6);
+    const vec3 y = LoadVec3(d + 9);
+    return Shapes::Cube(LoadVec3(d), LoadVec3(d + 3), glm::mat3{x, y, glm::cross(x, y)});
+  }
+  }
+  throw std::runtime_error("SceneFile: unknown shape type");
+}
+
+MaterialRecord ToRecord(const Material &material) {
+  MaterialRecord record{};
+  std::visit(overloaded{
+                 [&](const Materials::Lambertian &mat) {
+                   record.type = MaterialType::Lambertian;
+                   StoreVec3(record.data, mat.m_albedo);
+                 },
+                 [&](const Materials::Metal &mat) {
+                   record.type = MaterialType::Metal;
+                   StoreVec3(record.data, mat.Albedo());
+                   record.data[3] = mat.Fuzzyness();
+                 },
+                 [&](const Materials::Dielectric &mat) {
+                   record.type = MaterialType::Dielectric;
+                   record.data[0] = mat.RefractionIndex();
+                 },
+             },
+             material);
+  return record;
+}
+
+Material ToMaterial(const MaterialRecord &record) {
+  const float *d = record.data;
+  switch (record.type) {
+  case MaterialType::Lambertian:
+    return Materials::Lambertian(LoadVec3(d));
+  case MaterialType::Metal:
+    return Materials::Metal(LoadVec3(d), d[3]);
+  case MaterialType::Dielectric:
+    return Materials::Dielectric(d[0]);
+  }
+  throw std::runtime_error("SceneFile: unknown material type");
+}
+
+constexpr size_t recordSizes[SectionCount] = {sizeof(ShapeRecord), sizeof(MaterialRecord), sizeof(TextureRecord),
+                                              1, sizeof(BVH::Node)};
+} // namespace
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef _WIN32
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  if (!file)
+    throw std::runtime_error(fmt::format("SceneFile: can't open {}", path));
+  m_fallback.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(m_fallback.data()), static_cast<std::streamsize>(m_fallback.size()));
+  m_data = m_fallback.data();
+  m_size = m_fallback.size();
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(fmt::format("SceneFile: can't open {}", path));
+
+  struct stat info {};
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    throw std::runtime_error(fmt::format("SceneFile: {} is empty or unreadable", path));
+  }
+
+  m_size = static_cast<size_t>(info.st_size);
+  void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error(fmt::format("SceneFile: can't map {}", path));
+
+  madvise(mapping, m_size, MADV_WILLNEED);
+  m_data = static_cast<const std::byte *>(mapping);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (m_data)
+    munmap(const_cast<std::byte *>(m_data), m_size);
+#endif
+}
+
+View::View(const std::byte *data, const size_t size) : m_data{data}, m_size{size} {
+  if (size < sizeof(Header))
+    throw std::runtime_error("SceneFile: file is too small");
+
+  const Header &header = GetHeader();
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+    throw std::runtime_error("SceneFile: not a scene file");
+  // version 1 stored cubes without their placement, there is nothing to convert them from
+  if (header.version == 1)
+    throw std::runtime_error("SceneFile: version 1 files have no cube parameters, convert the text scene again");
+  if (header.version != version || header.headerSize != sizeof(Header))
+    throw std::runtime_error(fmt::format("SceneFile: unsupported version {} (expected {})", header.version, version));
+  if (header.fileSize != size)
+    throw std::runtime_error("SceneFile: truncated file");
+
+  for (uint32_t section = 0; section < SectionCount; ++section) {
+    const auto &[offset, count] = header.sections[section];
+    if (offset % alignment != 0 || offset > size || count > (size - offset) / recordSizes[section])
+      throw std::runtime_error(fmt::format("SceneFile: section {} is out of bounds", section));
+  }
+
+  if (header.boundedCount > Shapes().size())
+    throw std::runtime_error("SceneFile: invalid hierarchy");
+
+  const uint64_t pixelBytes = header.sections[PixelsSection].count;
+  for (const auto &texture : Textures()) {
+    const uint64_t bytes = 4ull * texture.width * texture.height;
+    if (texture.pixelOffset > pixelBytes || bytes > pixelBytes - texture.pixelOffset)
+      throw std::runtime_error("SceneFile: texture is out of bounds");
+  }
+}
+
+TextureImage View::Texture(const size_t index) const {
+  const auto &record = Textures()[index];
+  const auto *pixels = reinterpret_cast<const uint8_t *>(m_data + GetHeader().sections[PixelsSection].offset);
+  return {record.width, record.height, pixels + record.pixelOffset};
+}
+
+std::vector<std::byte> Serialize(const HittableObjectList &scene, const CameraRecord &camera,
+                                 const std::vector<TextureImage> &textures) {
+  const auto &objects = scene.GetObjects();
+  const auto &materials = scene.GetMaterials();
+  if (scene.Layout() != BVHLayout::Binary)
+    throw std::runtime_error("SceneFile: scenes are written with a binary hierarchy");
+  const auto &nodes = scene.GetBVH().Nodes();
+
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.headerSize = sizeof(Header);
+  header.boundedCount = scene.BoundedCount();
+  header.camera = camera;
+
+  uint64_t pixelBytes = 0;
+  for (const auto &texture : textures)
+    pixelBytes += 4ull * texture.width * texture.height;
+
+  const uint64_t counts[SectionCount] = {objects.size(), materials.size(), textures.size(), pixelBytes, nodes.size()};
+  uint64_t offset = AlignUp(sizeof(Header));
+  for (uint32_t section = 0; section < SectionCount; ++section) {
+    header.sections[section] = {offset, counts[section]};
+    offset = AlignUp(offset + counts[section] * recordSizes[section]);
+  }
+  header.fileSize = offset;
+
+  std::vector<std::byte> image(offset);
+  std::byte *base = image.data();
+  std::memcpy(base, &header, sizeof(header));
+
+  auto *shapeRecords = reinterpret_cast<ShapeRecord *>(base + header.sections[ShapesSection].offset);
+  for (size_t i = 0; i < objects.size(); ++i)
+    shapeRecords[i] = ToRecord(objects[i]);
+
+  auto *materialRecords = reinterpret_cast<MaterialRecord *>(base + header.sections[MaterialsSection].offset);
+  for (size_t i = 0; i < materials.size(); ++i)
+    materialRecords[i] = ToRecord(materials[i]);
+
+  auto *textureRecords = reinterpret_cast<TextureRecord *>(base + header.sections[TexturesSection].offset);
+  auto *pixels = reinterpret_cast<uint8_t *>(base + header.sections[PixelsSection].offset);
+  uint64_t pixelOffset = 0;
+  for (size_t i = 0; i < textures.size(); ++i) {
+    const uint64_t bytes = 4ull * textures[i].width * textures[i].height;
+    textureRecords[i] = {textures[i].width, textures[i].height, pixelOffset};
+    std::memcpy(pixels + pixelOffset, textures[i].pixels, bytes);
+    pixelOffset += bytes;
+  }
+
+  if (!nodes.empty())
+    std::memcpy(base + header.sections[NodesSection].offset, nodes.data(), nodes.size() * sizeof(BVH::Node));
+
+  return image;
+}
+
+void Write(const std::string &path, const std::span<const std::byte> image) {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file)
+    throw std::runtime_error(fmt::format("SceneFile: can't write {}", path));
+  file.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+}
+
+CameraRecord Load(const View &view, HittableObjectList &scene) {
+  const auto materialRecords = view.Materials();
+  std::vector<Material> materials;
+  materials.reserve(materialRecords.size());
+  for (const auto &record : materialRecords)
+    materials.push_back(ToMaterial(record));
+
+  const auto shapeRecords = view.Shapes();
+  std::vector<HittableObject> objects;
+  objects.reserve(shapeRecords.size());
+  for (const auto &record : shapeRecords) {
+    if (record.material >= materials.size())
+      throw std::runtime_error("SceneFile: invalid material index");
+    objects.emplace_back(ToShape(record), record.material);
+  }
+
+  const auto nodes = view.Nodes();
+  const uint64_t boundedCount = view.GetHeader().boundedCount;
+  if (!BVH::IsValid(nodes, boundedCount))
+    throw std::runtime_error("SceneFile: invalid hierarchy");
+
+  scene.Assign(std::move(objects), std::move(materials), {begin(nodes), end(nodes)}, boundedCount);
+  return view.GetHeader().camera;
+}
+
+Camera::CameraOrientation Orientation(const CameraRecord &camera) {
+  return {LoadVec3(camera.lookfrom), LoadVec3(camera.lookat), LoadVec3(camera.vup)};
+}
+
+void ConvertText(const std::string &textPath, const std::string &binaryPath) {
+  std::ifstream in{textPath};
+  if (!in)
+    throw std::runtime_error(fmt::format("SceneFile: can't open {}", textPath));
+
+  HittableObjectList scene;
+  std::unordered_map<std::string, Material> materials;
+  CameraRecord camera{{13.0f, 2.0f, 3.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, 20.0f, 0.1f, 0.0f};
+
+  using ImagePtr = std::unique_ptr<uint8_t, decltype(&stbi_image_free)>;
+  std::vector<ImagePtr> images;
+  std::vector<TextureImage> textures;
+
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+    const auto fail = [&](const std::string &what) {
+      return std::runtime_error(fmt::format("{}:{}: {}", textPath, lineNumber, what));
+    };
+
+    if (const auto comment = line.find('#'); comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream tokens{line};
+    std::string keyword;
+    if (!(tokens >> keyword))
+      continue;
+
+    const auto readFloats = [&](float *dst, size_t n) {
+      for (size_t i = 0; i < n; ++i)
+        if (!(tokens >> dst[i]))
+          throw fail(fmt::format("'{}' expects {} numbers", keyword, n));
+    };
+    const auto readMaterial = [&]() -> const Material & {
+      std::string name;
+      tokens >> name;
+      const auto it = materials.find(name);
+      if (it == end(materials))
+        throw fail(fmt::format("unknown material '{}'", name));
+      return it->second;
+    };
+    const auto readVertices = [&]() {
+      float d[9];
+      readFloats(d, 9);
+      return std::array<point3, 3>{LoadVec3(d), LoadVec3(d + 3), LoadVec3(d + 6)};
+    };
+
+    if (keyword == "camera") {
+      std::string key;
+      while (tokens >> key) {
+        if (key == "lookfrom")
+          readFloats(camera.lookfrom, 3);
+        else if (key == "lookat")
+          readFloats(camera.lookat, 3);
+        else if (key == "vup")
+          readFloats(camera.vup, 3);
+        else if (key == "fov")
+          readFloats(&camera.verticalFov, 1);
+        else if (key == "aperture")
+          readFloats(&camera.aperture, 1);
+        else if (key == "focus")
+          readFloats(&camera.focusDist, 1);
+        else
+          throw fail(fmt::format("unknown camera property '{}'", key));
+      }
+    } else if (keyword == "material") {
+      std::string name, type;
+      tokens >> name >> type;
+      float d[4];
+      if (type == "lambertian") {
+        readFloats(d, 3);
+        materials.insert_or_assign(name, Materials::Lambertian(LoadVec3(d)));
+      } else if (type == "metal") {
+        readFloats(d, 4);
+        materials.insert_or_assign(name, Materials::Metal(LoadVec3(d), d[3]));
+      } else if (type == "dielectric") {
+        readFloats(d, 1);
+        materials.insert_or_assign(name, Materials::Dielectric(d[0]));
+      } else {
+        throw fail(fmt::format("unknown material type '{}'", type));
+      }
+    } else if (keyword == "texture") {
+      std::string path;
+      tokens >> path;
+      int width, height, channels;
+      images.emplace_back(stbi_load(path.c_str(), &width, &height, &channels, 4), &stbi_image_free);
+      if (!images.back())
+        throw fail(fmt::format("can't load texture '{}'", path));
+      textures.push_back({static_cast<uint32_t>(width), static_cast<uint32_t>(height), images.back().get()});
+    } else if (keyword == "sphere") {
+      const Material &material = readMaterial();
+      float d[4];
+      readFloats(d, 4);
+      scene.Add(Shapes::Sphere(LoadVec3(d), d[3]), material);
+    } else if (keyword == "plane") {
+      const Material &material = readMaterial();
+      float d[6];
+      readFloats(d, 6);
+      scene.Add(Shapes::Plane(LoadVec3(d), LoadVec3(d + 3)), material);
+    } else if (keyword == "parallelogram") {
+      const Material &material = readMaterial();
+      scene.Add(Shapes::Parallelogram(readVertices()), material);
+    } else if (keyword == "rectangle") {
+      const Material &material = readMaterial();
+      scene.Add(Shapes::Rectangle(readVertices()), material);
+    } else if (keyword == "cube") {
+      const Material &material = readMaterial();
+      std::string form;
+      if (!(tokens >> form)) {
+        scene.Add(Shapes::Cube(), material);
+        continue;
+      }
+
+      float d[12];
+      const auto expect = [&](const char *key) {
+        std::string token;
+        if (!(tokens >> token) || token != key)
+          throw fail(fmt::format("'cube {}' expects '{}' next", form, key));
+      };
+      if (form == "min") {
+        readFloats(d, 3);
+        expect("max");
+        readFloats(d + 3, 3);
+        if (const vec3 size = LoadVec3(d + 3) - LoadVec3(d); size.x <= 0 || size.y <= 0 || size.z <= 0)
+          throw fail("cube max has to be above min on every axis");
+        scene.Add(Shapes::Cube(LoadVec3(d), LoadVec3(d + 3)), material);
+      } else if (form == "center") {
+        readFloats(d, 3);
+        expect("halfExtent");
+        readFloats(d + 3, 3);
+        expect("axes");
+        readFloats(d + 6, 6);
+        if (d[3] <= 0 || d[4] <= 0 || d[5] <= 0)
+          throw fail("cube halfExtent has to be positive");
+        const vec3 x = LoadVec3(d + 6);
+        const vec3 y = LoadVec3(d + 9);
+        if (glm::dot(x, x) == 0 || glm::dot(y, y) == 0 ||
+            std::abs(glm::dot(glm::normalize(x), glm::normalize(y))) > 1e-4f)
+          throw fail("cube axes have to be orthogonal");
+        const vec3 xAxis = glm::normalize(x);
+        const vec3 yAxis = glm::normalize(y);
+        scene.Add(Shapes::Cube(LoadVec3(d), LoadVec3(d + 3), glm::mat3{xAxis, yAxis, glm::cross(xAxis, yAxis)}),
+                  material);
+      } else {
+        throw fail(fmt::format("unknown cube form '{}', expected 'min' or 'center'", form));
+      }
+    } else {
+      throw fail(fmt::format("unknown keyword '{}'", keyword));
+    }
+  }
+
+  if (camera.focusDist <= 0.0f)
+    camera.focusDist = glm::length(LoadVec3(camera.lookfrom) - LoadVec3(camera.lookat));
+
+  // built once, loaded many times
+  scene.SetBuilder(BVHBuilder::BinnedSAH);
+  scene.Build();
+  Write(binaryPath, Serialize(scene, camera, textures));
+}
+} // namespace RTIAW::Render::SceneFile
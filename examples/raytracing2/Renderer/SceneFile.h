@@ -0,0 +1,132 @@
+#ifndef RTIAW_scenefile
+#define RTIAW_scenefile
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Renderer/Camera.h"
+#include "Renderer/HittableObjectList.h"
+
+namespace RTIAW::Render::SceneFile {
+// Versioned binary scene format.
+//
+// A scene file is a header followed by 64 byte aligned sections of fixed size records: shapes, materials,
+// embedded RGBA8 textures and the prebuilt BVH nodes. Nothing in it needs parsing, a mapped file is used in
+// place. Shapes are stored in hierarchy order, the unbounded ones (planes) after the first `boundedCount`.
+//
+// The human readable form (*.rtscene) is converted with ConvertText(), see scenes/ for the syntax.
+constexpr char magic[8] = {'R', 'T', 'I', 'A', 'W', 'S', 'C', 'N'};
+constexpr uint32_t version = 2; // 2: cubes carry their center, extent and axes
+constexpr size_t alignment = 64;
+
+enum class ShapeType : uint32_t { Sphere, Plane, Parallelogram, Rectangle, Cube };
+enum class MaterialType : uint32_t { Lambertian, Metal, Dielectric };
+enum Section : uint32_t { ShapesSection, MaterialsSection, TexturesSection, PixelsSection, NodesSection, SectionCount };
+
+struct SectionEntry {
+  uint64_t offset; // from the start of the file
+  uint64_t count;  // number of records, bytes for the pixel section
+};
+
+struct CameraRecord {
+  float lookfrom[3];
+  float lookat[3];
+  float vup[3];
+  float verticalFov;
+  float aperture;
+  float focusDist;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t fileSize;
+  uint64_t boundedCount;
+  SectionEntry sections[SectionCount];
+  CameraRecord camera;
+};
+
+struct ShapeRecord {
+  ShapeType type;
+  uint32_t material;
+  // Sphere: center, radius. Plane: point, normal. Parallelogram/Rectangle: three vertices.
+  // Cube: center, half extent, x and y axes.
+  float data[14];
+};
+
+struct MaterialRecord {
+  MaterialType type;
+  // Lambertian: albedo. Metal: albedo, fuzzyness. Dielectric: refraction index.
+  float data[7];
+};
+
+struct TextureRecord {
+  uint32_t width;
+  uint32_t height;
+  uint64_t pixelOffset; // RGBA8 pixels, from the start of the pixel section
+};
+
+static_assert(sizeof(ShapeRecord) == 64 && sizeof(MaterialRecord) == 32 && sizeof(TextureRecord) == 16);
+
+struct TextureImage {
+  uint32_t width;
+  uint32_t height;
+  const uint8_t *pixels; // RGBA8
+};
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  [[nodiscard]] const std::byte *Data() const { return m_data; }
+  [[nodiscard]] size_t Size() const { return m_size; }
+
+private:
+  const std::byte *m_data{nullptr};
+  size_t m_size{0};
+  std::vector<std::byte> m_fallback{}; // used where mmap is not available
+};
+
+// Validated, typed access to a scene image, either a mapped file or a buffer from Serialize()
+class View {
+public:
+  View(const std::byte *data, size_t size);
+
+  [[nodiscard]] const Header &GetHeader() const { return *reinterpret_cast<const Header *>(m_data); }
+  [[nodiscard]] std::span<const ShapeRecord> Shapes() const { return Records<ShapeRecord>(ShapesSection); }
+  [[nodiscard]] std::span<const MaterialRecord> Materials() const { return Records<MaterialRecord>(MaterialsSection); }
+  [[nodiscard]] std::span<const TextureRecord> Textures() const { return Records<TextureRecord>(TexturesSection); }
+  [[nodiscard]] std::span<const BVH::Node> Nodes() const { return Records<BVH::Node>(NodesSection); }
+  [[nodiscard]] TextureImage Texture(size_t index) const;
+
+private:
+  const std::byte *m_data;
+  size_t m_size;
+
+  template <typename T> [[nodiscard]] std::span<const T> Records(Section section) const {
+    const auto &entry = GetHeader().sections[section];
+    return {reinterpret_cast<const T *>(m_data + entry.offset), static_cast<size_t>(entry.count)};
+  }
+};
+
+[[nodiscard]] std::vector<std::byte> Serialize(const HittableObjectList &scene, const CameraRecord &camera,
+                                               const std::vector<TextureImage> &textures = {});
+void Write(const std::string &path, std::span<const std::byte> image);
+
+// Fills `scene` with the content of the file, hierarchy included, and returns its camera
+CameraRecord Load(const View &view, HittableObjectList &scene);
+[[nodiscard]] Camera::CameraOrientation Orientation(const CameraRecord &camera);
+
+// Reads a *.rtscene description and writes its binary form
+void ConvertText(const std::string &textPath, const std::string &binaryPath);
+} // namespace RTIAW::Render::SceneFile
+
+#endif
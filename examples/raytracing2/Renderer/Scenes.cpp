@@ -3,6 +3,7 @@
 #include <glm/ext/quaternion_geometric.hpp>
 #include <glm/ext/quaternion_transform.hpp>
 #include <glm/fwd.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/random.hpp>
 #include <glm/trigonometric.hpp>
 
@@ -18,9 +19,15 @@
 
 namespace RTIAW::Render {
 void Renderer::LoadScene() {
+  RTIAW_TRACE_SCOPE("LoadScene");
   m_scene.Clear();
+  m_scene.SetLayout(m_activeScene.bvhLayout);
+  m_scene.SetBuilder(m_activeScene.bvhBuilder);
+  m_TextureData = m_earthTexture;
+  m_cameraFollowsSettings = false;
+  m_modelInstance.reset();
 
-  switch (m_sceneType) {
+  switch (m_activeScene.scene) {
   case Scenes::DefaultScene: {
     Camera::CameraOrientation orientation{point3(13, 2, 3), point3(0, 0, 0),
                                           vec3(0, 1, 0)};
@@ -28,14 +35,21 @@ void Renderer::LoadScene() {
     constexpr auto dist_to_focus = 10.0f;
     constexpr auto aperture = 0.1f;
 
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
+    m_cameraSetup = {orientation, 20.0f, aperture, dist_to_focus};
 
     // m_scene.Add(Shapes::Sphere(point3(0, -1000, 0), 1000.0f),
     // Materials::Lambertian(color(0.5, 0.5, 0.5)));
     m_scene.Add(Shapes::Plane(point3(0, 0, 0), glm::vec3(0, 1, 0)),
                 Materials::Lambertian(color(0.5, 0.5, 0.5)));
 
+    // the small spheres are instances of a single unit sphere, each with its own material
+    HittableObjectList unitSphere;
+    unitSphere.Add(Shapes::Sphere(point3(0, 0, 0), 1.0f), Materials::Lambertian(color(0.5, 0.5, 0.5)));
+    const auto sphere = m_scene.AddPrototype(unitSphere);
+    const auto placement = [](const point3 &center) {
+      return glm::scale(glm::translate(glm::mat4{1.0f}, center), vec3(0.2f));
+    };
+
     for (int a = -11; a < 11; a++) {
       for (int b = -11; b < 11; b++) {
         const auto choose_mat = m_unifDistribution(m_rnGenerator);
@@ -49,20 +63,20 @@ void Renderer::LoadScene() {
                             m_unifDistribution(m_rnGenerator),
                             m_unifDistribution(m_rnGenerator)};
             auto albedo = randColor * randColor;
-            m_scene.Add(Shapes::Sphere(center, 0.2f),
-                        Materials::Lambertian(albedo));
+            m_scene.AddInstance(sphere, placement(center),
+                                Materials::Lambertian(albedo));
           } else if (choose_mat < 0.95f) {
             // metal
             color albedo{0.5f * (1.0f + m_unifDistribution(m_rnGenerator)),
                          0.5f * (1.0f + m_unifDistribution(m_rnGenerator)),
                          0.5f * (1.0f + m_unifDistribution(m_rnGenerator))};
             auto fuzz = 0.5f * m_unifDistribution(m_rnGenerator);
-            m_scene.Add(Shapes::Sphere(center, 0.2f),
-                        Materials::Metal(albedo, fuzz));
+            m_scene.AddInstance(sphere, placement(center),
+                                Materials::Metal(albedo, fuzz));
           } else {
             // glass
-            m_scene.Add(Shapes::Sphere(center, 0.2f),
-                        Materials::Dielectric(1.5f));
+            m_scene.AddInstance(sphere, placement(center),
+                                Materials::Dielectric(1.5f));
           }
         }
       }
@@ -82,8 +96,7 @@ void Renderer::LoadScene() {
     const auto dist_to_focus = std::sqrt(glm::dot(lookDir, lookDir));
     constexpr auto aperture = 0.5f;
 
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
+    m_cameraSetup = {orientation, 20.0f, aperture, dist_to_focus};
 
     auto R = std::cos(Utils::pi / 4);
     m_scene.Add(Shapes::Sphere(point3(0.0, -100.5, -1.0), 100.0f),
@@ -107,8 +120,7 @@ void Renderer::LoadScene() {
     const auto dist_to_focus = std::sqrt(glm::dot(lookDir, lookDir));
     constexpr auto aperture = 0.1f;
 
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
+    m_cameraSetup = {orientation, 20.0f, aperture, dist_to_focus};
 
     auto material = Materials::Lambertian(color(0.8, 0.2, 0.1));
     m_scene.Add(Shapes::Sphere(point3(-1, 0, 0), 1.0f), material);
@@ -141,8 +153,7 @@ void Renderer::LoadScene() {
     const auto dist_to_focus = std::sqrt(glm::dot(lookDir, lookDir));
     constexpr auto aperture = 0.1f;
 
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
+    m_cameraSetup = {orientation, 20.0f, aperture, dist_to_focus};
 
     auto material = Materials::Lambertian(color(0.8, 0.2, 0.1));
 
@@ -161,8 +172,7 @@ void Renderer::LoadScene() {
     const auto dist_to_focus = std::sqrt(glm::dot(lookDir, lookDir));
     constexpr auto aperture = 0.1f;
 
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
+    m_cameraSetup = {orientation, 20.0f, aperture, dist_to_focus};
 
     auto material = Materials::Lambertian(color(0.8, 0.2, 0.1));
 
@@ -174,35 +184,47 @@ void Renderer::LoadScene() {
   } break;
   case Scenes::Cube: {
 
-    // NOTE: default Camera
-    Camera::CameraOrientation orientation{lookfrom, lookat, vec3(0, 1, 0)};
-
-    const auto lookDir = orientation.lookfrom - orientation.lookat;
-    const auto dist_to_focus = std::sqrt(glm::dot(lookDir, lookDir));
-
-    m_camera = std::make_unique<Camera>(orientation, 20.0f, AspectRatio(),
-                                        aperture, dist_to_focus);
-    auto material = Materials::Lambertian(material_color);
-
-    // make the cube rotate according mvp matrix while time collapsed
-    lastRenderTime = timer->ElapsedMillis();
+    // NOTE: default Camera, follows the camera settings
+    FollowCameraSettings();
+    auto material = Materials::Lambertian(m_activeScene.materialColor);
 
-    m_camera->OnResize(m_imageSize[0], m_imageSize[1]);
-
-    Shapes::Cube cube{};
-    auto rectangles = cube.GetRectangles();
-    for (auto &rect : rectangles) {
-      m_scene.Add(rect, material);
-    }
+    // one instance of the cube, placed by the model matrix
+    HittableObjectList cubeGeometry;
+    cubeGeometry.Add(Shapes::Cube{}, material);
+    m_modelInstance = m_scene.AddInstance(m_scene.AddPrototype(cubeGeometry), m_activeModel.model);
 
     auto plane_material = Materials::Lambertian(color(0.6, 0.6, 0.6));
     m_scene.Add(Shapes::Plane(point3(0.0, -1.2, 0.0), glm::vec3(0.0, 1.0, 0.0)),
                 plane_material);
   } break;
+  case Scenes::FromFile: {
+    auto file = std::make_unique<SceneFile::MappedFile>(m_activeScene.file);
+    const SceneFile::View view{file->Data(), file->Size()};
+
+    const auto camera = SceneFile::Load(view, m_scene);
+    m_cameraSetup = {SceneFile::Orientation(camera), camera.verticalFov, camera.aperture, camera.focusDist};
+
+    if (!view.Textures().empty()) {
+      const auto texture = view.Texture(0);
+      m_TextureData = {const_cast<uint8_t *>(texture.pixels), texture.width, texture.height};
+    }
+    m_sceneFile = std::move(file);
+  } break;
   default:
     throw(std::runtime_error("Invalid scene selected"));
     break;
   }
+
+  // scene files come with their hierarchy already built, the pool is idle until the first frame
+  Walnut::Timer buildTimer;
+  if (!m_scene.HasHierarchy()) {
+    RTIAW_TRACE_SCOPE("BuildHierarchy");
+    m_scene.Build(&m_threadPool);
+  }
+  m_hierarchyBuildTime = buildTimer.ElapsedMillis();
+  m_hierarchyBytes = m_scene.HierarchyBytes();
+
+  RebuildCamera();
 }
 
 } // namespace RTIAW::Render
@@ -1,63 +1,131 @@
 #include "Renderer/Shapes/Cube.h"
-#include "Renderer/HittableObject.h"
-#include "Renderer/Shapes/Plane.h"
-#include <array>
-#include <optional>
-
-#include "Renderer/HitRecord.h"
-#include "Renderer/Shapes/Rectangle.h"
-#include "Renderer/Utils.h"
-
-template <class... Ts> struct overloaded : Ts... {
-  using Ts::operator()...;
-};
-// explicit deduction guide (not needed as of C++20)
-template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
-using RTIAW::Render::point3;
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <glm/matrix.hpp>
 
 namespace RTIAW::Render::Shapes {
+Cube::Cube(const point3 min, const point3 max) : m_center{0.5f * (min + max)}, m_halfExtent{0.5f * (max - min)} {
+  if (m_halfExtent.x <= 0 || m_halfExtent.y <= 0 || m_halfExtent.z <= 0) {
+    throw std::runtime_error("Cube::Cube: the given corners do not define a box.");
+  }
+}
+
+Cube::Cube(const point3 center, const vec3 halfExtent, const glm::mat3 &axes)
+    : m_center{center}, m_halfExtent{halfExtent}, m_axes{axes}, m_oriented{axes != glm::mat3{1.0f}} {
+  if (m_halfExtent.x <= 0 || m_halfExtent.y <= 0 || m_halfExtent.z <= 0) {
+    throw std::runtime_error("Cube::Cube: the given extent does not define a box.");
+  }
+}
+
+Cube::Cube(const std::array<point3, 8> points) {
+  // edges leaving the -x -y -z corner
+  const vec3 edges[3] = {points[5] - points[4], points[7] - points[4], points[0] - points[4]};
+
+  constexpr float tolerance = 1e-4f;
+  for (int i = 0; i < 3; i++) {
+    const auto &a = edges[i];
+    const auto &b = edges[(i + 1) % 3];
+    if (glm::dot(a, a) == 0 || std::abs(glm::dot(glm::normalize(a), glm::normalize(b))) > tolerance) {
+      throw std::runtime_error("Cube::Cube: the given points do not define a cube plane.");
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    m_halfExtent[i] = 0.5f * glm::length(edges[i]);
+    m_axes[i] = glm::normalize(edges[i]);
+  }
+  m_center = points[4] + 0.5f * (edges[0] + edges[1] + edges[2]);
+  m_oriented = m_axes != glm::mat3{1.0f};
+}
 
-Cube::Cube() {
+std::array<point3, 8> Cube::GetVertices() const {
+  std::array<point3, 8> vertices;
   for (int i = 0; i < 8; i++) {
-    m_vertices[i].x = CUBEVERTICES[i * 3];
-    m_vertices[i].y = CUBEVERTICES[i * 3 + 1];
-    m_vertices[i].z = CUBEVERTICES[i * 3 + 2];
+    // CUBEVERTICES is the unit cube, i.e. +-0.5 along each axis
+    const vec3 local = 2.0f * m_halfExtent * vec3{CUBEVERTICES[i * 3], CUBEVERTICES[i * 3 + 1], CUBEVERTICES[i * 3 + 2]};
+    vertices[i] = m_center + m_axes * local;
   }
+  return vertices;
+}
 
+std::vector<Shapes::Rectangle> Cube::GetRectangles() const {
+  const auto vertices = GetVertices();
+  std::vector<Shapes::Rectangle> rectangles;
   for (int i = 0; i < 6; i++) {
-    m_rectangles.push_back(Shapes::Rectangle({
-        m_vertices[CUBEINDEX[i][0]],
-        m_vertices[CUBEINDEX[i][1]],
-        m_vertices[CUBEINDEX[i][2]],
+    rectangles.push_back(Shapes::Rectangle({
+        vertices[CUBEINDEX[i][0]],
+        vertices[CUBEINDEX[i][1]],
+        vertices[CUBEINDEX[i][2]],
     }));
   }
-};
-
-Cube::Cube(std::array<point3, 8> points) {
+  return rectangles;
+}
 
-  for (int i = 0; i < 6; i++) {
-    if (glm::dot(points[CUBEINDEX[i][0]], points[CUBEINDEX[i][1]]) == 0 &&
-        glm::dot(points[CUBEINDEX[i][0]], points[CUBEINDEX[i][2]]) == 0) {
-      m_rectangles.push_back(Shapes::Rectangle({
-          points[CUBEINDEX[i][0]],
-          points[CUBEINDEX[i][1]],
-          points[CUBEINDEX[i][2]],
-      }));
-    } else {
-      throw std::runtime_error(
-          "Cube::Cube: the given points do not define a cube plane.");
-    }
+Ray Cube::ToLocal(const Ray &r) const {
+  if (!m_oriented) {
+    // same direction, the precomputed inverse and signs still hold
+    Ray local = r;
+    local.origin -= m_center;
+    return local;
   }
-};
+  const glm::mat3 toLocal = glm::transpose(m_axes);
+  return Ray{toLocal * (r.origin - m_center), toLocal * r.direction};
+}
 
 float Cube::FastHit(const Ray &r, const float t_min, const float t_max) const {
+  const Ray local = ToLocal(r);
+  const vec3 bounds[2] = {-m_halfExtent, m_halfExtent};
+
+  // Slab test. The sign of the direction picks the near and far plane of each slab, so there's no need to sort the
+  // two distances: a min/max over three axes is all that's left
+  const float tEnter =
+      std::max({(bounds[local.sign[0]].x - local.origin.x) * local.inverseDirection.x,
+                (bounds[local.sign[1]].y - local.origin.y) * local.inverseDirection.y,
+                (bounds[local.sign[2]].z - local.origin.z) * local.inverseDirection.z});
+  const float tExit =
+      std::min({(bounds[1 - local.sign[0]].x - local.origin.x) * local.inverseDirection.x,
+                (bounds[1 - local.sign[1]].y - local.origin.y) * local.inverseDirection.y,
+                (bounds[1 - local.sign[2]].z - local.origin.z) * local.inverseDirection.z});
 
-};
+  // rays starting inside the box (e.g. refracted ones) hit its far side
+  const float t = tEnter >= t_min ? tEnter : tExit;
+  return (tEnter <= tExit && t >= t_min && t <= t_max) ? t : std::numeric_limits<float>::max();
+}
 
 HitRecord Cube::ComputeHitRecord(const Ray &r, const float t) const {
+  HitRecord result{};
+  result.t = t;
+  result.p = r.At(t);
 
-};
+  // the face hit is the one along the axis where the point is relatively farthest from the center
+  const vec3 relative = (m_oriented ? glm::transpose(m_axes) * (result.p - m_center) : result.p - m_center) / m_halfExtent;
+  const vec3 distance = glm::abs(relative);
+  const int axis = (distance.x > distance.y && distance.x > distance.z) ? 0 : (distance.y > distance.z ? 1 : 2);
+  const vec3 outward_normal = m_axes[axis] * (relative[axis] < 0 ? -1.0f : 1.0f);
+
+  result.SetFaceNormal(r, outward_normal);
+
+  return result;
+}
+
+std::optional<HitRecord> Cube::Hit(const Ray &r, const float t_min, const float t_max) const {
+  static constexpr std::optional<HitRecord> empty_result{};
+
+  if (const auto t = FastHit(r, t_min, t_max); t < std::numeric_limits<float>::max()) {
+    return ComputeHitRecord(r, t);
+  } else {
+    return empty_result;
+  }
+}
 
-std::optional<HitRecord> Cube::Hit(const Ray &r, const float t_min,
-                                   const float t_max) const {};
+AABB Cube::BoundingBox() const {
+  // extent of the rotated box along each world axis
+  const vec3 extent = glm::abs(m_axes[0]) * m_halfExtent.x + glm::abs(m_axes[1]) * m_halfExtent.y +
+                      glm::abs(m_axes[2]) * m_halfExtent.z;
+  return {m_center - extent, m_center + extent};
+}
 } // namespace RTIAW::Render::Shapes
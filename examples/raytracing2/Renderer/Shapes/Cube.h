@@ -1,15 +1,15 @@
-#pragma once
-
-#include "Renderer/Materials/Materials.h"
-#include "Renderer/Shapes/Rectangle.h"
-#include <vector>
 #ifndef RTIAW_shapes_cube
 #define RTIAW_shapes_cube
+
 #include <array>
 #include <optional>
+#include <vector>
 
+#include <glm/mat3x3.hpp>
+
+#include "Renderer/AABB.h"
 #include "Renderer/HitRecord.h"
-#include "Renderer/Shapes/Plane.h"
+#include "Renderer/Shapes/Rectangle.h"
 #include "Renderer/Utils.h"
 
 static float CUBEVERTICES[] = {-0.5f, -0.5f, 0.5f,  0.5f,  -0.5f, 0.5f,
@@ -20,32 +20,41 @@ static int CUBEINDEX[6][3] = {
     {0, 1, 3}, {1, 2, 5}, {2, 3, 6}, {0, 3, 4}, {4, 5, 7}, {4, 0, 5},
 };
 namespace RTIAW::Render::Shapes {
+// Solid box, either axis-aligned or oriented. Rays are tested against the three slabs of the box in its own
+// frame, where it spans [-halfExtent, halfExtent].
 class Cube {
 public:
-public:
-  Cube();
+  // unit cube centered at the origin
+  Cube() = default;
+  // axis-aligned box
+  Cube(point3 min, point3 max);
+  // oriented box, the columns of `axes` are its (orthonormal) edge directions
+  Cube(point3 center, vec3 halfExtent, const glm::mat3 &axes);
+  // eight corners in the order of CUBEVERTICES, the edges have to be orthogonal
   explicit Cube(std::array<point3, 8> points);
 
-  [[nodiscard]] std::array<point3, 8> GetVertices() const {
-    return m_vertices;
-  };
-  [[nodiscard]] std::vector<Shapes::Rectangle> GetRectangles() const {
-    return m_rectangles;
-  };
+  [[nodiscard]] point3 Center() const { return m_center; };
+  [[nodiscard]] vec3 HalfExtent() const { return m_halfExtent; };
+  [[nodiscard]] const glm::mat3 &Axes() const { return m_axes; };
+
+  [[nodiscard]] std::array<point3, 8> GetVertices() const;
+  [[nodiscard]] std::vector<Shapes::Rectangle> GetRectangles() const;
 
   [[nodiscard]] float FastHit(const Ray &r, const float t_min,
                               const float t_max) const;
   [[nodiscard]] HitRecord ComputeHitRecord(const Ray &r, const float t) const;
   [[nodiscard]] std::optional<HitRecord> Hit(const Ray &r, const float t_min,
                                              const float t_max) const;
+  [[nodiscard]] AABB BoundingBox() const;
 
 private:
-  std::vector<Shapes::Rectangle> m_rectangles{};
-  std::array<point3, 8> m_vertices{};
-  Shapes::Plane m_plane{}; // The origin of this plane lies on one vertex of the
-                           // parallelogram
-  size_t m_materialIndex{};
-  std::vector<Material> materials;
+  point3 m_center{0, 0, 0};
+  vec3 m_halfExtent{0.5f, 0.5f, 0.5f};
+  glm::mat3 m_axes{1.0f};
+  bool m_oriented{false}; // axis-aligned boxes skip rotating the ray
+
+  // `r` in the box frame. Distances along the ray stay the same, the axes are orthonormal
+  [[nodiscard]] Ray ToLocal(const Ray &r) const;
 };
 } // namespace RTIAW::Render::Shapes
 
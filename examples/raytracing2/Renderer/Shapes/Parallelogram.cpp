@@ -68,4 +68,16 @@ std::optional<HitRecord> Parallelogram::Hit(const Ray &r, const float t_min, con
     return empty_result;
   }
 }
+
+AABB Parallelogram::BoundingBox() const {
+  AABB result{};
+  for (const auto &vertex : Vertices()) {
+    result.Expand(vertex);
+  }
+  // pad flat boxes so that the slab test never degenerates
+  constexpr float padding = 1e-4f;
+  result.min -= vec3{padding};
+  result.max += vec3{padding};
+  return result;
+}
 } // namespace RTIAW::Render::Shapes
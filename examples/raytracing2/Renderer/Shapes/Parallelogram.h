@@ -3,6 +3,7 @@
 
 #include <optional>
 
+#include "Renderer/AABB.h"
 #include "Renderer/HitRecord.h"
 #include "Renderer/Utils.h"
 
@@ -24,6 +25,7 @@ public:
   [[nodiscard]] float FastHit(const Ray &r, const float t_min, const float t_max) const;
   [[nodiscard]] HitRecord ComputeHitRecord(const Ray &r, const float t) const;
   [[nodiscard]] std::optional<HitRecord> Hit(const Ray &r, const float t_min, const float t_max) const;
+  [[nodiscard]] AABB BoundingBox() const;
 
 protected:
   Shapes::Plane m_plane{};          // The origin of this plane lies on one vertex of the parallelogram
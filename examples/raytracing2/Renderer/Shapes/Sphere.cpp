@@ -59,4 +59,10 @@ std::optional<HitRecord> Sphere::Hit(const Ray &r, const float t_min, const floa
     return empty_result;
   }
 }
+
+AABB Sphere::BoundingBox() const {
+  // the radius can be negative for hollow spheres, see ComputeHitRecord
+  const vec3 halfSize{std::abs(m_radius)};
+  return {m_center - halfSize, m_center + halfSize};
+}
 } // namespace RTIAW::Render::Shapes
@@ -4,6 +4,7 @@
 #include <memory>
 #include <optional>
 
+#include "Renderer/AABB.h"
 #include "Renderer/HitRecord.h"
 #include "Renderer/Utils.h"
 
@@ -16,6 +17,7 @@ public:
   [[nodiscard]] float FastHit(const Ray &r, const float t_min, const float t_max) const;
   [[nodiscard]] HitRecord ComputeHitRecord(const Ray &r, const float t) const;
   [[nodiscard]] std::optional<HitRecord> Hit(const Ray &r, const float t_min, const float t_max) const;
+  [[nodiscard]] AABB BoundingBox() const;
 
 public:
   point3 m_center{0, 0, 0};
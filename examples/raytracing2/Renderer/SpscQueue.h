@@ -0,0 +1,48 @@
+#ifndef RTIAW_utils_spscqueue
+#define RTIAW_utils_spscqueue
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace RTIAW::Utils {
+// ============================================================================ SpscQueue
+// SpscQueue
+//
+// Bounded lock-free FIFO between exactly one producer thread and one consumer thread. The slots are
+// preallocated, pushing and popping only move the element and publish an index.
+// ----------------------------------------------------------------------------
+template <typename T, std::size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+  // producer only, false when full
+  bool Push(T &&value) {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      return false;
+    m_slots[tail & (Capacity - 1)] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, false when empty
+  bool Pop(T &value) {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+    value = std::move(m_slots[head & (Capacity - 1)]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, Capacity> m_slots{};
+  // kept on separate cache lines, each is written by one side only
+  alignas(64) std::atomic<std::size_t> m_head{0};
+  alignas(64) std::atomic<std::size_t> m_tail{0};
+};
+} // namespace RTIAW::Utils
+
+#endif
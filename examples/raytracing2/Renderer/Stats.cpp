@@ -0,0 +1,81 @@
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "Renderer/Stats.h"
+
+namespace RTIAW::Render {
+uint64_t RenderStats::IntersectionTests() const {
+  return std::accumulate(begin(intersectionTests), end(intersectionTests), uint64_t{0});
+}
+
+RenderStats &RenderStats::operator+=(const RenderStats &other) {
+  primaryRays += other.primaryRays;
+  secondaryRays += other.secondaryRays;
+  for (size_t i = 0; i < intersectionTests.size(); ++i)
+    intersectionTests[i] += other.intersectionTests[i];
+  for (size_t i = 0; i < scatterCalls.size(); ++i)
+    scatterCalls[i] += other.scatterCalls[i];
+  earlyTerminations += other.earlyTerminations;
+  return *this;
+}
+
+namespace Stats {
+namespace {
+struct Registry {
+  std::mutex mutex;
+  // owned here, so that counters of exited threads are still summed
+  std::vector<std::unique_ptr<RenderStats>> counters;
+  // counters of exited threads, handed to the next new thread (which keeps adding to them)
+  std::vector<RenderStats *> released;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+} // namespace
+
+RenderStats &Local() {
+  // a render thread is started for every frame, reusing the counters keeps the registry from growing
+  thread_local struct Slot {
+    RenderStats *counters;
+
+    Slot() {
+      auto &registry = GetRegistry();
+      const std::lock_guard lock{registry.mutex};
+      if (registry.released.empty()) {
+        counters = registry.counters.emplace_back(std::make_unique<RenderStats>()).get();
+      } else {
+        counters = registry.released.back();
+        registry.released.pop_back();
+      }
+    }
+
+    ~Slot() {
+      auto &registry = GetRegistry();
+      const std::lock_guard lock{registry.mutex};
+      registry.released.push_back(counters);
+    }
+  } slot;
+  return *slot.counters;
+}
+
+void Reset() {
+  auto &registry = GetRegistry();
+  const std::lock_guard lock{registry.mutex};
+  for (auto &counters : registry.counters)
+    *counters = RenderStats{};
+}
+
+RenderStats Collect() {
+  auto &registry = GetRegistry();
+  const std::lock_guard lock{registry.mutex};
+  RenderStats result{};
+  for (const auto &counters : registry.counters)
+    result += *counters;
+  return result;
+}
+} // namespace Stats
+} // namespace RTIAW::Render
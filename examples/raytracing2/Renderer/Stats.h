@@ -0,0 +1,41 @@
+#ifndef RTIAW_stats
+#define RTIAW_stats
+
+#include <array>
+#include <cstdint>
+#include <variant>
+
+#include "Renderer/Materials/Materials.h"
+#include "Renderer/Shapes/Shapes.h"
+
+namespace RTIAW::Render {
+// Work done while rendering a frame
+struct RenderStats {
+  static constexpr std::array<const char *, 5> shapeNames{"Sphere", "Plane", "Parallelogram", "Rectangle", "Cube"};
+  static constexpr std::array<const char *, 3> materialNames{"Lambertian", "Dielectric", "Metal"};
+  static_assert(shapeNames.size() == std::variant_size_v<Shape>);
+  static_assert(materialNames.size() == std::variant_size_v<Material>);
+
+  uint64_t primaryRays{0};   // camera rays traced
+  uint64_t secondaryRays{0}; // scattered rays traced
+  std::array<uint64_t, shapeNames.size()> intersectionTests{};
+  std::array<uint64_t, materialNames.size()> scatterCalls{};
+  uint64_t earlyTerminations{0}; // paths absorbed before reaching the bounce limit or leaving the scene
+
+  [[nodiscard]] uint64_t Rays() const { return primaryRays + secondaryRays; }
+  [[nodiscard]] uint64_t IntersectionTests() const;
+
+  RenderStats &operator+=(const RenderStats &other);
+};
+
+// Per-thread counters: every thread increments its own RenderStats without atomics, they are only summed
+// (or reset) when no render is running.
+namespace Stats {
+// counters of the calling thread
+RenderStats &Local();
+void Reset();
+[[nodiscard]] RenderStats Collect();
+} // namespace Stats
+} // namespace RTIAW::Render
+
+#endif
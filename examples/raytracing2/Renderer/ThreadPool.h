@@ -12,14 +12,62 @@
 // ================================================================================ Standard Includes
 // Standard Includes
 // --------------------------------------------------------------------------------
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <functional>
 #include <future>
+#include <latch>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
+
+#include "Renderer/Topology.h"
 
 namespace RTIAW::Utils {
+// ============================================================================ Task_Ring
+// Task_Ring
+//
+// FIFO with the interface of the std::queue it replaces, on a ring buffer that only grows: unlike a deque
+// it stops allocating once it has been as full as it will get
+// ----------------------------------------------------------------------------
+template <typename T> class Task_Ring {
+public:
+  bool empty() const { return m_size == 0; }
+  std::size_t size() const { return m_size; }
+
+  T &front() { return m_slots[m_head]; }
+
+  void pop() {
+    m_slots[m_head] = T{};
+    m_head = (m_head + 1) % m_slots.size();
+    --m_size;
+  }
+
+  template <typename... Args> void emplace(Args &&...args) {
+    if (m_size == m_slots.size())
+      Grow();
+    m_slots[(m_head + m_size) % m_slots.size()] = T(std::forward<Args>(args)...);
+    ++m_size;
+  }
+
+private:
+  std::vector<T> m_slots;
+  std::size_t m_head{0};
+  std::size_t m_size{0};
+
+  void Grow() {
+    std::vector<T> slots(std::max<std::size_t>(16, 2 * m_slots.size()));
+    for (std::size_t i = 0; i < m_size; ++i)
+      slots[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+    m_slots = std::move(slots);
+    m_head = 0;
+  }
+};
+
 // ============================================================================ Pool
 // Pool
 //
@@ -34,34 +82,63 @@ public:
   using Threads_t = std::vector<std::thread>;
 
   using Task_Function_t = std::function<void()>;
-  using Task_Queue_t = std::queue<Task_Function_t>;
+  using Task_Queue_t = Task_Ring<Task_Function_t>;
 
 private:
   // -------------------------------------------------------------------- State
   Threads_t m_threads;
   Task_Queue_t m_task_queue;
+  std::vector<std::size_t> m_worker_nodes; // NUMA node each worker runs on
+  std::size_t m_node_count{1};              // 1 unless the workers are pinned
   Mutex_t m_queue_mutex;
   Condition_t m_pool_notifier;
+  Condition_t m_idle_notifier;
+  std::size_t m_busy_count{0}; // tasks taken off the queue whose callable has not been destroyed yet
   bool m_should_stop_processing;
   bool m_is_emergency_stop;
   bool m_is_paused;
 
 public:
   // Construct ( max threads )
-  Pool() : Pool(std::max(1u, std::thread::hardware_concurrency() - 1)) {}
+  Pool() : Pool(DefaultThreadCount()) {}
 
-  // Construct ( thread count )
-  explicit Pool(const std::size_t thread_count)
+  // Construct ( thread count, placement )
+  // With an affinity other than None every worker is pinned (see Affinity) and ParallelFor() gives the
+  // workers of each NUMA node their own contiguous slice of the range, so that what they first touch stays local
+  explicit Pool(const std::size_t thread_count, const Affinity affinity = Affinity::None)
       : m_should_stop_processing(false), m_is_emergency_stop(false), m_is_paused(false) {
     // Sanity
     if (thread_count == 0)
       throw std::runtime_error("ERROR: Thread::Pool() -- must have at least one thread");
 
+    // Placement, cores are dealt to the nodes in turn so that a partial pool still covers every node
+    const auto &topology = Topology::Get();
+    std::vector<std::vector<unsigned int>> placements(thread_count);
+    m_worker_nodes.assign(thread_count, 0);
+    if (affinity != Affinity::None) {
+      m_node_count = std::min(topology.nodes.size(), Bulk_Ranges::max_slices);
+      std::vector<std::size_t> next_cpu(topology.nodes.size(), 0);
+      for (std::size_t i = 0; i < thread_count; ++i) {
+        const std::size_t node = i % m_node_count;
+        const auto &cpus = topology.nodes[node];
+        m_worker_nodes[i] = node;
+        if (affinity == Affinity::Core)
+          placements[i] = {cpus[next_cpu[node]++ % cpus.size()]};
+        else
+          placements[i] = cpus;
+      }
+    }
+
     // Init pool
     m_threads.reserve(thread_count);
 
     for (std::size_t i = 0; i < thread_count; ++i)
-      m_threads.emplace_back([this]() { Worker(); });
+      m_threads.emplace_back([this, i, cpus = std::move(placements[i])]() {
+        if (!cpus.empty())
+          PinCurrentThread(cpus);
+        t_worker_node = m_worker_nodes[i];
+        Worker();
+      });
   }
 
   // Deleted
@@ -89,6 +166,9 @@ public:
   // Public API
   // -------------------------------------------------------------------- Accessors
   decltype(m_threads.size()) ThreadCount() const { return m_threads.size(); }
+  std::size_t NodeCount() const { return m_node_count; }
+
+  static std::size_t DefaultThreadCount() { return std::max(1u, std::thread::hardware_concurrency() - 1); }
 
   // -------------------------------------------------------------------- Add_Simple_Task()
   template <typename Lambda_t>
@@ -141,6 +221,58 @@ public:
     return result;
   }
 
+  // -------------------------------------------------------------------- Parallel_For()
+  // Calls `function(first, last)` over [begin, end) split in ranges of `grain` indices, and returns when all of
+  // them are done. The ranges are handed out through an atomic counter to the calling thread and to at most
+  // one helper per worker, which are queued with a single lock and woken with a single notification. Nothing is
+  // allocated, the callable is used in place.
+  //
+  // Ranges always start at `begin` plus a multiple of `grain`. On a pinned pool they are dealt from one slice per
+  // NUMA node, each thread works through the slice of its own node before helping the others.
+  //
+  // The first exception thrown by `function` cancels the ranges not started yet and is rethrown here. Must not
+  // be called from a task of this pool, nor while it is paused.
+  template <typename Function_t>
+  void ParallelFor(const std::size_t begin, const std::size_t end, const std::size_t grain, Function_t &&function) {
+    Bulk_Ranges ranges{begin, end, grain, m_node_count};
+    RunBulk(ranges, [&ranges, &function]() {
+      const std::size_t home = ranges.Home();
+      std::size_t first, last;
+      while (ranges.Take(home, first, last))
+        function(first, last);
+    });
+  }
+
+  // -------------------------------------------------------------------- Parallel_Reduce()
+  // Folds `map(first, last)` over the ranges of [begin, end) with `reduce`, starting from `identity`, scheduled
+  // as in ParallelFor(). Every thread folds its own ranges before the partial results are combined, in no
+  // particular order: `reduce` has to be associative and commutative.
+  template <typename Value_t, typename Map_t, typename Reduce_t>
+  Value_t ParallelReduce(const std::size_t begin, const std::size_t end, const std::size_t grain, Value_t identity,
+                         Map_t &&map, Reduce_t &&reduce) {
+    Bulk_Ranges ranges{begin, end, grain, m_node_count};
+    std::mutex result_mutex;
+    Value_t result = identity;
+    RunBulk(ranges, [&]() {
+      const std::size_t home = ranges.Home();
+      Value_t partial = identity;
+      std::size_t first, last;
+      while (ranges.Take(home, first, last))
+        partial = reduce(std::move(partial), map(first, last));
+
+      const std::lock_guard result_lock{result_mutex};
+      result = reduce(std::move(result), std::move(partial));
+    });
+    return result;
+  }
+
+  // -------------------------------------------------------------------- Wait_Idle()
+  // Blocks until the queue is empty and no worker is still inside (or cleaning up after) a task
+  void WaitIdle() {
+    Unique_Lock_t queue_lock(m_queue_mutex);
+    m_idle_notifier.wait(queue_lock, [this]() { return m_task_queue.empty() && m_busy_count == 0; });
+  }
+
   // -------------------------------------------------------------------- Emergency_Stop()
   void EmergencyStop() {
     {
@@ -166,6 +298,111 @@ public:
 private:
   // ==================================================================== Private API
   // Private API
+  // NUMA node of the calling thread when it is a worker of a pinned pool
+  static inline thread_local std::size_t t_worker_node = SIZE_MAX;
+
+  // -------------------------------------------------------------------- Bulk_Ranges
+  // Index ranges of a ParallelFor() / ParallelReduce(), shared by the threads taking part in it. The whole
+  // range is cut in up to max_slices contiguous slices, each with its own counter.
+  struct Bulk_Ranges {
+    static constexpr std::size_t max_slices = 8;
+
+    struct Slice {
+      std::atomic<std::size_t> next{0};
+      std::size_t end{0};
+    };
+
+    std::array<Slice, max_slices> slices;
+    std::size_t slice_count;
+    const std::size_t grain;
+    const std::size_t range_count;
+
+    Bulk_Ranges(const std::size_t begin, const std::size_t end, const std::size_t grain, const std::size_t slice_count)
+        : grain{std::max<std::size_t>(1, grain)},
+          range_count{end > begin ? (end - begin + this->grain - 1) / this->grain : 0} {
+      // at least one range per slice, slice boundaries on range boundaries
+      this->slice_count = std::clamp<std::size_t>(std::min(slice_count, range_count), 1, max_slices);
+      for (std::size_t s = 0; s < this->slice_count; ++s) {
+        slices[s].next = std::min(end, begin + range_count * s / this->slice_count * this->grain);
+        slices[s].end = std::min(end, begin + range_count * (s + 1) / this->slice_count * this->grain);
+      }
+    }
+
+    // slice to start from on the calling thread
+    [[nodiscard]] std::size_t Home() const {
+      if (slice_count == 1)
+        return 0;
+      return (t_worker_node != SIZE_MAX ? t_worker_node : Topology::Get().CurrentNode()) % slice_count;
+    }
+
+    bool Take(const std::size_t home, std::size_t &first, std::size_t &last) {
+      for (std::size_t k = 0; k < slice_count; ++k) {
+        auto &slice = slices[(home + k) % slice_count];
+        if (slice.next.load(std::memory_order_relaxed) >= slice.end)
+          continue;
+        first = slice.next.fetch_add(grain, std::memory_order_relaxed);
+        if (first < slice.end) {
+          last = std::min(slice.end, first + grain);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void Cancel() {
+      for (auto &slice : slices)
+        slice.next.store(slice.end, std::memory_order_relaxed);
+    }
+  };
+
+  // -------------------------------------------------------------------- Run_Bulk()
+  // Runs `participant()` on the calling thread and on as many workers as there are ranges left for, returns
+  // once every one of them is done with `ranges`
+  template <typename Participant_t> void RunBulk(Bulk_Ranges &ranges, Participant_t &&participant) {
+    if (ranges.range_count == 0)
+      return;
+    const std::size_t helper_count = std::min(m_threads.size(), ranges.range_count - 1);
+
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+    auto run = [&]() {
+      try {
+        participant();
+      } catch (...) {
+        ranges.Cancel();
+        if (!failed.exchange(true))
+          error = std::current_exception();
+      }
+    };
+
+    std::latch done{static_cast<std::ptrdiff_t>(helper_count)};
+    auto helper = [&run, &done]() {
+      run();
+      done.count_down();
+    };
+
+    if (helper_count > 0) {
+      {
+        Unique_Lock_t queue_lock(m_queue_mutex);
+
+        // Sanity
+        if (m_should_stop_processing || m_is_emergency_stop)
+          throw std::runtime_error("ERROR: Thread::Pool::Parallel_For() - attempted to add task to stopped pool");
+
+        // a reference to the helper fits in the std::function without allocating
+        for (std::size_t i = 0; i < helper_count; ++i)
+          m_task_queue.emplace([&helper]() { helper(); });
+      }
+      m_pool_notifier.notify_all();
+    }
+
+    run();
+    done.wait();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+
   // -------------------------------------------------------------------- Worker()
   void Worker() {
     while (true) {
@@ -188,10 +425,18 @@ private:
         // Retrieve next task
         task = std::move(m_task_queue.front());
         m_task_queue.pop();
+        ++m_busy_count;
       }
 
       // Execute task
       task();
+      task = nullptr;
+
+      {
+        Unique_Lock_t queue_lock(m_queue_mutex);
+        if (--m_busy_count == 0 && m_task_queue.empty())
+          m_idle_notifier.notify_all();
+      }
     }
   }
 };
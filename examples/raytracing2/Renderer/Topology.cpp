@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fmt/format.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Renderer/Topology.h"
+
+namespace RTIAW::Utils {
+namespace {
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<unsigned int> ParseCpuList(const std::string &list) {
+  std::vector<unsigned int> result;
+  std::stringstream stream{list};
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    const auto dash = range.find('-');
+    const auto first = static_cast<unsigned int>(std::stoul(range.substr(0, dash)));
+    const auto last = dash == std::string::npos ? first : static_cast<unsigned int>(std::stoul(range.substr(dash + 1)));
+    for (unsigned int cpu = first; cpu <= last; ++cpu)
+      result.push_back(cpu);
+  }
+  return result;
+}
+
+std::string ReadLine(const std::string &path) {
+  std::ifstream file{path};
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+Topology SingleNode() {
+  Topology topology;
+  auto &cpus = topology.nodes.emplace_back();
+  for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+    cpus.push_back(cpu);
+  return topology;
+}
+
+#ifdef __linux__
+Topology Detect() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return SingleNode();
+
+  Topology topology;
+  for (unsigned int node = 0;; ++node) {
+    const auto list = ReadLine(fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+    if (list.empty())
+      break;
+
+    std::vector<unsigned int> cores, siblings;
+    for (const auto cpu : ParseCpuList(list)) {
+      if (!CPU_ISSET(cpu, &allowed))
+        continue;
+      // the first thread of a core comes first, so that spreading workers fills cores before SMT siblings
+      const auto threads = ParseCpuList(
+          ReadLine(fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu)));
+      (threads.empty() || threads.front() == cpu ? cores : siblings).push_back(cpu);
+    }
+    cores.insert(end(cores), begin(siblings), end(siblings));
+    if (!cores.empty())
+      topology.nodes.push_back(std::move(cores));
+  }
+
+  return topology.nodes.empty() ? SingleNode() : topology;
+}
+#else
+Topology Detect() { return SingleNode(); }
+#endif
+} // namespace
+
+Affinity ParseAffinity(const std::string_view name) {
+  if (name == "none")
+    return Affinity::None;
+  if (name == "core")
+    return Affinity::Core;
+  if (name == "node")
+    return Affinity::Node;
+  throw std::runtime_error(fmt::format("Unknown affinity '{}', expected none, core or node", name));
+}
+
+std::size_t Topology::CpuCount() const {
+  std::size_t count = 0;
+  for (const auto &cpus : nodes)
+    count += cpus.size();
+  return count;
+}
+
+std::size_t Topology::NodeOf(const unsigned int cpu) const {
+  for (std::size_t node = 0; node < nodes.size(); ++node) {
+    if (std::find(begin(nodes[node]), end(nodes[node]), cpu) != end(nodes[node]))
+      return node;
+  }
+  return 0;
+}
+
+std::size_t Topology::CurrentNode() const {
+#ifdef __linux__
+  if (nodes.size() > 1) {
+    if (const int cpu = sched_getcpu(); cpu >= 0)
+      return NodeOf(static_cast<unsigned int>(cpu));
+  }
+#endif
+  return 0;
+}
+
+const Topology &Topology::Get() {
+  static const Topology topology = Detect();
+  return topology;
+}
+
+bool PinCurrentThread(const std::span<const unsigned int> cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus)
+    CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+} // namespace RTIAW::Utils
@@ -0,0 +1,38 @@
+#ifndef RTIAW_utils_topology
+#define RTIAW_utils_topology
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace RTIAW::Utils {
+// Where the workers of a Pool run
+enum class Affinity {
+  None, // let the OS schedule them
+  Core, // one CPU each, spread over the NUMA nodes
+  Node, // any CPU of one NUMA node each, nodes assigned round robin
+};
+
+[[nodiscard]] Affinity ParseAffinity(std::string_view name);
+
+// CPUs this process may run on, grouped by NUMA node
+struct Topology {
+  // logical CPU ids of every node, SMT siblings after the first thread of each core
+  std::vector<std::vector<unsigned int>> nodes;
+
+  [[nodiscard]] std::size_t CpuCount() const;
+  [[nodiscard]] std::size_t NodeOf(unsigned int cpu) const;
+  // node of the CPU the calling thread is running on right now
+  [[nodiscard]] std::size_t CurrentNode() const;
+
+  // Read once from /sys/devices/system on Linux. Elsewhere, or when that fails, a single node with
+  // hardware_concurrency() CPUs
+  static const Topology &Get();
+};
+
+// Restricts the calling thread to `cpus`, returns false when that is not supported or not allowed
+bool PinCurrentThread(std::span<const unsigned int> cpus);
+} // namespace RTIAW::Utils
+
+#endif
@@ -0,0 +1,113 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "Renderer/Trace.h"
+
+namespace RTIAW::Trace {
+namespace {
+struct ThreadBuffer {
+  uint32_t id{0};
+  std::string name{};
+  std::unique_ptr<Event[]> events{std::make_unique<Event[]>(bufferCapacity)};
+  // events recorded so far, the last bufferCapacity of them are still in the ring
+  std::atomic<uint64_t> written{0};
+};
+
+struct Registry {
+  std::mutex mutex;
+  // owned here rather than by the threads, events of exited threads stay dumpable
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadBuffer &LocalBuffer() {
+  thread_local ThreadBuffer *buffer = [] {
+    auto &registry = GetRegistry();
+    const std::lock_guard lock{registry.mutex};
+    auto &result = registry.buffers.emplace_back(std::make_unique<ThreadBuffer>());
+    result->id = static_cast<uint32_t>(registry.buffers.size());
+    return result.get();
+  }();
+  return *buffer;
+}
+
+const auto processStart = std::chrono::steady_clock::now();
+
+std::string Escape(const std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  for (const char c : text) {
+    if (c == '"' || c == '\\')
+      result.push_back('\\');
+    if (static_cast<unsigned char>(c) >= 0x20)
+      result.push_back(c);
+  }
+  return result;
+}
+} // namespace
+
+uint64_t Now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - processStart).count());
+}
+
+void Record(const char *name, const uint64_t begin, const uint64_t end) {
+  auto &buffer = LocalBuffer();
+  const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+  buffer.events[index % bufferCapacity] = {name, begin, end};
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void SetThreadName(const std::string &name) {
+  auto &buffer = LocalBuffer();
+  const std::lock_guard lock{GetRegistry().mutex};
+  buffer.name = name;
+}
+
+void WriteChromeJson(const std::string &path) {
+  std::ofstream file{path};
+  if (!file)
+    throw std::runtime_error(fmt::format("Trace: can't open {}", path));
+
+  auto &registry = GetRegistry();
+  const std::lock_guard lock{registry.mutex};
+
+  // complete events ("X"), timestamps in microseconds
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  const auto separator = [&first]() {
+    const char *result = first ? "\n" : ",\n";
+    first = false;
+    return result;
+  };
+
+  for (const auto &buffer : registry.buffers) {
+    const std::string threadName = buffer->name.empty() ? fmt::format("Thread {}", buffer->id) : buffer->name;
+    file << separator()
+         << fmt::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})", buffer->id,
+                        Escape(threadName));
+
+    const uint64_t written = buffer->written.load(std::memory_order_acquire);
+    const uint64_t oldest = written > bufferCapacity ? written - bufferCapacity : 0;
+    for (uint64_t i = oldest; i < written; ++i) {
+      const Event &event = buffer->events[i % bufferCapacity];
+      file << separator()
+           << fmt::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})", Escape(event.name),
+                          buffer->id, event.begin * 1e-3, (event.end - event.begin) * 1e-3);
+    }
+  }
+  file << "\n]}\n";
+}
+} // namespace RTIAW::Trace
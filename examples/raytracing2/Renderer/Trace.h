@@ -0,0 +1,61 @@
+#ifndef RTIAW_trace
+#define RTIAW_trace
+
+#include <cstdint>
+#include <string>
+
+// Scoped trace events, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Built with RTIAW_TRACE defined (`xmake f --trace=y`), RTIAW_TRACE_SCOPE("name") records the begin and end
+// of the enclosing scope into a ring buffer owned by the calling thread: no locks and no allocation past the
+// first event of each thread. Without it the macros expand to nothing.
+// Event names have to be string literals, only their address is stored.
+#ifdef RTIAW_TRACE
+#define RTIAW_TRACE_CONCAT_IMPL(a, b) a##b
+#define RTIAW_TRACE_CONCAT(a, b) RTIAW_TRACE_CONCAT_IMPL(a, b)
+#define RTIAW_TRACE_SCOPE(name) const ::RTIAW::Trace::Scope RTIAW_TRACE_CONCAT(traceScope, __LINE__){name}
+#define RTIAW_TRACE_THREAD_NAME(name) ::RTIAW::Trace::SetThreadName(name)
+#else
+#define RTIAW_TRACE_SCOPE(name)
+#define RTIAW_TRACE_THREAD_NAME(name)
+#endif
+
+namespace RTIAW::Trace {
+#ifdef RTIAW_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+// events kept per thread, older ones are overwritten
+constexpr size_t bufferCapacity = 1 << 16;
+
+struct Event {
+  const char *name;
+  uint64_t begin; // ns since the start of the process, monotonic
+  uint64_t end;
+};
+
+[[nodiscard]] uint64_t Now();
+void Record(const char *name, uint64_t begin, uint64_t end);
+// label shown for the calling thread in the trace viewer
+void SetThreadName(const std::string &name);
+
+// Writes the events of every thread seen so far. Threads still recording while this runs may have their
+// most recent events skipped or torn, dump when the renderer is idle for an exact picture.
+void WriteChromeJson(const std::string &path);
+
+class Scope {
+public:
+  explicit Scope(const char *name) : m_name{name}, m_begin{Now()} {}
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() { Record(m_name, m_begin, Now()); }
+
+private:
+  const char *m_name;
+  uint64_t m_begin;
+};
+} // namespace RTIAW::Trace
+
+#endif
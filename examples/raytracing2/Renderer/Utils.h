@@ -3,6 +3,8 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <initializer_list>
 #include <random>
 
 namespace RTIAW::Utils {
@@ -22,11 +24,29 @@ template <typename T, qualifier Q> float azimuth(glm::vec<3, T, Q> vec) { return
 } // namespace glm
 
 namespace RTIAW::Random {
+// Generator of the calling thread, shared by the functions below and the materials. The renderer reseeds it
+// for every quad (see Seed()), so that a frame with a fixed seed doesn't depend on which worker rendered what
+inline std::mt19937 &Generator() {
+  static thread_local std::mt19937 generator{std::random_device{}()};
+  return generator;
+}
+
+// Reseeds the generator of the calling thread with `values` hashed together (FNV-1a)
+inline void Seed(const std::initializer_list<uint32_t> values) {
+  uint32_t hash = 2166136261u;
+  for (const uint32_t value : values) {
+    for (int byte = 0; byte < 4; ++byte) {
+      hash = (hash ^ ((value >> (8 * byte)) & 0xffu)) * 16777619u;
+    }
+  }
+  Generator().seed(hash);
+}
+
 // All functions adapted from glm source code.
 // On Linux the rand() syscall has global lock that really hurts multithreading performances
 
 template <typename T> glm::vec<2, T, glm::defaultp> diskRand(T Radius) {
-  static thread_local std::mt19937 generator{std::random_device{}()};
+  auto &generator = Generator();
   static thread_local std::uniform_real_distribution<T> unif{T(-Radius), T(Radius)};
 
   assert(Radius > static_cast<T>(0));
@@ -45,7 +65,7 @@ template <typename T> glm::vec<2, T, glm::defaultp> diskRand(T Radius) {
 }
 
 template <typename T> GLM_FUNC_QUALIFIER glm::vec<3, T, glm::defaultp> sphericalRand(T Radius) {
-  static thread_local std::mt19937 generator{std::random_device{}()};
+  auto &generator = Generator();
   static thread_local std::uniform_real_distribution<T> unif1{T(0.0), T(6.283185307179586476925286766559)};
   static thread_local std::uniform_real_distribution<T> unif2{T(-1), T(1)};
 
@@ -0,0 +1,67 @@
+#include "Renderer/Wavefront.h"
+
+namespace RTIAW::Render {
+void Wavefront::PathQueue::Resize(const size_t size) {
+  rays.resize(size);
+  throughput.resize(size);
+  pixels.resize(size);
+  alive.resize(size);
+}
+
+size_t Wavefront::ChunkCount(const size_t size) const {
+  // a few chunks per thread, so that a slow chunk does not stall the whole stage
+  const size_t maxChunks = 4 * m_pool.ThreadCount();
+  return std::min(maxChunks, (size + minChunkSize - 1) / minChunkSize);
+}
+
+void Wavefront::Extend(const HittableObjectList &scene) {
+  RTIAW_TRACE_SCOPE("Wavefront::Extend");
+  m_hits.resize(m_queue.Size());
+  m_hitMask.resize(m_queue.Size());
+
+  ForEachChunk(m_queue.Size(), [&](size_t, size_t first, size_t last) {
+    auto &stats = Stats::Local();
+    (m_bounce == 0 ? stats.primaryRays : stats.secondaryRays) += last - first;
+    for (size_t i = first; i < last; ++i) {
+      if (const auto hit = scene.Intersect(m_queue.rays[i], 0.001f, RTIAW::Utils::infinity); hit) {
+        m_hits[i] = hit.value();
+        m_hitMask[i] = 1;
+      } else {
+        m_hitMask[i] = 0;
+      }
+    }
+  });
+}
+
+void Wavefront::Compact() {
+  RTIAW_TRACE_SCOPE("Wavefront::Compact");
+  const size_t size = m_queue.Size();
+  m_chunkOffsets.assign(ChunkCount(size) + 1, 0);
+
+  // count the survivors of each chunk, then move them to their final slot in parallel
+  ForEachChunk(size, [&](size_t chunk, size_t first, size_t last) {
+    m_chunkOffsets[chunk + 1] =
+        static_cast<size_t>(std::count(begin(m_queue.alive) + first, begin(m_queue.alive) + last, 1));
+  });
+  for (size_t chunk = 1; chunk < m_chunkOffsets.size(); ++chunk) {
+    m_chunkOffsets[chunk] += m_chunkOffsets[chunk - 1];
+  }
+
+  m_compacted.Resize(m_chunkOffsets.back());
+  ForEachChunk(size, [&](size_t chunk, size_t first, size_t last) {
+    size_t out = m_chunkOffsets[chunk];
+    for (size_t i = first; i < last; ++i) {
+      if (!m_queue.alive[i])
+        continue;
+      m_compacted.rays[out] = m_queue.rays[i];
+      m_compacted.throughput[out] = m_queue.throughput[i];
+      m_compacted.pixels[out] = m_queue.pixels[i];
+      m_compacted.alive[out] = 1;
+      ++out;
+    }
+  });
+
+  std::swap(m_queue, m_compacted);
+  ++m_bounce;
+}
+} // namespace RTIAW::Render
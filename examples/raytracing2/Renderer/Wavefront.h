@@ -0,0 +1,128 @@
+#ifndef RTIAW_wavefront
+#define RTIAW_wavefront
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Renderer/HittableObjectList.h"
+#include "Renderer/MaterialBuckets.h"
+#include "Renderer/Stats.h"
+#include "Renderer/ThreadPool.h"
+#include "Renderer/Trace.h"
+
+namespace RTIAW::Render {
+// Breadth-first path tracing.
+//
+// Instead of following one path to the end before starting the next (Renderer::ShootRay), a wave of paths is
+// kept in a queue and all of them are advanced together, one stage at a time:
+//   Generate - one camera ray per pixel of the wave
+//   Extend   - closest hit for every queued ray
+//   Shade    - scatter the hits (grouped by material type), accumulate the misses
+//   Compact  - drop the terminated paths so the next bounce only sees live ones
+// Every stage is split in chunks over the thread pool, so threads stay busy however unevenly paths end.
+class Wavefront {
+public:
+  // Struct of arrays, index i of every vector belongs to the same path
+  struct PathQueue {
+    std::vector<Ray> rays;
+    std::vector<color> throughput;
+    std::vector<uint32_t> pixels; // index in the wave
+    std::vector<uint8_t> alive;
+
+    [[nodiscard]] size_t Size() const { return rays.size(); }
+    void Resize(size_t size);
+  };
+
+  explicit Wavefront(Utils::Pool &pool) : m_pool{pool} {}
+
+  // Starts a wave: `cameraRay(pixel)` returns the primary ray of each pixel in [0, count)
+  template <typename CameraRay> void Generate(const size_t count, CameraRay &&cameraRay) {
+    RTIAW_TRACE_SCOPE("Wavefront::Generate");
+    m_queue.Resize(count);
+    m_bounce = 0;
+    ForEachChunk(count, [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        m_queue.rays[i] = cameraRay(static_cast<uint32_t>(i));
+        m_queue.throughput[i] = color{1, 1, 1};
+        m_queue.pixels[i] = static_cast<uint32_t>(i);
+        m_queue.alive[i] = 1;
+      }
+    });
+  }
+
+  void Extend(const HittableObjectList &scene);
+
+  // Adds `throughput * miss(ray)` to `radiance` for the rays that left the scene
+  template <typename Miss> void Shade(const std::vector<Material> &materials, std::span<color> radiance, Miss &&miss) {
+    RTIAW_TRACE_SCOPE("Wavefront::Shade");
+    ForEachChunk(m_queue.Size(), [&](size_t chunk, size_t first, size_t last) {
+      auto &stats = Stats::Local();
+      auto &buckets = m_buckets[chunk];
+      buckets.Clear();
+      for (size_t i = first; i < last; ++i) {
+        if (m_hitMask[i]) {
+          buckets.Push(materials, static_cast<uint32_t>(i), m_hits[i]);
+        } else {
+          // a wave holds a single path per pixel, no other thread touches this one
+          radiance[m_queue.pixels[i]] += m_queue.throughput[i] * miss(m_queue.rays[i]);
+          m_queue.alive[i] = 0;
+        }
+      }
+
+      buckets.Shade(
+          materials, [this](uint32_t i) -> const Ray & { return m_queue.rays[i]; },
+          [this, &stats](uint32_t i, const std::optional<ScatteringRecord> &scattered) {
+            if (scattered) {
+              m_queue.throughput[i] *= scattered->attenuation;
+              m_queue.rays[i] = scattered->ray;
+            } else {
+              m_queue.alive[i] = 0;
+              ++stats.earlyTerminations;
+            }
+          });
+    });
+  }
+
+  void Compact();
+
+  [[nodiscard]] size_t ActivePaths() const { return m_queue.Size(); }
+
+private:
+  // chunks are kept large enough to amortize the task overhead
+  static constexpr size_t minChunkSize = 1024;
+
+  Utils::Pool &m_pool;
+
+  PathQueue m_queue;
+  PathQueue m_compacted; // swapped with m_queue by Compact()
+  unsigned int m_bounce{0}; // of the rays in the queue, 0 for camera rays
+  std::vector<SurfaceHit> m_hits;
+  std::vector<uint8_t> m_hitMask;
+
+  std::vector<MaterialBuckets> m_buckets; // one per chunk
+  std::vector<size_t> m_chunkOffsets;
+
+  [[nodiscard]] size_t ChunkCount(size_t size) const;
+
+  // Runs `function(chunk, first, last)` over [0, size) on the pool and waits for it. The split only depends on
+  // `size`, so consecutive stages over the same queue see the same chunks.
+  template <typename Function> void ForEachChunk(const size_t size, Function &&function) {
+    const size_t chunkCount = ChunkCount(size);
+    if (chunkCount == 0)
+      return;
+    if (m_buckets.size() < chunkCount)
+      m_buckets.resize(chunkCount);
+
+    // ranges of exactly one chunk, so the chunk index follows from where they start
+    const size_t chunkSize = (size + chunkCount - 1) / chunkCount;
+    m_pool.ParallelFor(0, size, chunkSize, [&function, chunkSize](const size_t first, const size_t last) {
+      RTIAW_TRACE_SCOPE("Wavefront::Chunk");
+      function(first / chunkSize, first, last);
+    });
+  }
+};
+} // namespace RTIAW::Render
+
+#endif
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <cstdint>
+
+#include "Renderer/WideBVH.h"
+
+namespace RTIAW::Render {
+namespace {
+// a candidate that is a part of an oversized leaf rather than a binary node
+constexpr uint32_t noNode = UINT32_MAX;
+// leaf sizes are stored in a byte, larger binary leaves (many primitives sharing a centroid) are halved until
+// they fit
+constexpr uint32_t maxLeafCount = UINT8_MAX;
+// binary subtrees with up to this many primitives become one leaf: the last binary levels would otherwise end
+// up in nodes with a few children each
+template <unsigned Width> constexpr uint32_t mergedLeafCount = Width;
+constexpr int minExponent = -126; // 2^e stays a normal float
+constexpr int maxExponent = 127;
+} // namespace
+
+// a child of a node being built: a binary node, or a range of an oversized binary leaf
+template <unsigned Width> struct WideBVH<Width>::Candidate {
+  AABB bounds;
+  uint32_t node;
+  uint32_t first;
+  uint32_t count;
+};
+
+template <unsigned Width> void WideBVH<Width>::Build(const BVH &bvh, const std::vector<AABB> &bounds) {
+  m_nodes.clear();
+  if (bvh.Empty())
+    return;
+
+  // primitive range of every binary subtree, leaves come in order
+  const auto &binaryNodes = bvh.Nodes();
+  m_ranges.assign(binaryNodes.size(), {0, 0});
+  const auto rangeOf = [&](const auto &self, const uint32_t node) -> std::pair<uint32_t, uint32_t> {
+    const auto &binary = binaryNodes[node];
+    if (binary.IsLeaf())
+      return m_ranges[node] = {binary.leftFirst, binary.count};
+    const auto left = self(self, binary.leftFirst);
+    const auto right = self(self, binary.leftFirst + 1);
+    return m_ranges[node] = {left.first, left.second + right.second};
+  };
+  rangeOf(rangeOf, 0);
+
+  m_nodes.emplace_back();
+  BuildNode(0, binaryNodes[0].Bounds(), {Candidate{binaryNodes[0].Bounds(), 0, m_ranges[0].first, m_ranges[0].second}},
+            bvh, bounds);
+  m_ranges = {};
+  m_nodes.shrink_to_fit();
+}
+
+template <unsigned Width>
+void WideBVH<Width>::BuildNode(const uint32_t nodeIndex, const AABB &nodeBounds, std::vector<Candidate> children,
+                               const BVH &bvh, const std::vector<AABB> &bounds) {
+  const auto &binaryNodes = bvh.Nodes();
+  const auto isInner = [&](const Candidate &candidate) {
+    if (candidate.node != noNode && !binaryNodes[candidate.node].IsLeaf())
+      return candidate.count > mergedLeafCount<Width>;
+    return candidate.count > maxLeafCount;
+  };
+  const auto open = [&](const Candidate &candidate) -> std::pair<Candidate, Candidate> {
+    if (candidate.node != noNode && !binaryNodes[candidate.node].IsLeaf()) {
+      const uint32_t left = binaryNodes[candidate.node].leftFirst;
+      const auto &leftNode = binaryNodes[left];
+      const auto &rightNode = binaryNodes[left + 1];
+      return {Candidate{leftNode.Bounds(), left, m_ranges[left].first, m_ranges[left].second},
+              Candidate{rightNode.Bounds(), left + 1, m_ranges[left + 1].first, m_ranges[left + 1].second}};
+    }
+    // halves of an oversized leaf, with bounds of their own
+    const uint32_t half = candidate.count / 2;
+    std::pair<Candidate, Candidate> halves{Candidate{AABB{}, noNode, candidate.first, half},
+                                           Candidate{AABB{}, noNode, candidate.first + half, candidate.count - half}};
+    for (auto *part : {&halves.first, &halves.second}) {
+      for (uint32_t i = part->first; i < part->first + part->count; ++i)
+        part->bounds.Expand(bounds[i]);
+    }
+    return halves;
+  };
+
+  // Pull the largest inner children up until the node is full: the binary levels in between disappear
+  while (children.size() < Width) {
+    int largest = -1;
+    for (size_t i = 0; i < children.size(); ++i) {
+      if (isInner(children[i]) &&
+          (largest < 0 || children[i].bounds.SurfaceArea() > children[largest].bounds.SurfaceArea()))
+        largest = static_cast<int>(i);
+    }
+    if (largest < 0)
+      break;
+    const auto [first, second] = open(children[largest]);
+    children[largest] = first;
+    children.push_back(second);
+  }
+
+  Node node{};
+  for (int axis = 0; axis < 3; ++axis) {
+    // smallest power of two step whose 255 steps cover the node, as decoded by HitChildren()
+    const float lo = nodeBounds.min[axis];
+    const float hi = nodeBounds.max[axis];
+    int exponent = minExponent;
+    if (hi > lo)
+      exponent = std::clamp(static_cast<int>(std::ceil(std::log2((hi - lo) / 255.0f))), minExponent, maxExponent);
+    while (exponent < maxExponent && lo + 255.0f * Scale(static_cast<int8_t>(exponent)) < hi)
+      ++exponent;
+    const float scale = Scale(static_cast<int8_t>(exponent));
+    node.origin[axis] = lo;
+    node.exponent[axis] = static_cast<int8_t>(exponent);
+
+    // rounded outwards, then checked against the decoded planes
+    for (size_t i = 0; i < children.size(); ++i) {
+      const float childMin = children[i].bounds.min[axis];
+      const float childMax = children[i].bounds.max[axis];
+      int qmin = std::clamp(static_cast<int>(std::floor((childMin - lo) / scale)), 0, 255);
+      while (qmin > 0 && lo + static_cast<float>(qmin) * scale > childMin)
+        --qmin;
+      int qmax = std::clamp(static_cast<int>(std::ceil((childMax - lo) / scale)), 0, 255);
+      while (qmax < 255 && lo + static_cast<float>(qmax) * scale < childMax)
+        ++qmax;
+      node.qmin[axis][i] = static_cast<uint8_t>(qmin);
+      node.qmax[axis][i] = static_cast<uint8_t>(qmax);
+    }
+  }
+
+  for (size_t i = 0; i < children.size(); ++i) {
+    node.childMask |= static_cast<uint8_t>(1u << i);
+    if (isInner(children[i])) {
+      node.innerMask |= static_cast<uint8_t>(1u << i);
+    } else {
+      node.child[i] = children[i].first;
+      node.count[i] = static_cast<uint8_t>(children[i].count);
+    }
+  }
+
+  // the inner children of a node are stored next to each other, then built depth first
+  for (size_t i = 0; i < children.size(); ++i) {
+    if (node.innerMask & (1u << i)) {
+      node.child[i] = static_cast<uint32_t>(m_nodes.size());
+      m_nodes.emplace_back();
+    }
+  }
+  m_nodes[nodeIndex] = node;
+  for (size_t i = 0; i < children.size(); ++i) {
+    if (node.innerMask & (1u << i))
+      BuildNode(node.child[i], children[i].bounds, {children[i]}, bvh, bounds);
+  }
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+} // namespace RTIAW::Render
@@ -0,0 +1,179 @@
+#ifndef RTIAW_widebvh
+#define RTIAW_widebvh
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Renderer/AABB.h"
+#include "Renderer/BVH.h"
+#include "Renderer/Ray.h"
+
+namespace RTIAW::Render {
+// node layout of the object hierarchy of a HittableObjectList
+enum class BVHLayout { Binary, Wide4, Wide8 };
+
+// A bounding volume hierarchy with `Width` children per node, collapsed from a binary BVH.
+//
+// Child bounds are stored with 8 bits per plane, relative to the bounds of their node: plane = origin + q * 2^e
+// with one exponent per axis, rounded outwards so that a child box always contains its primitives. A 4 wide node
+// is one cache line, an 8 wide one two, against 32 bytes per binary node and about three binary nodes per wide
+// one. Traversal tests all the children of a node at once, lane by lane over plain arrays that the compiler turns
+// into vector code.
+//
+// Leaves are primitive ranges in the binary build order: binary leaves, or whole binary subtrees of at most
+// Width primitives.
+template <unsigned Width> class WideBVH {
+public:
+  static_assert(Width == 4 || Width == 8);
+
+  struct alignas(64) Node {
+    float origin[3];   // min corner of the node bounds
+    int8_t exponent[3];
+    uint8_t innerMask; // bit i: child i is a node, otherwise a leaf
+    uint32_t child[Width]; // node index of an inner child, first primitive of a leaf
+    uint8_t qmin[3][Width];
+    uint8_t qmax[3][Width];
+    uint8_t count[Width]; // primitives of a leaf child
+    uint8_t childMask;    // bit i: slot i is used
+  };
+  static_assert(sizeof(Node) == 64 * (Width / 4), "wide nodes are one cache line per four children");
+
+  // Collapses `bvh`, whose leaves index primitives with `bounds`
+  void Build(const BVH &bvh, const std::vector<AABB> &bounds);
+  void Clear() { m_nodes.clear(); }
+
+  [[nodiscard]] bool Empty() const { return m_nodes.empty(); }
+  [[nodiscard]] size_t Bytes() const { return m_nodes.size() * sizeof(Node); }
+
+  // Same contract as BVH::Traverse(): nearest children first, `intersectLeaf(first, count, closest)` shrinks
+  // `closest` when it finds a nearer hit
+  template <typename IntersectLeaf>
+  void Traverse(const Ray &r, const float t_min, float &closest, IntersectLeaf &&intersectLeaf) const {
+    if (m_nodes.empty())
+      return;
+
+    std::pair<uint32_t, float> stack[stackSize];
+    size_t stackTop = 0;
+    uint32_t current = 0;
+
+    while (true) {
+      const Node &node = m_nodes[current];
+      float tEnter[Width];
+      const unsigned hitMask = HitChildren(node, r, t_min, closest, tEnter);
+
+      // the children that were hit, nearest first
+      uint32_t order[Width];
+      unsigned hits = 0;
+      for (unsigned i = 0; i < Width; ++i) {
+        if (hitMask & (1u << i)) {
+          unsigned j = hits++;
+          for (; j > 0 && tEnter[order[j - 1]] > tEnter[i]; --j)
+            order[j] = order[j - 1];
+          order[j] = i;
+        }
+      }
+
+      // leaves are tested right away, the inner children go on the stack farthest first
+      for (unsigned k = hits; k > 0; --k) {
+        const unsigned i = order[k - 1];
+        if (node.innerMask & (1u << i))
+          stack[stackTop++] = {node.child[i], tEnter[i]};
+      }
+      for (unsigned k = 0; k < hits; ++k) {
+        const unsigned i = order[k];
+        if (!(node.innerMask & (1u << i)) && tEnter[i] <= closest)
+          intersectLeaf(node.child[i], node.count[i], closest);
+      }
+
+      // pop the next subtree that can still contain a closer hit
+      do {
+        if (stackTop == 0)
+          return;
+        --stackTop;
+      } while (stack[stackTop].second > closest);
+      current = stack[stackTop].first;
+    }
+  }
+
+  // Same contract as BVH::TraverseAny()
+  template <typename AnyLeaf>
+  [[nodiscard]] bool TraverseAny(const Ray &r, const float t_min, const float t_max, AnyLeaf &&anyLeaf) const {
+    if (m_nodes.empty())
+      return false;
+
+    uint32_t stack[stackSize];
+    size_t stackTop = 0;
+    stack[stackTop++] = 0;
+
+    while (stackTop > 0) {
+      const Node &node = m_nodes[stack[--stackTop]];
+      float tEnter[Width];
+      const unsigned hitMask = HitChildren(node, r, t_min, t_max, tEnter);
+      for (unsigned i = 0; i < Width; ++i) {
+        if (!(hitMask & (1u << i)))
+          continue;
+        if (node.innerMask & (1u << i))
+          stack[stackTop++] = node.child[i];
+        else if (anyLeaf(node.child[i], node.count[i]))
+          return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  // Each wide level takes at least one binary level, or one halving of an oversized leaf (see WideBVH.cpp), and
+  // leaves at most Width - 1 children on the stack
+  static constexpr size_t stackSize = (BVH::maxDepth + 32) * (Width - 1) + Width;
+
+  std::vector<Node> m_nodes;
+  // first primitive and primitive count of each binary node, while building
+  std::vector<std::pair<uint32_t, uint32_t>> m_ranges;
+
+  struct Candidate;
+  void BuildNode(uint32_t nodeIndex, const AABB &nodeBounds, std::vector<Candidate> children, const BVH &bvh,
+                 const std::vector<AABB> &bounds);
+
+  // 2^exponent
+  static float Scale(const int8_t exponent) {
+    return std::bit_cast<float>(static_cast<uint32_t>(exponent + 127) << 23);
+  }
+
+  // Slab test of every child, lane by lane. Returns the mask of the children hit within [t_min, t_max] and
+  // their entry distances in `tEnter`
+  static unsigned HitChildren(const Node &node, const Ray &r, const float t_min, const float t_max,
+                              float (&tEnter)[Width]) {
+    float tExit[Width];
+    for (unsigned i = 0; i < Width; ++i) {
+      tEnter[i] = t_min;
+      tExit[i] = t_max;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      const float origin = node.origin[axis];
+      const float scale = Scale(node.exponent[axis]);
+      const float rayOrigin = r.origin[axis];
+      const float inverse = r.inverseDirection[axis];
+      for (unsigned i = 0; i < Width; ++i) {
+        // the decoding has to match the build exactly, q * scale is exact
+        const float t0 = (origin + static_cast<float>(node.qmin[axis][i]) * scale - rayOrigin) * inverse;
+        const float t1 = (origin + static_cast<float>(node.qmax[axis][i]) * scale - rayOrigin) * inverse;
+        tEnter[i] = std::max(tEnter[i], std::min(t0, t1));
+        tExit[i] = std::min(tExit[i], std::max(t0, t1));
+      }
+    }
+
+    unsigned mask = 0;
+    for (unsigned i = 0; i < Width; ++i)
+      mask |= static_cast<unsigned>(tEnter[i] <= tExit[i]) << i;
+    return mask & node.childMask;
+  }
+};
+
+extern template class WideBVH<4>;
+extern template class WideBVH<8>;
+} // namespace RTIAW::Render
+
+#endif
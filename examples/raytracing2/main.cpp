@@ -27,13 +27,115 @@
 #pragma once
 #include "Application.h"
 #include "ApplicationLayer.h"
+#include "Renderer/Animation.h"
+#include "Renderer/Distributed.h"
+#include "Renderer/Regression.h"
+#include "Renderer/Renderer.h"
+#include "Renderer/SceneFile.h"
+#include "Renderer/Topology.h"
 
+#include <fmt/format.h>
 #include <glm/gtc/type_ptr.hpp>
+#include <magic_enum.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
 using namespace Walnut;
 using namespace RTIAW;
 
-int main(int argc, char **) {
+int main(int argc, char **argv) {
+
+  // raytracing2_example_app --convert-scene scene.rtscene scene.rtsb
+  if (argc == 4 && std::string_view{argv[1]} == "--convert-scene") {
+    Render::SceneFile::ConvertText(argv[2], argv[3]);
+    return 0;
+  }
+
+  // raytracing2_example_app [--threads N] [--affinity none|core|node] [--render-animation path.rtanim]
+  //                         [--coordinate address | --work address]
+  //                         [--regress directory | --update-references directory] [--max-rmse value]
+  //                         [--max-slowdown percent]
+  std::size_t threadCount = 0;
+  auto affinity = Utils::Affinity::None;
+  std::string animationPath;
+  std::string coordinatorAddress;
+  std::string workAddress;
+  std::optional<Render::Regression::Options> regression;
+  // the thresholds only apply to a regression run, they may come before --regress
+  std::optional<float> maxRmse;
+  std::optional<float> maxSlowdown;
+  for (int i = 1; i < argc; i += 2) {
+    const std::string_view option{argv[i]};
+    // every option takes a value
+    if (i + 1 == argc) {
+      throw std::runtime_error(fmt::format("Option '{}' needs a value", option));
+    }
+    if (option == "--threads") {
+      threadCount = std::stoul(argv[i + 1]);
+    } else if (option == "--affinity") {
+      affinity = Utils::ParseAffinity(argv[i + 1]);
+    } else if (option == "--render-animation") {
+      animationPath = argv[i + 1];
+    } else if (option == "--coordinate") {
+      coordinatorAddress = argv[i + 1];
+    } else if (option == "--work") {
+      workAddress = argv[i + 1];
+    } else if (option == "--regress" || option == "--update-references") {
+      regression.emplace();
+      regression->directory = argv[i + 1];
+      regression->update = option == "--update-references";
+    } else if (option == "--max-rmse") {
+      maxRmse = std::stof(argv[i + 1]);
+    } else if (option == "--max-slowdown") {
+      maxSlowdown = std::stof(argv[i + 1]) / 100.0f;
+    } else {
+      throw std::runtime_error(fmt::format("Unknown option '{}'", option));
+    }
+  }
+  if (!regression && (maxRmse || maxSlowdown)) {
+    throw std::runtime_error("--max-rmse and --max-slowdown need --regress or --update-references");
+  }
+  if (!coordinatorAddress.empty() && animationPath.empty()) {
+    throw std::runtime_error("--coordinate needs --render-animation");
+  }
+
+  // golden image and render time check of the built-in scenes, see Renderer/Regression.h
+  if (regression) {
+    regression->maxRmse = maxRmse.value_or(regression->maxRmse);
+    regression->maxSlowdown = maxSlowdown.value_or(regression->maxSlowdown);
+    return Render::Regression::Run(*regression, threadCount, affinity) == 0 ? 0 : 1;
+  }
+
+  // render leases for a coordinator, see Renderer/Distributed.h
+  if (!workAddress.empty()) {
+    Render::Distributed::Work(workAddress, threadCount, affinity);
+    return 0;
+  }
+
+  // batch render without a window, see Renderer/Animation.h for the file format. With --coordinate the frames
+  // are rendered by the workers that connect to the address instead
+  if (!animationPath.empty()) {
+    const auto animation = Render::Animation::Load(animationPath);
+    if (!coordinatorAddress.empty()) {
+      Render::Distributed::Options options;
+      options.address = coordinatorAddress;
+      Render::Distributed::Coordinate(animation, options);
+      return 0;
+    }
+    Render::Renderer renderer{threadCount, affinity};
+    if (const auto scene = magic_enum::enum_cast<Render::Renderer::Scenes>(animation.scene); scene) {
+      renderer.SetScene(*scene);
+    } else {
+      renderer.SetScene(Render::Renderer::Scenes::FromFile);
+      renderer.SetSceneFile(animation.scene);
+    }
+    renderer.SetImageSize(animation.imageSize.x, animation.imageSize.y);
+    renderer.SetSamplesPerPixel(animation.samplesPerPixel);
+    renderer.SetMaxRayBounces(animation.maxRayDepth);
+    return renderer.RenderAnimation(animation).get() ? 0 : 1;
+  }
 
   ApplicationSpecification spec;
   spec.Name = "Walnut Example";
@@ -43,7 +145,7 @@ int main(int argc, char **) {
   auto *app = new Application(spec);
 
   std::shared_ptr<ApplicationLayer> applicationLayer =
-      std::make_shared<ApplicationLayer>();
+      std::make_shared<ApplicationLayer>(threadCount, affinity);
   app->PushLayer(applicationLayer);
   // Sett callbacks
   app->SetMenubarCallback([app]() {
@@ -7,6 +7,14 @@ add_requires('imgui-walnut walnut', { configs = { glfw = true, vulkan = true } }
 add_requires('glfw-walnut walnut', { configs = { glfw_include = 'vulkan' } })
 add_requires('spdlog', 'fmt', 'magic_enum')
 
+-- xmake f --trace=y: record scoped trace events (Renderer/Trace.h)
+option('trace')
+set_default(false)
+set_showmenu(true)
+set_description('Record render pipeline trace events, exportable as Chrome trace JSON')
+add_defines('RTIAW_TRACE')
+option_end()
+
 -- main app
 target('raytracing2_example_app')
 set_languages('c++20')
@@ -15,6 +23,7 @@ add_files('**.cpp')
 add_includedirs('.')
 add_defines('RESOURCE_DIR="./wgpu"')
 add_defines('WEBGPU_BACKEND_WGPU')
+add_options('trace')
 set_targetdir('.')
 -- packges with link need
 add_packages('spdlog', 'fmt', 'magic_enum')